@@ -6,6 +6,27 @@ CONFIG(release, debug|release){
     #just uncomment next lines if you want to ignore asserts and got a more optimized binary
     #CONFIG += FINAL_RELEASE
 }
+#the ray/triangle kernel (raytrianglekernel.cpp) is written to be auto-vectorized:
+#only that file is compiled with -O3 -fno-trapping-math and an explicit ISA, so the binary
+#still runs on any x86-64 with SSE4.1. Uncomment next line to target AVX2 machines only
+#CONFIG += KERNEL_AVX2
+KERNEL_SOURCES = raytrianglekernel.cpp
+unix:!macx{
+    KERNEL_FLAGS = -O3 -fno-trapping-math -msse4.1
+    KERNEL_AVX2 {
+        KERNEL_FLAGS = -O3 -fno-trapping-math -mavx2
+    }
+    kernel.name = kernel
+    kernel.input = KERNEL_SOURCES
+    kernel.dependency_type = TYPE_C
+    kernel.variable_out = OBJECTS
+    kernel.output = ${QMAKE_VAR_OBJECTS_DIR}${QMAKE_FILE_IN_BASE}$${first(QMAKE_EXT_OBJ)}
+    kernel.commands = $${QMAKE_CXX} $(CXXFLAGS) $${KERNEL_FLAGS} $(DEFINES) $(INCPATH) -c ${QMAKE_FILE_IN} -o ${QMAKE_FILE_OUT}
+    QMAKE_EXTRA_COMPILERS += kernel
+}
+else {
+    SOURCES += $${KERNEL_SOURCES}
+}
 FINAL_RELEASE {
     unix:!macx{
         QMAKE_CXXFLAGS_RELEASE -= -g -O2
@@ -22,6 +43,27 @@ macx{
     }
 }
 
+#Embree: runs the visibility ray queries through Intel Embree 3 instead of the CGAL AABB tree
+#Uncomment next line to enable it (set EMBREE_HOME if Embree is not installed system-wide)
+#CONFIG += EMBREE
+EMBREE {
+    message (Embree)
+    exists($$(EMBREE_HOME)){
+        INCLUDEPATH += $$(EMBREE_HOME)/include
+        LIBS += -L$$(EMBREE_HOME)/lib
+    }
+    LIBS += -lembree3
+    DEFINES += EMBREE_DEFINED
+    SOURCES += embreeraycaster.cpp
+    HEADERS += embreeraycaster.h
+}
+
+#Uncomment next line to count the heap allocations of the visibility ray queries
+#CONFIG += COUNT_ALLOCATIONS
+COUNT_ALLOCATIONS {
+    DEFINES += COUNT_ALLOCATIONS
+}
+
 #Add or remove all the modules you need
 #Before pushing the project with your new module, please double check that everything works keeping uncommentend
 #only the modules that are required by your module. Also please write here required and optional modules for your module
@@ -46,7 +88,7 @@ include (cgal/cgal.pri)
 #Trimesh module: contains a Trimesh data structure
 #Requires: Common module
 #Optional: Viewer module
-#include (trimesh/trimesh.pri)
+include (trimesh/trimesh.pri)
 
 #Igl module: coontaint an intergace to some functionalities of libIGL
 #Requires: Common module, libIGL (an environment variable named LIBIGL containing the root directory of the library must be setted)
@@ -61,12 +103,25 @@ message(Included modules: $$MODULES)
 SOURCES += \
     main.cpp \
     drawmanager.cpp \
-    polylinesCheck.cpp
+    polylinesCheck.cpp \
+    visibilitycache.cpp \
+    visibilityresult.cpp \
+    exportqueue.cpp \
+    facetree.cpp \
+    allocationcounter.cpp
 
 FORMS += \
     drawmanager.ui
 
 HEADERS += \
     drawmanager.h \
-    polylinesCheck.h
+    polylinesCheck.h \
+    visibilitycache.h \
+    visibilityresult.h \
+    exportqueue.h \
+    facetree.h \
+    raytrianglekernel.h \
+    rayscratch.h \
+    segmenttriangle.h \
+    allocationcounter.h
 
@@ -0,0 +1,18 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+/**
+ * Counts the calls to the global operator new. The counter is compiled only with
+ * CONFIG += COUNT_ALLOCATIONS (see CG3LabBase.pro), which replaces the global
+ * allocation functions; otherwise enabled() is false and count() is always 0.
+ */
+
+namespace AllocationCounter {
+
+bool                enabled ();
+
+unsigned long long  count   ();
+
+}
+
+#endif // ALLOCATIONCOUNTER_H
@@ -2,9 +2,17 @@
 #include "ui_drawmanager.h"
 
 #include <QtGui>
+#include <QDir>
+#include <QStandardPaths>
 #include <string>
 #include <QDebug>
 
+#include <trimesh/parallel.h>
+#include <trimesh/load_save_trimesh.h>
+#include <trimesh/weld.h>
+#include <trimesh/mesh_archive.h>
+#include <trimesh/load_progress.h>
+
 #define halfC (M_PI / 180)
 
 DrawManager::DrawManager(QWidget *parent) :
@@ -17,9 +25,42 @@ DrawManager::DrawManager(QWidget *parent) :
     //connect(mainWindow, SIGNAL(objectPicked(uint)),this, SLOT(on_triangleClicked(uint)));
     connect(mainWindow, SIGNAL(objectsPicked(QList<unsigned int>)),
             this, SLOT(on_triangleClicked(QList<unsigned int>)));
+
+    //Cache delle visibilità già calcolate, condivisa tra le sessioni
+    QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/visibility";
+    if(QDir().mkpath(cacheDir)){
+        visibilityCache.setDirectory(cacheDir.toStdString());
+        polyline.setVisibilityCache(&visibilityCache);
+    }
+
+    //gli indici del combo box seguono PolylinesCheck::RayBackend
+    #ifndef EMBREE_DEFINED
+    ui->rayBackend->removeItem(PolylinesCheck::EMBREE_RAYS);
+    #endif
+    ui->rayBackend->setCurrentIndex(polyline.getRayBackend());
+
+    //i salvataggi girano in background: la barra mostra quelli ancora in coda
+    ui->exportProgress->setVisible(false);
+    connect(&exportQueue, SIGNAL(progress(int,int)), this, SLOT(exportQueueProgress(int,int)));
+    connect(&exportQueue, SIGNAL(failed(QString)), this, SLOT(exportQueueFailed(QString)));
+    connect(&exportQueue, SIGNAL(finished()), this, SLOT(exportQueueFinished()));
+
+    //le mesh si caricano in background: prima un'anteprima a punti, poi la mesh completa
+    setLoading(false);
+    connect(&meshLoader, SIGNAL(progress(int)), ui->loadProgress, SLOT(setValue(int)));
+    connect(&meshLoader, SIGNAL(previewReady()), this, SLOT(meshPreviewReady()));
+    connect(&meshLoader, SIGNAL(loaded()), this, SLOT(meshLoaded()));
+    connect(&meshLoader, SIGNAL(canceled()), this, SLOT(meshLoadStopped()));
+    connect(&meshLoader, SIGNAL(failed()), this, SLOT(meshLoadFailed()));
 }
 
 DrawManager::~DrawManager(){
+    //i file in coda vanno completati prima di chiudere, il caricamento in corso no
+    exportQueue.waitForDone();
+    meshLoader.cancel();
+    meshLoader.wait();
+    delete loadingMesh;
+    removePreview();
     delete ui;
 }
 
@@ -49,6 +90,7 @@ void DrawManager::setButtonMeshLoaded(bool b){
     ui->resetParam->setEnabled(b);
     ui->meshToOrigin->setEnabled(b);
     ui->visualFrame->setEnabled(b);
+    ui->loadResult->setEnabled(b);
 
     ui->selectAxis->setEnabled(b);
         QList<QWidget*> list = ui->selectAxis->findChildren<QWidget*>() ;
@@ -90,16 +132,85 @@ void DrawManager::on_loadMesh_clicked(){
     QString filename = QFileDialog::getOpenFileName(nullptr,
                        "Open Eigen Mesh",
                        ".",
-                       "OBJ(*.obj);;PLY(*.ply)");
-    string nameMesh = filename.toStdString().substr(filename.toStdString().find_last_of("/") + 1);
+                       "OBJ(*.obj);;PLY(*.ply);;STL(*.stl);;Trimesh archive(*.tmz)");
     if (!filename.isEmpty()) {
-        meshEigen = new PickableEigenmesh();
-        meshEigen->readFromObj(filename.toStdString());        
-        mainWindow->pushObj(meshEigen, nameMesh);
-        setButtonMeshLoaded(true);
-        mainWindow->updateGlCanvas();
+        //lettura, fusione dei vertici e normali girano sul worker: la mesh si vede solo quando è pronta
+        PickableEigenmesh* mesh = new PickableEigenmesh();
+        std::string path = filename.toUtf8().constData();
+        loadingReport.clear();
+        bool started = meshLoader.start(filename, [this, mesh, path](){
+            std::vector<double> xyz;
+            std::vector<int> tri;
+            QString file = QString::fromStdString(path);
+            //i lettori restituiscono false se il file non si legge o se il caricamento è annullato
+            if(file.endsWith(".ply", Qt::CaseInsensitive)){
+                //i PLY (binari degli scanner o ascii) passano dal lettore del modulo trimesh
+                if (!loadPly(path.c_str(), xyz, tri)) return false;
+            }
+            else if(file.endsWith(".stl", Qt::CaseInsensitive)){
+                //gli STL hanno tre vertici per faccia: vanno fusi prima di costruire la mesh
+                if (!loadStl(path.c_str(), xyz, tri)) return false;
+                //il resoconto si mostra nella barra di stato quando la mesh è pronta (meshLoaded)
+                weldReport report = weldVertices(xyz, tri, weldTolerance(xyz));
+                loadingReport = tr("%1 vertices merged, %2 degenerate and %3 duplicate triangles removed.")
+                                .arg(report.mergedVertices).arg(report.degenerateFaces).arg(report.duplicateFaces);
+            }
+            else if(file.endsWith(".tmz", Qt::CaseInsensitive)){
+                //archivio compresso (saveArchive): decodificato a blocchi in parallelo
+                if (!loadArchive(path.c_str(), xyz, tri)) return false;
+            }
+            else{
+                //anche gli OBJ passano dal lettore del modulo trimesh: riporta l'avanzamento, si interrompe
+                //e rilegge le coordinate esatte (l'hash dei risultati .vres deve coincidere)
+                if (!loadObj(path.c_str(), xyz, tri)) return false;
+            }
+            if (LoadProgress::current()->isCanceled()) return false;
+            fillEigenMesh(mesh, xyz, tri);
+            return true;
+        });
+        if (started){
+            loadingMesh = mesh;
+            loadingName = filename.toStdString().substr(filename.toStdString().find_last_of("/") + 1);
+            setLoading(true);
+        }
+        else delete mesh;
     }
-    if(nameMesh == "batman_bust.obj"){
+}
+
+void DrawManager::on_cancelLoad_clicked(){
+    meshLoader.cancel();
+}
+
+void DrawManager::meshPreviewReady(){
+    //nuvola di punti campionata dal file, mostrata finché la mesh non è pronta
+    const std::vector<double>& xyz = meshLoader.preview();
+    int nVertices = (int)xyz.size()/3;
+    previewMesh = new DrawableEigenMesh();
+    previewMesh->resizeVertices(nVertices);
+    for (int v = 0; v < nVertices; v++){
+        previewMesh->setVertex(v, xyz[3*v], xyz[3*v+1], xyz[3*v+2]);
+    }
+    previewMesh->updateBoundingBox();
+    previewMesh->setPointsShading();
+    mainWindow->pushObj(previewMesh, "Preview");
+    mainWindow->updateGlCanvas();
+}
+
+void DrawManager::meshLoaded(){
+    //la mesh completa sostituisce l'anteprima in un solo passo
+    removePreview();
+    meshEigen = loadingMesh;
+    loadingMesh = nullptr;
+    setLoading(false);
+    polyline.invalidateIntersectTree();
+    mainWindow->pushObj(meshEigen, loadingName);
+    setButtonMeshLoaded(true);
+    if(!loadingReport.isEmpty()){
+        mainWindow->statusBar()->showMessage(QString::fromStdString(loadingName) + ": " + loadingReport);
+    }
+    mainWindow->updateGlCanvas();
+
+    if(loadingName == "batman_bust.obj"){
         selection = 1;
         coordPlane.setXCoord(0);
         coordPlane.setYCoord(52);
@@ -119,8 +230,33 @@ void DrawManager::on_loadMesh_clicked(){
     QColor c;
     c.setHsv(100,0,255);
 
-    for(unsigned int i = 0 ; i < meshEigen->getNumberFaces(); i++){
-        meshEigen->setFaceColor(c.redF(), c.greenF(), c.blueF(), i);
+    colorAllFaces(c);
+}
+
+void DrawManager::meshLoadStopped(){
+    removePreview();
+    delete loadingMesh;
+    loadingMesh = nullptr;
+    setLoading(false);
+    mainWindow->updateGlCanvas();
+}
+
+void DrawManager::meshLoadFailed(){
+    meshLoadStopped();
+    QMessageBox::warning(this, "Attenzione", "Impossibile leggere " + QString::fromStdString(loadingName));
+}
+
+void DrawManager::setLoading(bool b){
+    ui->loadMesh->setEnabled(!b && meshEigen == nullptr);
+    ui->loadProgress->setVisible(b);
+    ui->cancelLoad->setVisible(b);
+}
+
+void DrawManager::removePreview(){
+    if (previewMesh != nullptr){
+        mainWindow->deleteObj(previewMesh);
+        delete previewMesh;
+        previewMesh = nullptr;
     }
 }
 
@@ -279,10 +415,15 @@ void DrawManager::on_clearMesh_clicked(){
     ui->visualFrame->setEnabled(false);
     ui->checkFrame->setEnabled(false);
     ui->selectAxis_2->setEnabled(false);
+    ui->loadResult->setEnabled(false);
+    ui->resultOrientation->setEnabled(false);
+    ui->resultUnique->setEnabled(false);
+    visibilityResult.clear();
     mainWindow->deleteObj(meshEigen);
     mainWindow->clearDebugCylinders();
     mainWindow->clearDebugSpheres();
     delete meshEigen;
+    polyline.invalidateIntersectTree();
     polyline.getChecker().clear();
     meshEigen = nullptr;
 
@@ -361,6 +502,7 @@ void DrawManager::on_drawPoint_clicked(){
 void DrawManager::on_translate_clicked(){
     Pointd centro(-((polyline.getMax()-polyline.getMin())/2+polyline.getMin()));
     meshEigen->translate(centro);
+    polyline.invalidateIntersectTree();
     Matrix3d rotation;
     Vec3 y(1,0,0);
     Vec3 z(0,0,1);
@@ -390,13 +532,15 @@ void DrawManager::on_check_clicked(){
     Vec3 axis(1,0,0);
     QColor c;
     polyline.updateChecker(false);
-    polyline.check(meshEigen,angleCStart,0);
+    polyline.setCacheMeshKey(VisibilityCache::meshHash(*meshEigen));
+    polyline.invalidateIntersectTree();
+    polyline.check(meshEigen,angleCStart,0,sweepDirection(0));
 
     for(int i = 0; i < nPlaneUser; i++){
         Common::getRotationMatrix(axis, (stepAngle * halfC), rotation);
         meshEigen->rotate(rotation,Vector3d(0,0,0));
         meshEigen->updateBoundingBox();
-        polyline.check(meshEigen,angleCStart,0);
+        polyline.check(meshEigen,angleCStart,0,sweepDirection(stepAngle * halfC * (i+1)));
         mainWindow->updateGlCanvas();
     }
 
@@ -428,18 +572,38 @@ void DrawManager::on_check_clicked(){
 
 void DrawManager::on_stepByStep_clicked(){
     if(filename == ""){
-        on_saveMesh_clicked();
+        //solo il percorso: la mesh si scrive una volta sotto, con cifre esatte
+        QString file = QFileDialog::getSaveFileName(mainWindow, tr("Export surface to file"), "",
+                                                    tr("OBJ files (*.obj);;All files (*)"));
+        if(file.isEmpty()){
+            return;
+        }
+        if(!file.endsWith(".obj", Qt::CaseInsensitive)){
+            file += ".obj";
+        }
+        filename = file;
     }
 
     Vec3 axis(1,0,0);
     QColor c;
     c.setHsv(100,0,255);
+    unsigned long long meshKey = VisibilityCache::meshHash(*meshEigen);
+    polyline.setCacheMeshKey(meshKey);
+    polyline.invalidateIntersectTree();
     Matrix3d rotation = getRotationMatrix(axis, (stepAngle * halfC * increse));
 
-    for(unsigned int i = 0 ; i < meshEigen->getNumberFaces(); i++){
-        c.setHsv(100,0,127);
-        meshEigen->setFaceColor(c.redF(), c.greenF(), c.blueF(), i);
-    }
+    //la geometria si copia una volta per tutto lo sweep: gli export cambiano solo i colori
+    ExportQueue::GeometryPtr geometry = snapshotGeometry();
+
+    //la mesh si salva una sola volta, con cifre che si rileggono identiche: il risultato la riferisce per hash
+    const QString base = baseName();
+    exportMesh(filename, geometry, OBJ_EXACT_PRECISION);
+    visibilityResult.setMesh(meshKey, meshEigen->getNumberFaces(), filename.toStdString());
+    std::vector<Vec3> directions;
+    VectI colors;
+
+    c.setHsv(100,0,127);
+    colorAllFaces(c);
 
     mainWindow->updateGlCanvas();
 
@@ -450,18 +614,18 @@ void DrawManager::on_stepByStep_clicked(){
     polyline.setCheckerDimension(nPlaneUser,meshEigen->getNumberFaces());
     polyline.updateChecker(false);
 
-    polyline.check(meshEigen,nextColor,0);
+    polyline.check(meshEigen,nextColor,0,sweepDirection(stepAngle * halfC * increse));
+    directions.push_back(sweepDirection(stepAngle * halfC * increse));
+    colors.push_back(nextColor);
 
     rotation = getRotationMatrix(axis, -(stepAngle * halfC * increse));
     meshEigen->rotate(rotation,Vector3d(0,0,0));
-    filename.truncate(filename.size()-4);
     QString format = ".obj";
-    meshEigen->saveOnObj((filename + QString::number(increse)+format).toUtf8().constData());
+    if(ui->exportObj->isChecked())
+        exportMesh(base + QString::number(increse)+format, geometry);
 
-    for(unsigned int i = 0 ; i < meshEigen->getNumberFaces(); i++){
-        c.setHsv(100,0,127);
-        meshEigen->setFaceColor(c.redF(), c.greenF(), c.blueF(), i);
-    }
+    c.setHsv(100,0,127);
+    colorAllFaces(c);
     increse++;
     nextColor += stepColor;
     for(int i = 0; i < nPlaneUser; i++){
@@ -469,16 +633,17 @@ void DrawManager::on_stepByStep_clicked(){
         meshEigen->rotate(rotation,Vector3d(0,0,0));
         meshEigen->updateBoundingBox();
 
-        polyline.check(meshEigen,nextColor,i+1);
+        polyline.check(meshEigen,nextColor,i+1,sweepDirection(stepAngle * halfC * increse));
+        directions.push_back(sweepDirection(stepAngle * halfC * increse));
+        colors.push_back(nextColor);
         //mainWindow->updateGlCanvas();
 
         rotation = getRotationMatrix(axis, -(stepAngle * halfC * increse));
         meshEigen->rotate(rotation,Vector3d(0,0,0));
 
-        meshEigen->saveOnObj((filename + QString::number(increse)+format).toUtf8().constData());
-        for(unsigned int i = 0 ; i < meshEigen->getNumberFaces(); i++){
-            meshEigen->setFaceColor(c.redF(), c.greenF(), c.blueF(), i);
-        }
+        if(ui->exportObj->isChecked())
+            exportMesh(base + QString::number(increse)+format, geometry);
+        colorAllFaces(c);
         increse++;
         nextColor += stepColor;
     }
@@ -487,12 +652,30 @@ void DrawManager::on_stepByStep_clicked(){
 
         polyline.minimizeProblem();
         polyline.serchUniqueTriangoForOrientation();
-        colorUniqueTriangle();
+        colorUniqueTriangle(geometry);
+
+        //un solo file per tutto lo sweep: direzioni, copertura, orientamenti scelti e facce singole
+        MatrixI checker = polyline.getChecker();
+        for(unsigned int i = 0; i < checker.size(); i++){
+            //l'ultima riga del checker raccoglie le facce escluse: non ha una direzione
+            if(i < directions.size())
+                visibilityResult.addOrientation(directions[i], colors[i], checker[i], polyline.getFrontFaces()[i]);
+            else
+                visibilityResult.addOrientation(Vec3(), 0, checker[i], polyline.getFrontFaces()[i]);
+        }
+        visibilityResult.setSelection(polyline.getOrientationSelected(), polyline.getUniqueTriangle());
+        visibilityResult.save((base + ".vres").toStdString());
+
+        ui->resultOrientation->setRange(0, visibilityResult.getNumberOrientations()-1);
+        ui->resultOrientation->setEnabled(true);
+        ui->resultUnique->setEnabled(true);
+        showResult();
 }
 
 void DrawManager::on_meshToOrigin_clicked(){
     meshBerycenter = meshEigen->getBarycenter();
     meshEigen->translate(-meshBerycenter);
+    polyline.invalidateIntersectTree();
     mainWindow->updateGlCanvas();
 }
 
@@ -508,7 +691,7 @@ void DrawManager::on_saveMesh_clicked(){
     if(filedialog.exec()){
         filename = filedialog.selectedFiles().front();
         //std::cerr << "Saving to file \"" << filename.toLocal8Bit().data() << "\"...";
-        meshEigen->saveOnObj(filename.toUtf8().constData());
+        exportMesh(filename);
     }
 }
 
@@ -597,6 +780,7 @@ void DrawManager::rotate(int axisP){
     }
     meshEigen->rotate(rotation,Vector3d(0,0,0));
     meshEigen->updateBoundingBox();
+    polyline.invalidateIntersectTree();
     mainWindow->updateGlCanvas();
 }
 
@@ -651,12 +835,88 @@ void DrawManager::on_zPiu_clicked(){
 
 void DrawManager::translate(Pointd point){
     meshEigen->translate(point);
+    polyline.invalidateIntersectTree();
     mainWindow->updateGlCanvas();
 }
 
-void DrawManager::colorUniqueTriangle(){
+Vec3 DrawManager::sweepDirection(double angle) const{
+    //i raggi sono lungo y nella mesh ruotata di angle attorno a x:
+    //nel sistema di riferimento iniziale la direzione è R^T * (0,1,0)
+    return Vec3(0, cos(angle), -sin(angle));
+}
+
+void DrawManager::colorAllFaces(const QColor& c){
+    //ogni faccia scrive solo la propria riga dei colori: le facce si colorano in parallelo
+    double r = c.redF(), g = c.greenF(), b = c.blueF();
+    Parallel::forEach(meshEigen->getNumberFaces(), [&](int f){
+        meshEigen->setFaceColor(r, g, b, f);
+    });
+}
+
+void DrawManager::fillEigenMesh(PickableEigenmesh* target, const std::vector<double>& xyz, const std::vector<int>& tri){
+    //ogni vertice e ogni faccia scrive solo la propria riga: si copiano in parallelo
+    int nVertices = (int)xyz.size()/3;
+    int nFaces = (int)tri.size()/3;
+    target->resizeVertices(nVertices);
+    target->resizeFaces(nFaces);
+    Parallel::forEach(nVertices, [&](int v){
+        target->setVertex(v, xyz[3*v], xyz[3*v+1], xyz[3*v+2]);
+    });
+    Parallel::forEach(nFaces, [&](int f){
+        target->setFace(f, tri[3*f], tri[3*f+1], tri[3*f+2]);
+    });
+    target->updateFaceNormals();
+    target->updateVertexNormals();
+    target->updateBoundingBox();
+}
+
+ExportQueue::GeometryPtr DrawManager::snapshotGeometry(){
+    //vertici e facce copiati in parallelo: la copia è immutabile e condivisa dai salvataggi in coda
+    std::shared_ptr<ExportQueue::Geometry> geometry(new ExportQueue::Geometry);
+    int nVertices = meshEigen->getNumberVertices();
+    int nFaces = meshEigen->getNumberFaces();
+    geometry->xyz.resize(3*nVertices);
+    geometry->tri.resize(3*nFaces);
+    Parallel::forEach(nVertices, [&](int v){
+        Pointd p = meshEigen->getVertex(v);
+        geometry->xyz[3*v] = p.x(); geometry->xyz[3*v+1] = p.y(); geometry->xyz[3*v+2] = p.z();
+    });
+    Parallel::forEach(nFaces, [&](int f){
+        Pointi t = meshEigen->getFace(f);
+        geometry->tri[3*f] = t.x(); geometry->tri[3*f+1] = t.y(); geometry->tri[3*f+2] = t.z();
+    });
+    return geometry;
+}
+
+void DrawManager::exportMesh(const QString& file, int precision){
+    exportMesh(file, snapshotGeometry(), precision);
+}
+
+void DrawManager::exportMesh(const QString& file, const ExportQueue::GeometryPtr& geometry, int precision){
+    //sul thread della GUI si copiano solo i colori: la scrittura (saveObj) avviene in background
+    int nFaces = meshEigen->getNumberFaces();
+    std::vector<float> colors(3*nFaces);
+    Parallel::forEach(nFaces, [&](int f){
+        QColor c = meshEigen->getFaceColor(f);
+        colors[3*f] = c.redF(); colors[3*f+1] = c.greenF(); colors[3*f+2] = c.blueF();
+    });
+    exportQueue.enqueue(file, geometry, std::move(colors), precision);
+}
+
+//il file della mesh senza estensione: prefisso degli OBJ per orientamento e del .vres
+QString DrawManager::baseName() const{
+    if(filename.endsWith(".obj", Qt::CaseInsensitive))
+        return filename.left(filename.size()-4);
+    return filename;
+}
+
+void DrawManager::colorUniqueTriangle(const ExportQueue::GeometryPtr& geometry){
 
     increse = 0;
+    //le facce singole sono già nel file del risultato: gli OBJ solo se richiesti
+    if(!ui->exportObj->isChecked()){
+        return;
+    }
     QString format = ".obj";
     QColor c;
     for(unsigned int i = 0; i <polyline.getUniqueTriangle().size();i++){
@@ -666,9 +926,7 @@ void DrawManager::colorUniqueTriangle(){
     for(unsigned int i = 0; i < polyline.getUniqueTriangle().size(); i++){
         //Coloro di nuovo tutta la mesh di grigio
         c.setHsv(0,0,127);
-        for(unsigned int i = 0 ; i < meshEigen->getNumberFaces(); i++){
-            meshEigen->setFaceColor(c.redF(), c.greenF(), c.blueF(), i);
-        }
+        colorAllFaces(c);
 
         //verifico se per l'orientamento selezionato esistono singoli triangoli visti
         if(polyline.getUniqueTriangle()[i].size() > 0){
@@ -678,7 +936,7 @@ void DrawManager::colorUniqueTriangle(){
                 meshEigen->setFaceColor(c.redF(), c.greenF(), c.blueF(), f);
             }
 
-            meshEigen->saveOnObj((filename + QString::number(polyline.getOrientationSelected()[i])+"singole"+format).toUtf8().constData());
+            exportMesh(baseName() + QString::number(polyline.getOrientationSelected()[i])+"singole"+format, geometry);
         }
 
     }
@@ -707,3 +965,75 @@ void DrawManager::on_flatMeshRadioButton_toggled(bool checked) {
         mainWindow->updateGlCanvas();
     }
 }
+
+void DrawManager::on_rayBackend_currentIndexChanged(int index){
+    polyline.setRayBackend((PolylinesCheck::RayBackend)index);
+}
+
+void DrawManager::on_loadResult_clicked(){
+    QString file = QFileDialog::getOpenFileName(nullptr,
+                   "Open visibility result",
+                   ".",
+                   "Visibility result(*.vres)");
+    if(file.isEmpty() || !visibilityResult.load(file.toStdString())){
+        return;
+    }
+    if(visibilityResult.getNumberFaces() != meshEigen->getNumberFaces()){
+        visibilityResult.clear();
+        ui->resultOrientation->setEnabled(false);
+        ui->resultUnique->setEnabled(false);
+        QMessageBox::warning(this, "Attenzione", "Il risultato è stato calcolato su un'altra mesh");
+        return;
+    }
+    if(visibilityResult.getMeshKey() != VisibilityCache::meshHash(*meshEigen)){
+        //stesse facce ma vertici diversi: le direzioni del risultato non valgono per questa mesh
+        QString meshFile = QString::fromStdString(visibilityResult.getMeshFile());
+        visibilityResult.clear();
+        ui->resultOrientation->setEnabled(false);
+        ui->resultUnique->setEnabled(false);
+        QMessageBox::warning(this, "Attenzione", "Il risultato è stato calcolato su un'altra mesh:\n" + meshFile);
+        return;
+    }
+    ui->resultOrientation->setRange(0, visibilityResult.getNumberOrientations()-1);
+    ui->resultOrientation->setEnabled(true);
+    ui->resultUnique->setEnabled(true);
+    showResult();
+}
+
+void DrawManager::on_resultOrientation_valueChanged(int value){
+    Q_UNUSED(value);
+    showResult();
+}
+
+void DrawManager::on_resultUnique_stateChanged(int arg1){
+    Q_UNUSED(arg1);
+    showResult();
+}
+
+void DrawManager::showResult(){
+    //colora la mesh con l'orientamento scelto del risultato, come gli OBJ esportati
+    if(meshEigen == nullptr || visibilityResult.getNumberOrientations() == 0 ||
+       visibilityResult.getNumberFaces() != meshEigen->getNumberFaces()){
+        return;
+    }
+    unsigned int orientation = ui->resultOrientation->value();
+    if(ui->resultUnique->isChecked())
+        visibilityResult.colorUniqueFaces(meshEigen, orientation);
+    else
+        visibilityResult.colorOrientation(meshEigen, orientation);
+    mainWindow->updateGlCanvas();
+}
+
+void DrawManager::exportQueueProgress(int done, int total){
+    ui->exportProgress->setMaximum(total);
+    ui->exportProgress->setValue(done);
+    ui->exportProgress->setVisible(true);
+}
+
+void DrawManager::exportQueueFailed(const QString& file){
+    mainWindow->statusBar()->showMessage(tr("Export to the OBJ file %1 failed!").arg(file));
+}
+
+void DrawManager::exportQueueFinished(){
+    ui->exportProgress->setVisible(false);
+}
@@ -27,6 +27,10 @@
 #include <QFrame>
 
 #include <polylinesCheck.h>
+#include <visibilitycache.h>
+#include <visibilityresult.h>
+#include <exportqueue.h>
+#include <trimesh/gui/meshloader.h>
 
 #ifdef __APPLE__
 #include <gl.h>
@@ -63,7 +67,7 @@ class DrawManager : public QFrame
         explicit DrawManager(QWidget *parent = 0);
         ~DrawManager();
 
-    void colorUniqueTriangle();
+    void colorUniqueTriangle(const ExportQueue::GeometryPtr& geometry);
 
 private slots:
 
@@ -168,13 +172,58 @@ private slots:
         void on_pointsMeshRadioButton_toggled(bool checked);
 
         void on_flatMeshRadioButton_toggled(bool checked);
+
+        void on_rayBackend_currentIndexChanged  (int index);
+
+        void on_loadResult_clicked              ();
+
+        void on_resultOrientation_valueChanged  (int value);
+
+        void on_resultUnique_stateChanged       (int arg1);
+
+        void exportQueueProgress                (int done, int total);
+
+        void exportQueueFailed                  (const QString& file);
+
+        void exportQueueFinished                ();
+
+        void on_cancelLoad_clicked              ();
+
+        void meshPreviewReady                   ();
+
+        void meshLoaded                         ();
+
+        void meshLoadStopped                    ();
+
+        void meshLoadFailed                     ();
 private:
 
-        PickableEigenmesh*  meshEigen;
+        Vec3                sweepDirection      (double angle) const;
+        void                colorAllFaces       (const QColor& c);
+        ExportQueue::GeometryPtr snapshotGeometry();
+        QString             baseName            () const;
+        void                exportMesh          (const QString& file, int precision = 6);
+        void                exportMesh          (const QString& file, const ExportQueue::GeometryPtr& geometry,
+                                                 int precision = 6);
+        void                fillEigenMesh       (PickableEigenmesh* target, const std::vector<double>& xyz,
+                                                 const std::vector<int>& tri);
+        void                setLoading          (bool b);
+        void                removePreview       ();
+        void                showResult          ();
+
+        PickableEigenmesh*  meshEigen = nullptr;
+        PickableEigenmesh*  loadingMesh = nullptr;  //riempita dal worker, non ancora disegnata
+        DrawableEigenMesh*  previewMesh = nullptr;  //nuvola di punti mostrata durante il caricamento
         PolylinesCheck      polyline;
+        VisibilityCache     visibilityCache;
+        VisibilityResult    visibilityResult;
+        ExportQueue         exportQueue;
+        MeshLoader          meshLoader;
         Ui::DrawManager*    ui;
         MainWindow*         mainWindow;
         QString             filename;
+        std::string         loadingName;
+        QString             loadingReport;      //scritto dal worker, letto in meshLoaded
         Pointd              vectorUser;
         Pointd              point;
         Pointd              meshBerycenter;
@@ -0,0 +1,171 @@
+#include "embreeraycaster.h"
+#include "segmenttriangle.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#define STREAM_SIZE 4096        // rays per rtcIntersect1M call
+
+namespace {
+
+struct QueryContext {
+    RTCIntersectContext         context;    //must be the first member
+    const Pointd*               p1;
+    const Pointd*               p2;
+    std::vector<int>*           faces;
+};
+
+//float bounds that contain the double ones, with some room for the rounding of the rays
+inline float lowerBound(double v){
+    float f = (float)v;
+    if (f > v) f = std::nextafter(f, -INFINITY);
+    return f - std::fabs(f) * 1e-6f - 1e-30f;
+}
+
+inline float upperBound(double v){
+    float f = (float)v;
+    if (f < v) f = std::nextafter(f, INFINITY);
+    return f + std::fabs(f) * 1e-6f + 1e-30f;
+}
+
+inline void setRay(RTCRayHit& rh, const Pointd& p1, const Pointd& p2, unsigned int id){
+    rh.ray.org_x = p1.x();
+    rh.ray.org_y = p1.y();
+    rh.ray.org_z = p1.z();
+    rh.ray.dir_x = p2.x() - p1.x();
+    rh.ray.dir_y = p2.y() - p1.y();
+    rh.ray.dir_z = p2.z() - p1.z();
+    rh.ray.tnear = 0;
+    rh.ray.tfar = 1;    //segment
+    rh.ray.time = 0;
+    rh.ray.mask = -1;
+    rh.ray.id = id;
+    rh.ray.flags = 0;
+    rh.hit.geomID = RTC_INVALID_GEOMETRY_ID;
+    rh.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+}
+
+inline void sortUnique(std::vector<int>& faces){
+    std::sort(faces.begin(), faces.end());
+    faces.erase(std::unique(faces.begin(), faces.end()), faces.end());
+}
+
+}
+
+EmbreeRayCaster::EmbreeRayCaster(const DrawableEigenMesh& mesh) : device(nullptr), scene(nullptr){
+    unsigned int nVertices = mesh.getNumberVertices();
+    unsigned int nFaces = mesh.getNumberFaces();
+    coords.resize(nVertices*3);
+    tris.resize(nFaces*3);
+    for(unsigned int i = 0; i < nVertices; i++){
+        Pointd v = mesh.getVertex(i);
+        coords[3*i+0] = v.x();
+        coords[3*i+1] = v.y();
+        coords[3*i+2] = v.z();
+    }
+    for(unsigned int i = 0; i < nFaces; i++){
+        Pointi f = mesh.getFace(i);
+        tris[3*i+0] = f.x();
+        tris[3*i+1] = f.y();
+        tris[3*i+2] = f.z();
+    }
+
+    device = rtcNewDevice(nullptr);
+    if (device == nullptr){
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : EmbreeRayCaster() : couldn't create Embree device, error " << rtcGetDeviceError(nullptr) << std::endl;
+        return;
+    }
+    scene = rtcNewScene(device);
+    rtcSetSceneFlags(scene, RTC_SCENE_FLAG_ROBUST);
+    rtcSetSceneBuildQuality(scene, RTC_BUILD_QUALITY_HIGH);
+
+    RTCGeometry geometry = rtcNewGeometry(device, RTC_GEOMETRY_TYPE_USER);
+    rtcSetGeometryUserPrimitiveCount(geometry, nFaces);
+    rtcSetGeometryUserData(geometry, this);
+    rtcSetGeometryBoundsFunction(geometry, bounds, nullptr);
+    rtcSetGeometryIntersectFunction(geometry, intersect);
+    rtcCommitGeometry(geometry);
+    rtcAttachGeometry(scene, geometry);
+    rtcReleaseGeometry(geometry);
+    rtcCommitScene(scene);
+}
+
+EmbreeRayCaster::~EmbreeRayCaster(){
+    if (scene != nullptr) rtcReleaseScene(scene);
+    if (device != nullptr) rtcReleaseDevice(device);
+}
+
+void EmbreeRayCaster::getIntersectEigenFaces(const Pointd& p1, const Pointd& p2, std::vector<int>& faces) const{
+    if (scene == nullptr) return;
+    QueryContext ctx;
+    rtcInitIntersectContext(&ctx.context);
+    ctx.p1 = &p1;
+    ctx.p2 = &p2;
+    ctx.faces = &faces;
+    RTCRayHit rh;
+    setRay(rh, p1, p2, 0);
+    rtcIntersect1(scene, &ctx.context, &rh);
+    sortUnique(faces);
+}
+
+void EmbreeRayCaster::getIntersectEigenFaces(const std::vector<Pointd>& p1, const std::vector<Pointd>& p2,
+                                             std::vector<std::vector<int> >& faces) const{
+    faces.resize(p1.size());
+    if (scene == nullptr) return;
+    std::vector<RTCRayHit> rays(std::min<size_t>(p1.size(), STREAM_SIZE));
+    for (size_t first = 0; first < p1.size(); first += STREAM_SIZE){
+        unsigned int n = (unsigned int)std::min<size_t>(p1.size() - first, STREAM_SIZE);
+        QueryContext ctx;
+        rtcInitIntersectContext(&ctx.context);
+        ctx.context.flags = RTC_INTERSECT_CONTEXT_FLAG_COHERENT;
+        ctx.p1 = &p1[first];
+        ctx.p2 = &p2[first];
+        ctx.faces = &faces[first];
+        for (unsigned int i = 0; i < n; i++){
+            setRay(rays[i], p1[first+i], p2[first+i], i);
+        }
+        rtcIntersect1M(scene, &ctx.context, rays.data(), n, sizeof(RTCRayHit));
+        for (unsigned int i = 0; i < n; i++){
+            sortUnique(faces[first+i]);
+        }
+    }
+}
+
+void EmbreeRayCaster::bounds(const RTCBoundsFunctionArguments* args){
+    const EmbreeRayCaster* self = (const EmbreeRayCaster*)args->geometryUserPtr;
+    const int* t = &self->tris[3*args->primID];
+    double lo[3], hi[3];
+    for (int k = 0; k < 3; k++){
+        lo[k] = hi[k] = self->coords[3*t[0]+k];
+        for (int j = 1; j < 3; j++){
+            lo[k] = std::min(lo[k], self->coords[3*t[j]+k]);
+            hi[k] = std::max(hi[k], self->coords[3*t[j]+k]);
+        }
+    }
+    RTCBounds* b = args->bounds_o;
+    b->lower_x = lowerBound(lo[0]);
+    b->lower_y = lowerBound(lo[1]);
+    b->lower_z = lowerBound(lo[2]);
+    b->upper_x = upperBound(hi[0]);
+    b->upper_y = upperBound(hi[1]);
+    b->upper_z = upperBound(hi[2]);
+}
+
+void EmbreeRayCaster::intersect(const RTCIntersectFunctionNArguments* args){
+    //the hit is recorded but never committed, so the traversal visits every face along the segment
+    const EmbreeRayCaster* self = (const EmbreeRayCaster*)args->geometryUserPtr;
+    const QueryContext* ctx = (const QueryContext*)args->context;
+    RTCRayN* rays = RTCRayHitN_RayN(args->rayhit, args->N);
+    const int* t = &self->tris[3*args->primID];
+    const double* a = &self->coords[3*t[0]];
+    const double* b = &self->coords[3*t[1]];
+    const double* c = &self->coords[3*t[2]];
+    for (unsigned int i = 0; i < args->N; i++){
+        if (!args->valid[i]) continue;
+        unsigned int id = RTCRayN_id(rays, args->N, i);
+        double p[3] = {ctx->p1[id].x(), ctx->p1[id].y(), ctx->p1[id].z()};
+        double q[3] = {ctx->p2[id].x(), ctx->p2[id].y(), ctx->p2[id].z()};
+        if (SegmentTriangle::intersect(p, q, a, b, c)) ctx->faces[id].push_back(args->primID);
+    }
+}
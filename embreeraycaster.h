@@ -0,0 +1,44 @@
+#ifndef EMBREERAYCASTER_H
+#define EMBREERAYCASTER_H
+
+#include <eigenmesh/eigenmesh/gui/drawableeigenmesh.h>
+#include <embree3/rtcore.h>
+
+#include <vector>
+
+/**
+ * @brief Segment queries over an eigen mesh through Intel Embree.
+ *
+ * Same contract as CGALInterface::AABBTree::getIntersectEigenFaces: every face
+ * touched by the closed segment p1-p2 is reported. Embree provides the BVH and the
+ * ray streams; each candidate face is then tested in double precision against the
+ * original segment, so the faces reported are the same of the CGAL tree.
+ */
+class EmbreeRayCaster
+{
+    public:
+        EmbreeRayCaster(const DrawableEigenMesh& mesh);
+
+        ~EmbreeRayCaster();
+
+        void    getIntersectEigenFaces  (const Pointd& p1, const Pointd& p2, std::vector<int>& faces) const;
+
+        void    getIntersectEigenFaces  (const std::vector<Pointd>& p1, const std::vector<Pointd>& p2,
+                                         std::vector< std::vector<int> >& faces) const;
+
+    private:
+
+        EmbreeRayCaster(const EmbreeRayCaster&);
+        EmbreeRayCaster& operator=(const EmbreeRayCaster&);
+
+        static void bounds              (const RTCBoundsFunctionArguments* args);
+
+        static void intersect           (const RTCIntersectFunctionNArguments* args);
+
+        RTCDevice               device;
+        RTCScene                scene;
+        std::vector<double>     coords;
+        std::vector<int>        tris;
+};
+
+#endif // EMBREERAYCASTER_H
@@ -0,0 +1,79 @@
+#include "exportqueue.h"
+
+#include <QMutexLocker>
+#include <QRunnable>
+
+#include <utility>
+
+#include <trimesh/load_save_trimesh.h>
+
+class ExportQueue::Job : public QRunnable
+{
+    public:
+        Job(ExportQueue* queue, const QString& file, const GeometryPtr& geometry,
+            std::vector<float>& colors, int precision) :
+            queue(queue), file(file), geometry(geometry), precision(precision){
+            this->colors.swap(colors);
+        }
+
+        void run(){
+            bool ok = saveObj(file.toUtf8().constData(), geometry->xyz, geometry->tri, colors, precision);
+            //la memoria del job si libera subito, prima che il segnale arrivi alla GUI
+            std::vector<float>().swap(colors);
+            geometry.reset();
+            queue->jobDone(file, ok);
+        }
+
+    private:
+        ExportQueue*        queue;
+        QString             file;
+        GeometryPtr         geometry;
+        std::vector<float>  colors;
+        int                 precision;
+};
+
+ExportQueue::ExportQueue(QObject* parent) : QObject(parent), done(0), total(0){
+    pool.setMaxThreadCount(1);
+}
+
+ExportQueue::~ExportQueue(){
+    pool.waitForDone();
+}
+
+void ExportQueue::enqueue(const QString& file, const GeometryPtr& geometry,
+                          std::vector<float> colors, int precision){
+    {
+        QMutexLocker lock(&mutex);
+        if(done == total){
+            done = total = 0;
+        }
+        total++;
+    }
+    pool.start(new Job(this, file, geometry, colors, precision));
+}
+
+int ExportQueue::pending() const{
+    QMutexLocker lock(&mutex);
+    return total - done;
+}
+
+void ExportQueue::waitForDone(){
+    pool.waitForDone();
+}
+
+void ExportQueue::jobDone(const QString& file, bool ok){
+    int d, t;
+    {
+        QMutexLocker lock(&mutex);
+        d = ++done;
+        t = total;
+    }
+    if(ok)
+        emit exported(file);
+    else
+        emit failed(file);
+    emit progress(d, t);
+    if(d == t){
+        emit finished();
+    }
+}
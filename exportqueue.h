@@ -0,0 +1,72 @@
+#ifndef EXPORTQUEUE_H
+#define EXPORTQUEUE_H
+
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Background writer of colored OBJ files: the GUI thread (and the sweep running on
+ * it) only takes a snapshot of the mesh and goes on while the file is written.
+ *
+ * A job owns everything it writes. The geometry is an immutable snapshot shared between
+ * jobs, so the exports of the same mesh (e.g. the orientations of a sweep) copy it only
+ * once; every job has its own copy of the face colors. Jobs are written one at a time,
+ * in the order they were queued (saveObj already formats on the whole thread pool), so
+ * a later export of a file always wins over an earlier one.
+ *
+ * Every job ends with exported() or, if the file could not be written, failed(); then
+ * progress() counts it either way. progress(), exported(), failed() and finished() are
+ * emitted from the writer thread: connected to an object of the GUI thread they are
+ * delivered there, through its event loop.
+ */
+class ExportQueue : public QObject
+{
+        Q_OBJECT
+
+    public:
+        struct Geometry {
+            std::vector<double> xyz;
+            std::vector<int>    tri;
+        };
+
+        typedef std::shared_ptr<const Geometry>                   GeometryPtr;
+
+        explicit ExportQueue(QObject* parent = 0);
+
+        ~ExportQueue();
+
+        void    enqueue                 (const QString& file, const GeometryPtr& geometry,
+                                         std::vector<float> colors, int precision = 6);
+
+        int     pending                 () const;
+
+        void    waitForDone             ();
+
+    signals:
+
+        void    progress                (int done, int total);
+
+        void    exported                (const QString& file);
+
+        void    failed                  (const QString& file);
+
+        void    finished                ();
+
+    private:
+
+        class Job;
+
+        mutable QMutex      mutex;
+        QThreadPool         pool;
+        int                 done;       //jobs written since the queue was last empty
+        int                 total;      //jobs queued since the queue was last empty
+
+        void    jobDone                 (const QString& file, bool ok);
+};
+
+#endif // EXPORTQUEUE_H
@@ -0,0 +1,216 @@
+#include "facetree.h"
+#include "segmenttriangle.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+
+struct CentroidLess {
+    const std::vector<double>& centroids;
+    int axis;
+    CentroidLess(const std::vector<double>& centroids, int axis) : centroids(centroids), axis(axis) {}
+    bool operator()(int a, int b) const { return centroids[3*a+axis] < centroids[3*b+axis]; }
+};
+
+//boxes are slightly enlarged, so the slab test never rejects a face the exact test would accept
+inline double pad(double v){
+    return 1e-9 * (std::fabs(v) + 1);
+}
+
+}
+
+FaceTree::FaceTree(const DrawableEigenMesh& mesh, bool rayHits){
+    unsigned int nVertices = mesh.getNumberVertices();
+    unsigned int nFaces = mesh.getNumberFaces();
+    coords.resize(nVertices*3);
+    tris.resize(nFaces*3);
+    for(unsigned int i = 0; i < nVertices; i++){
+        Pointd v = mesh.getVertex(i);
+        coords[3*i+0] = v.x();
+        coords[3*i+1] = v.y();
+        coords[3*i+2] = v.z();
+    }
+    std::vector<double> centroids(nFaces*3);
+    order.resize(nFaces);
+    for(unsigned int i = 0; i < nFaces; i++){
+        Pointi f = mesh.getFace(i);
+        tris[3*i+0] = f.x();
+        tris[3*i+1] = f.y();
+        tris[3*i+2] = f.z();
+        for(int k = 0; k < 3; k++){
+            centroids[3*i+k] = (coords[3*f.x()+k] + coords[3*f.y()+k] + coords[3*f.z()+k]) / 3;
+        }
+        order[i] = i;
+    }
+    if (nFaces > 0){
+        nodes.reserve(2 * (nFaces / (LEAF_SIZE/2) + 1));
+        build(centroids, 0, nFaces);
+        if (rayHits) buildBlocks();
+    }
+}
+
+void FaceTree::getIntersectEigenFaces(const Pointd& p1, const Pointd& p2, std::vector<int>& faces) const{
+    getIntersectEigenFaces(p1, p2, faces, RayScratch::local());
+}
+
+void FaceTree::getIntersectEigenFaces(const Pointd& p1, const Pointd& p2, std::vector<int>& faces,
+                                      RayScratch& scratch) const{
+    if (nodes.empty()) return;
+    double p[3] = {p1.x(), p1.y(), p1.z()};
+    double q[3] = {p2.x(), p2.y(), p2.z()};
+    double d[3] = {q[0]-p[0], q[1]-p[1], q[2]-p[2]};
+
+    std::vector<int>& stack = scratch.stack;
+    stack.clear();
+    stack.push_back(0);
+    while (!stack.empty()){
+        int id = stack.back();
+        stack.pop_back();
+        const Node& node = nodes[id];
+        if (!overlaps(node, p, d, 1)) continue;
+        if (node.count > 0){
+            for (int i = node.first; i < node.first + node.count; i++){
+                const int* t = &tris[3*order[i]];
+                if (SegmentTriangle::intersect(p, q, &coords[3*t[0]], &coords[3*t[1]], &coords[3*t[2]])){
+                    faces.push_back(order[i]);
+                }
+            }
+        }
+        else {
+            stack.push_back(node.first);
+            stack.push_back(id + 1);
+        }
+    }
+}
+
+void FaceTree::getRayHits(const Pointd& p1, const Pointd& p2, std::vector<RayHit>& hits) const{
+    getRayHits(p1, p2, hits, RayScratch::local());
+}
+
+void FaceTree::getRayHits(const Pointd& p1, const Pointd& p2, std::vector<RayHit>& hits, RayScratch& scratch) const{
+    hits.clear();
+    if (triangles.size() == 0) return;
+    double p[3] = {p1.x(), p1.y(), p1.z()};
+    double d[3] = {p2.x()-p[0], p2.y()-p[1], p2.z()-p[2]};
+
+    std::vector<int>& stack = scratch.stack;
+    stack.clear();
+    stack.push_back(0);
+    int result[RAY_LANES];
+    double t[RAY_LANES];
+    while (!stack.empty()){
+        int id = stack.back();
+        stack.pop_back();
+        const Node& node = nodes[id];
+        if (!overlaps(node, p, d, DBL_MAX)) continue;
+        if (node.count > 0){
+            //build() always splits more than LEAF_SIZE = RAY_LANES faces: a single kernel call
+            triangles.intersect(p1, p2, node.block, result, t);
+            for (int l = 0; l < node.count; l++){
+                if (result[l] == 1){
+                    RayHit hit = {t[l], order[node.first + l]};
+                    hits.push_back(hit);
+                }
+            }
+        }
+        else {
+            stack.push_back(node.first);
+            stack.push_back(id + 1);
+        }
+    }
+    std::sort(hits.begin(), hits.end());
+}
+
+int FaceTree::build(const std::vector<double>& centroids, int begin, int end){
+    int id = nodes.size();
+    nodes.push_back(Node());
+
+    Node node;
+    node.block = -1;
+    double cmin[3] = {DBL_MAX, DBL_MAX, DBL_MAX}, cmax[3] = {-DBL_MAX, -DBL_MAX, -DBL_MAX};
+    for (int k = 0; k < 3; k++){
+        node.min[k] = DBL_MAX;
+        node.max[k] = -DBL_MAX;
+    }
+    for (int i = begin; i < end; i++){
+        int f = order[i];
+        for (int k = 0; k < 3; k++){
+            for (int j = 0; j < 3; j++){
+                double v = coords[3*tris[3*f+j]+k];
+                node.min[k] = std::min(node.min[k], v);
+                node.max[k] = std::max(node.max[k], v);
+            }
+            cmin[k] = std::min(cmin[k], centroids[3*f+k]);
+            cmax[k] = std::max(cmax[k], centroids[3*f+k]);
+        }
+    }
+    for (int k = 0; k < 3; k++){
+        node.min[k] -= pad(node.min[k]);
+        node.max[k] += pad(node.max[k]);
+    }
+
+    int axis = 0;
+    for (int k = 1; k < 3; k++){
+        if (cmax[k] - cmin[k] > cmax[axis] - cmin[axis]) axis = k;
+    }
+    if (end - begin <= LEAF_SIZE){
+        node.first = begin;
+        node.count = end - begin;
+        nodes[id] = node;
+        return id;
+    }
+
+    //median split along the largest extent of the centroids; if the centroids coincide
+    //any split is as good, the range is halved as it is
+    int mid = (begin + end) / 2;
+    if (cmax[axis] > cmin[axis]){
+        std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, CentroidLess(centroids, axis));
+    }
+    node.count = 0;
+    nodes[id] = node;
+    build(centroids, begin, mid);
+    int right = build(centroids, mid, end);
+    nodes[id].first = right;
+    return id;
+}
+
+//each leaf starts a new block, so that a leaf is tested by one call of the kernel
+void FaceTree::buildBlocks(){
+    unsigned int lanes = 0;
+    for (unsigned int id = 0; id < nodes.size(); id++){
+        lanes += (nodes[id].count + RAY_LANES - 1) / RAY_LANES * RAY_LANES;
+    }
+    triangles.reserve(lanes);
+    for (unsigned int id = 0; id < nodes.size(); id++){
+        Node& node = nodes[id];
+        if (node.count == 0) continue;
+        node.block = triangles.size();
+        for (int i = node.first; i < node.first + node.count; i++){
+            const int* t = &tris[3*order[i]];
+            triangles.add(Pointd(coords[3*t[0]], coords[3*t[0]+1], coords[3*t[0]+2]),
+                          Pointd(coords[3*t[1]], coords[3*t[1]+1], coords[3*t[1]+2]),
+                          Pointd(coords[3*t[2]], coords[3*t[2]+1], coords[3*t[2]+2]));
+        }
+        triangles.endBlock();
+    }
+}
+
+bool FaceTree::overlaps(const Node& node, const double* p, const double* d, double tmax) const{
+    double tmin = 0;
+    for (int k = 0; k < 3; k++){
+        if (d[k] == 0){
+            if (p[k] < node.min[k] || p[k] > node.max[k]) return false;
+            continue;
+        }
+        double inv = 1.0 / d[k];
+        double t0 = (node.min[k] - p[k]) * inv;
+        double t1 = (node.max[k] - p[k]) * inv;
+        if (t0 > t1) std::swap(t0, t1);
+        tmin = std::max(tmin, t0);
+        tmax = std::min(tmax, t1);
+        if (tmin > tmax) return false;
+    }
+    return true;
+}
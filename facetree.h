@@ -0,0 +1,71 @@
+#ifndef FACETREE_H
+#define FACETREE_H
+
+#include <eigenmesh/eigenmesh/gui/drawableeigenmesh.h>
+
+#include <vector>
+
+#include <rayscratch.h>
+#include <raytrianglekernel.h>
+
+/**
+ * @brief Flattened AABB tree over the faces of an eigen mesh.
+ *
+ * Same contract as CGALInterface::AABBTree::getIntersectEigenFaces (every face touched by
+ * the closed segment is appended to the output), but a query never allocates: the output
+ * vector and the traversal stack are supplied by the caller, or taken from the arena of
+ * the calling thread (RayScratch::local()), and they are reused across queries.
+ * Concurrent queries on the same tree are safe as long as each thread uses its own scratch.
+ *
+ * Built with rayHits = true, the leaves also keep their faces as TriangleSoA blocks and
+ * getRayHits() returns every face crossed by the ray p1 -> p2 (not bounded by p2), sorted
+ * along the ray, with the same codes of the TriangleSoA kernel.
+ */
+struct RayHit {
+    double  t;          //the hit point is p1 + t*(p2-p1)
+    int     face;
+
+    bool operator<(const RayHit& other) const { return t < other.t || (t == other.t && face < other.face); }
+};
+
+class FaceTree
+{
+    public:
+        FaceTree(const DrawableEigenMesh& mesh, bool rayHits = false);
+
+        void    getIntersectEigenFaces  (const Pointd& p1, const Pointd& p2, std::vector<int>& faces) const;
+
+        void    getIntersectEigenFaces  (const Pointd& p1, const Pointd& p2, std::vector<int>& faces,
+                                         RayScratch& scratch) const;
+
+        void    getRayHits              (const Pointd& p1, const Pointd& p2, std::vector<RayHit>& hits) const;
+
+        void    getRayHits              (const Pointd& p1, const Pointd& p2, std::vector<RayHit>& hits,
+                                         RayScratch& scratch) const;
+
+    private:
+
+        struct Node {
+            double  min[3];
+            double  max[3];
+            int     first;      //leaf: first slot in order; inner node: index of the right child
+            int     count;      //faces in the leaf, 0 for inner nodes (the left child follows the node)
+            int     block;      //leaf: first lane of its faces in triangles (-1 without ray hits)
+        };
+
+        static const int LEAF_SIZE = RAY_LANES;
+
+        int     build                   (const std::vector<double>& centroids, int begin, int end);
+
+        void    buildBlocks             ();
+
+        bool    overlaps                (const Node& node, const double* p, const double* d, double tmax) const;
+
+        std::vector<Node>       nodes;
+        std::vector<int>        order;      //faces grouped by leaf
+        std::vector<double>     coords;
+        std::vector<int>        tris;
+        TriangleSoA             triangles;  //leaf faces in blocks of RAY_LANES, only with ray hits
+};
+
+#endif // FACETREE_H
@@ -1,8 +1,6 @@
 #include "polylinesCheck.h"
 using namespace std;
 
-#define SMALL_NUM   0.0000000001 // anything that avoids division overflow
-
 PolylinesCheck::PolylinesCheck(){
 }
 
@@ -118,166 +116,205 @@ void PolylinesCheck::setD(){
 }
 
 void PolylinesCheck::checkIntersect(DrawableEigenMesh* meshEigenOrigin, Pointd p0, Pointd p1, int selection){
-    int nFaces = meshEigenOrigin->getNumberFaces();
-    int inter=0;
-    //bool inter = false;
-    bool flag = false;
-    for(int i=0; i<nFaces;i++){
-        Pointi f = meshEigenOrigin->getFace(i);
-        inter = intersect3D_RayTriangle(p0, p1, meshEigenOrigin->getVertex(f.x()),
-                                                meshEigenOrigin->getVertex(f.y()),
-                                                meshEigenOrigin->getVertex(f.z()));
-        if(inter == 1){
-            if(flag){
-                switch (selection) {
-                case 0:
-                    if(minP.x() > I.x()){
-                        minP = I;
-                    }
-                    if(maxP.x() < I.x()){
-                        maxP = I;
-                    }
-                    break;
-                case 1:
-                    if(minP.y() > I.y()){
-                        minP = I;
-                    }
-                    if(maxP.y() < I.y()){
-                        maxP = I;
-                    }
-                    break;
-                case 2:
-                    if(minP.z() > I.z()){
-                        minP = I;
-                    }
-                    if(maxP.z() < I.z()){
-                        maxP = I;
-                    }
-                    break;
-                default:
-                    break;
-                }
-            } else {
-                minP = I;
-                maxP = I;
-                flag = true;
-            }
-        }
+    //l'albero viene costruito una volta e riusato finché la mesh non cambia (invalidateIntersectTree)
+    if(intersectTree == nullptr || intersectMesh != meshEigenOrigin){
+        intersectTree.reset(new FaceTree(*meshEigenOrigin, true));
+        intersectMesh = meshEigenOrigin;
+    }
+    intersectTree->getRayHits(p0, p1, rayHits);
+    if(rayHits.empty()){
+        return;
     }
-}
 
-int PolylinesCheck::intersect3D_RayTriangle( Pointd p0, Pointd p1, Pointd v0, Pointd v1, Pointd v2){
-
-    //intersect3D_RayTriangle(): find the 3D intersection of a ray with a triangle
-    //    Input:  a ray R, and a triangle T
-    //    Output: *I = intersection point (when it exists)
-    //    Return: -1 = triangle is degenerate (a segment or point)
-    //             0 =  disjoint (no intersect)
-    //             1 =  intersect in unique point I1
-    //             2 =  are in the same plane
-
-    Vec3    e1, e2, n;                      // triangle vectors
-    Vec3    dir, w0, w;                     // ray vectors
-    double     r, a, b;                     // params to calc ray-plane intersect
-    // get triangle edge vectors and plane normal
-    e1 = v1 - v0;
-    e2 = v2 - v0;
-    n = e1.cross(e2);                       // cross product
-    if (n == (Vec3)0)                       // triangle is degenerate
-        return -1;                          // do not deal with this case
-
-    dir = p1 - p0;                          // ray direction vector
-    w0 = p0 - v0;
-    a = -n.dot(w0);
-    b = n.dot(dir);
-    if (fabs(b) < SMALL_NUM) {              // ray is  parallel to triangle plane
-        if (a == 0)                         // ray lies in triangle plane
-            return 2;
-        else return 0;                      // ray disjoint from plane
+    //hits sorted along the ray: the extremes are the first and the last one
+    Vec3 dir = p1 - p0;
+    double first = rayHits.front().t;
+    double last = rayHits.back().t;
+    if(selection >= 0 && selection < 3 && dir[selection] < 0){
+        std::swap(first, last);
     }
+    minP = p0 + Pointd(first*dir.x(), first*dir.y(), first*dir.z());
+    maxP = p0 + Pointd(last*dir.x(), last*dir.y(), last*dir.z());
+}
 
-    // get intersect point of ray with triangle plane
-    r = a / b;
-    if (r < 0.0)                            // ray goes away from triangle
-        return 0;                           // => no intersect
-    // for a segment, also test if (r > 1.0) => no intersect
+void PolylinesCheck::invalidateIntersectTree(){
+    intersectTree.reset();
+    intersectMesh = nullptr;
+}
 
-    I = p0 + Pointd(r*dir.x(), r*dir.y(), r*dir.z());                   // intersect point of ray and plane
+void PolylinesCheck::check(DrawableEigenMesh *meshEigenOrigin, int color, int indexPlane, const Vec3& direction){
 
-    // is I inside T?
-    float    uu, uv, vv, wu, wv, D;
-    uu = e1.dot(e1);
-    uv = e1.dot(e2);
-    vv = e2.dot(e2);
-    w = I - v0;
-    wu = w.dot(e1);
-    wv = w.dot(e2);
-    D = uv * uv - uu * vv;
+    meshPoly = *meshEigenOrigin;
 
-    // get and test parametric coords
-    float s, t;
-    s = (uv * wv - vv * wu) / D;
-    if (s < 0.0 || s > 1.0)                 // I is outside T
-        return 0;
-    t = (uv * wu - uu * wv) / D;
-    if (t < 0.0 || (s + t) > 1.0)           // I is outside T
-        return 0;
+    //direction: ray direction in the reference frame of the sweep, needed to address the cache
+    if(visibilityCache != nullptr && visibilityCache->isEnabled() && direction != Vec3()){
+        VectI front, back;
+        if(!visibilityCache->lookup(cacheMeshKey, direction, meshEigenOrigin->getNumberFaces(), front, back)){
+            computeVisibility(meshEigenOrigin, front, back);
+            visibilityCache->store(cacheMeshKey, direction, front, back);
+        }
+        applyVisibility(meshEigenOrigin, front, back, color, indexPlane);
+        return;
+    }
 
-    return 1;                               // I is in T
+    switch(rayBackend){
+        #ifdef EMBREE_DEFINED
+        case EMBREE_RAYS: {
+            EmbreeRayCaster caster(*meshEigenOrigin);
+            checkRays(caster, meshEigenOrigin, color, indexPlane);
+            break;
+        }
+        #endif
+        case NATIVE_RAYS: {
+            FaceTree faceTree(*meshEigenOrigin);
+            checkRays(faceTree, meshEigenOrigin, color, indexPlane);
+            break;
+        }
+        default: {
+            CGALInterface::AABBTree eigenTree(*meshEigenOrigin);
+            checkRays(eigenTree, meshEigenOrigin, color, indexPlane);
+            break;
+        }
+    }
 }
 
-void PolylinesCheck::check(DrawableEigenMesh *meshEigenOrigin, int color, int indexPlane){
-
-    meshPoly = *meshEigenOrigin;
-
-    CGALInterface::AABBTree eigenTree(*meshEigenOrigin);
-    QColor c;
-    Pointi f;
-    VectI blackList;
-    Vec3 e1, e2, e3, n;
-    int face;
+template<class Tree>
+void PolylinesCheck::checkRays(Tree& eigenTree, DrawableEigenMesh *meshEigenOrigin, int color, int indexPlane){
+    //buffer riusato tra i raggi e tra le chiamate: a regime nessuna allocazione
+    VectI& blackList = RayScratch::local().hits;
+    int front, back;
     double max = meshEigenOrigin->getBoundingBox().maxY()+50;
     double min = meshEigenOrigin->getBoundingBox().minY()-50;
-    //int indexNotVisibleVector = checker.size()-1;
+    unsigned long long allocations = AllocationCounter::count();
+    unsigned int rays = 0;
 
     for(unsigned int i = 0; i < checker[indexPlane].size(); i++){
-        /*if(notVisibleFace.size() > 0){
-            c.setHsv(0,255,255);
-            for(int j : notVisibleFace){
-                checker[indexPlane][j]=1;
-                meshEigenOrigin->setFaceColor(c.redF(), c.greenF(),c.blueF(),j);
-            }
-        }*/
-        if(checker[indexPlane][i] != 1 && !(std::find(notVisibleFace.begin(),
-                                                      notVisibleFace.end(), i)
-                                            != notVisibleFace.end())){
-            f = meshEigenOrigin->getFace(i);
-            e1 = meshEigenOrigin->getVertex(f.x());
-            e2 = meshEigenOrigin->getVertex(f.y());
-            e3 = meshEigenOrigin->getVertex(f.z());
-
-            Pointd bar((e1+e2+e3)/3);
-            //cerco le intersezioni della retta passante per la i-esima faccia
-            eigenTree.getIntersectEigenFaces(Pointd(bar.x(), max, bar.z()), Pointd(bar.x(), min, bar.z()), blackList);
-            //Prendo quella che si trova più in alto
-            face = serchMaxY(blackList,meshEigenOrigin);
-            if(checker[indexPlane][face] != 1){
-                checker[indexPlane][face] = 1;
-                c.setHsv(color, 255,255);
-                meshEigenOrigin->setFaceColor(c.redF(), c.greenF(),c.blueF(),face);
+        if(rayNeeded(i, indexPlane)){
+            shootRay(eigenTree, meshEigenOrigin, i, max, min, blackList, front, back);
+            rays++;
+            markRay(meshEigenOrigin, front, back, color, indexPlane);
+        }
+    }
+    if(AllocationCounter::enabled()){
+        cout << "check: " << AllocationCounter::count() - allocations << " allocations for " << rays << " rays" << endl;
+    }
+}
+
+template<class Tree>
+void PolylinesCheck::shootRay(Tree& eigenTree, DrawableEigenMesh *meshEigenOrigin, unsigned int i, double max, double min,
+                              VectI& blackList, int& front, int& back){
+    Pointi f = meshEigenOrigin->getFace(i);
+    Pointd bar((meshEigenOrigin->getVertex(f.x()) +
+                meshEigenOrigin->getVertex(f.y()) +
+                meshEigenOrigin->getVertex(f.z()))/3);
+    //cerco le intersezioni della retta passante per la i-esima faccia
+    blackList.clear();
+    eigenTree.getIntersectEigenFaces(Pointd(bar.x(), max, bar.z()), Pointd(bar.x(), min, bar.z()), blackList);
+    front = back = -1;
+    if(!blackList.empty()){
+        //la più in alto e la più in basso
+        front = serchMaxY(blackList,meshEigenOrigin);
+        back = serchMinY(blackList,meshEigenOrigin);
+    }
+    blackList.clear();
+}
+
+bool PolylinesCheck::rayNeeded(unsigned int i, int indexPlane) const{
+    //le facce già marcate e quelle escluse non lanciano raggi
+    return checker[indexPlane][i] != 1 &&
+           std::find(notVisibleFace.begin(), notVisibleFace.end(), (int)i) == notVisibleFace.end();
+}
+
+void PolylinesCheck::markRay(DrawableEigenMesh *meshEigenOrigin, int front, int back, int color, int indexPlane){
+    QColor c;
+    if(front >= 0 && checker[indexPlane][front] != 1){
+        checker[indexPlane][front] = 1;
+        frontFaces[indexPlane][front] = true;
+        c.setHsv(color, 255,255);
+        meshEigenOrigin->setFaceColor(c.redF(), c.greenF(),c.blueF(),front);
+    }
+    if(back >= 0 && checker[indexPlane][back] != 1){
+        checker[indexPlane][back] = 1;
+        c.setHsv(120+color, 255,255);
+        meshEigenOrigin->setFaceColor(c.redF(), c.greenF(),c.blueF(),back);
+    }
+}
+
+void PolylinesCheck::computeVisibility(DrawableEigenMesh *meshEigenOrigin, VectI& front, VectI& back){
+    //Same rays as check(), but shot from every face: the result does not depend on
+    //the faces already marked or excluded, so it can be reused by any later sweep
+    unsigned int nFaces = meshEigenOrigin->getNumberFaces();
+    front.assign(nFaces, -1);
+    back.assign(nFaces, -1);
+
+    switch(rayBackend){
+        #ifdef EMBREE_DEFINED
+        case EMBREE_RAYS: {
+            //all the rays are known in advance: a single stream query
+            Pointi f;
+            double max = meshEigenOrigin->getBoundingBox().maxY()+50;
+            double min = meshEigenOrigin->getBoundingBox().minY()-50;
+            std::vector<Pointd> from(nFaces), to(nFaces);
+            for(unsigned int i = 0; i < nFaces; i++){
+                f = meshEigenOrigin->getFace(i);
+                Pointd bar((meshEigenOrigin->getVertex(f.x()) +
+                            meshEigenOrigin->getVertex(f.y()) +
+                            meshEigenOrigin->getVertex(f.z()))/3);
+                from[i] = Pointd(bar.x(), max, bar.z());
+                to[i] = Pointd(bar.x(), min, bar.z());
             }
-            //Prendo quella che si trova più in basso
-            face = serchMinY(blackList,meshEigenOrigin);
-            if(checker[indexPlane][face] != 1){
-                checker[indexPlane][face] = 1;
-                c.setHsv(120+color, 255,255);
-                meshEigenOrigin->setFaceColor(c.redF(), c.greenF(),c.blueF(),face);
+            MatrixI hits;
+            EmbreeRayCaster caster(*meshEigenOrigin);
+            caster.getIntersectEigenFaces(from, to, hits);
+            for(unsigned int i = 0; i < nFaces; i++){
+                if(!hits[i].empty()){
+                    front[i] = serchMaxY(hits[i],meshEigenOrigin);
+                    back[i] = serchMinY(hits[i],meshEigenOrigin);
+                }
             }
-            //Svuoto la lista
-            blackList.clear();
+            break;
+        }
+        #endif
+        case NATIVE_RAYS: {
+            FaceTree faceTree(*meshEigenOrigin);
+            visibilityRays(faceTree, meshEigenOrigin, front, back);
+            break;
         }
+        default: {
+            CGALInterface::AABBTree eigenTree(*meshEigenOrigin);
+            visibilityRays(eigenTree, meshEigenOrigin, front, back);
+            break;
+        }
+    }
+}
+
+template<class Tree>
+void PolylinesCheck::visibilityRays(Tree& eigenTree, DrawableEigenMesh *meshEigenOrigin, VectI& front, VectI& back){
+    VectI& blackList = RayScratch::local().hits;
+    double max = meshEigenOrigin->getBoundingBox().maxY()+50;
+    double min = meshEigenOrigin->getBoundingBox().minY()-50;
+
+    for(unsigned int i = 0; i < front.size(); i++){
+        shootRay(eigenTree, meshEigenOrigin, i, max, min, blackList, front[i], back[i]);
     }
-    indexPlane++;
+}
+
+void PolylinesCheck::applyVisibility(DrawableEigenMesh *meshEigenOrigin, const VectI& front,
+                                     const VectI& back, int color, int indexPlane){
+    //stesso ciclo di checkRays, con i raggi già calcolati: il risultato è identico
+    for(unsigned int i = 0; i < front.size(); i++){
+        if(rayNeeded(i, indexPlane)){
+            markRay(meshEigenOrigin, front[i], back[i], color, indexPlane);
+        }
+    }
+}
+
+void PolylinesCheck::setVisibilityCache(VisibilityCache* cache){
+    visibilityCache = cache;
+}
+
+void PolylinesCheck::setCacheMeshKey(unsigned long long key){
+    cacheMeshKey = key;
 }
 
 void PolylinesCheck::rotatePoint(Eigen::Matrix3d rotation, Pointd p){
@@ -285,41 +322,70 @@ void PolylinesCheck::rotatePoint(Eigen::Matrix3d rotation, Pointd p){
     maxP.rotate(rotation, p);
 }
 
-int PolylinesCheck::serchMaxY (std::vector<int> lista, DrawableEigenMesh *meshEigenOrigin){
+//A parità di y vince la faccia con indice minore, così il risultato non dipende
+//dall'ordine in cui il backend restituisce le intersezioni
+int PolylinesCheck::serchMaxY (const std::vector<int>& lista, DrawableEigenMesh *meshEigenOrigin){
     int max = lista.front();
+    double maxY = meshEigenOrigin->getVertex(meshEigenOrigin->getFace(max).y()).y();
         for(int i : lista){
-            if(meshEigenOrigin->getVertex(meshEigenOrigin->getFace(i).y()).y() > meshEigenOrigin->getVertex(meshEigenOrigin->getFace(max).y()).y()){
+            double y = meshEigenOrigin->getVertex(meshEigenOrigin->getFace(i).y()).y();
+            if(y > maxY || (y == maxY && i < max)){
                 max = i;
+                maxY = y;
             }
         }
     return max;
 }
 
-int PolylinesCheck::serchMinY (std::vector<int> lista, DrawableEigenMesh *meshEigenOrigin){
+int PolylinesCheck::serchMinY (const std::vector<int>& lista, DrawableEigenMesh *meshEigenOrigin){
         int min = lista.front();
+        double minY = meshEigenOrigin->getVertex(meshEigenOrigin->getFace(min).y()).y();
         for(int i : lista){
-            if(meshEigenOrigin->getVertex(meshEigenOrigin->getFace(i).y()).y() < meshEigenOrigin->getVertex(meshEigenOrigin->getFace(min).y()).y()){
+            double y = meshEigenOrigin->getVertex(meshEigenOrigin->getFace(i).y()).y();
+            if(y < minY || (y == minY && i < min)){
                 min = i;
+                minY = y;
             }
         }
     return min;
 }
 
+void PolylinesCheck::setRayBackend(RayBackend backend){
+    #ifndef EMBREE_DEFINED
+    if(backend == EMBREE_RAYS){
+        std::cerr << "Embree backend not available: rebuild with CONFIG += EMBREE" << std::endl;
+        return;
+    }
+    #endif
+    rayBackend = backend;
+}
+
+PolylinesCheck::RayBackend PolylinesCheck::getRayBackend() const{
+    return rayBackend;
+}
+
 void PolylinesCheck::setCheckerDimension (int nplane, int dimension){
     checker.resize(nplane+=1);
+    frontFaces.resize(nplane);
     for(int i = 0; i< nplane ; i++){
         checker[i].resize(dimension);
+        frontFaces[i].resize(dimension);
     }
 }
 
 void PolylinesCheck::resetChecker(){
     checker.clear();
+    frontFaces.clear();
 }
 
 MatrixI PolylinesCheck::getChecker(){
     return checker;
 }
 
+const std::vector<FaceBitset>& PolylinesCheck::getFrontFaces() const{
+    return frontFaces;
+}
+
 void PolylinesCheck::searchNoVisibleFace (){
 
     for(unsigned int i = 0; i < checker[0].size();i++){
@@ -401,6 +467,7 @@ void PolylinesCheck::updateChecker(bool updateCheckerFlag){
     if(!updateCheckerFlag){
         checker.push_back(VectI());
         checker[checker.size()-1].resize(checker[0].size());
+        frontFaces.push_back(FaceBitset(checker[0].size()));
     }
 
     int nOrientation = checker.size();
@@ -411,8 +478,10 @@ void PolylinesCheck::updateChecker(bool updateCheckerFlag){
 }
 
 void PolylinesCheck::resetMatrixCheck(){
-    for(unsigned int i = 0; i<checker[0].size(); i++)
+    for(unsigned int i = 0; i<checker[0].size(); i++){
         checker[0][i] = 0;
+        frontFaces[0][i] = false;
+    }
 }
 
 void PolylinesCheck::serchUniqueTriangoForOrientation(){
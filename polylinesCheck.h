@@ -17,6 +17,15 @@
 #include <cgal/cgalslicer.h>
 #include <common/utils.h>
 
+#include <visibilitycache.h>
+#include <facetree.h>
+#include <raytrianglekernel.h>
+#include <rayscratch.h>
+#include <allocationcounter.h>
+#ifdef EMBREE_DEFINED
+#include <embreeraycaster.h>
+#endif
+
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QStatusBar>
@@ -25,6 +34,7 @@
 #include <gurobi_c++.h>
 
 #include <algorithm>
+#include <memory>
 
 using namespace CGAL;
 using namespace std;
@@ -48,6 +58,8 @@ typedef std::vector<VectI>                                        MatrixI;
 class PolylinesCheck
 {
     public:
+        enum RayBackend { CGAL_RAYS, NATIVE_RAYS, EMBREE_RAYS };
+
         PolylinesCheck();
 
         //Pointd  maxP;
@@ -72,17 +84,31 @@ class PolylinesCheck
 
         void    setD                    ();
 
-        int     intersect3D_RayTriangle (Pointd p0, Pointd p1, Pointd v0, Pointd v1, Pointd v2);
-
         void    checkIntersect          (DrawableEigenMesh* meshEigenOrigin, Pointd p0, Pointd p1, int selection);
 
+        void    invalidateIntersectTree ();
+
         void    rotatePoint             (Eigen::Matrix3d rotation, Pointd p);
 
-        void    check                   (DrawableEigenMesh *meshEigenOrigin, int color, int indexPlane);
+        void    check                   (DrawableEigenMesh *meshEigenOrigin, int color, int indexPlane,
+                                         const Vec3& direction = Vec3());
+
+        void    computeVisibility       (DrawableEigenMesh *meshEigenOrigin, VectI& front, VectI& back);
+
+        void    applyVisibility         (DrawableEigenMesh *meshEigenOrigin, const VectI& front,
+                                         const VectI& back, int color, int indexPlane);
+
+        void    setVisibilityCache      (VisibilityCache* cache);
+
+        void    setCacheMeshKey         (unsigned long long key);
 
-        int     serchMinY               (std::vector<int> lista, DrawableEigenMesh *meshEigenOrigin);
+        int     serchMinY               (const std::vector<int>& lista, DrawableEigenMesh *meshEigenOrigin);
 
-        int     serchMaxY               (std::vector<int> lista, DrawableEigenMesh *meshEigenOrigin);
+        int     serchMaxY               (const std::vector<int>& lista, DrawableEigenMesh *meshEigenOrigin);
+
+        void    setRayBackend           (RayBackend backend);
+
+        RayBackend getRayBackend        () const;
 
         void    setCheckerDimension     (int nplane, int dimension);
 
@@ -90,6 +116,8 @@ class PolylinesCheck
 
         MatrixI   getChecker            ();
 
+        const std::vector<FaceBitset>& getFrontFaces() const;
+
         void searchNoVisibleFace        ();
 
         VectI getNotVisibleFace         ();
@@ -110,6 +138,20 @@ class PolylinesCheck
 
 private:
 
+        template<class Tree>
+        void    checkRays               (Tree& tree, DrawableEigenMesh *meshEigenOrigin, int color, int indexPlane);
+
+        template<class Tree>
+        void    visibilityRays          (Tree& tree, DrawableEigenMesh *meshEigenOrigin, VectI& front, VectI& back);
+
+        template<class Tree>
+        void    shootRay                (Tree& tree, DrawableEigenMesh *meshEigenOrigin, unsigned int i, double max, double min,
+                                         VectI& blackList, int& front, int& back);
+
+        bool    rayNeeded               (unsigned int i, int indexPlane) const;
+
+        void    markRay                 (DrawableEigenMesh *meshEigenOrigin, int front, int back, int color, int indexPlane);
+
         PickableEigenmesh   meshPoly;
         Array2dPoint        poly2d;
         ArrayPoint          poly;
@@ -119,11 +161,17 @@ private:
         Point3              max;
         Pointd              minP;
         Pointd              maxP;
-        Pointd              I;
         MatrixI             checker;
+        std::vector<FaceBitset> frontFaces;   //per riga del checker: le facce marcate dal lato frontale
         MatrixI             uniqueTriangle;
         Vec3                normalplane;
         double              d;
+        VisibilityCache*    visibilityCache = nullptr;
+        unsigned long long  cacheMeshKey = 0;
+        RayBackend          rayBackend = CGAL_RAYS;   //il nativo resta opzionale finche non e validato su mesh reali
+        std::unique_ptr<FaceTree> intersectTree;
+        const DrawableEigenMesh*  intersectMesh = nullptr;
+        std::vector<RayHit> rayHits;
 };
 
 #endif // POLYLINES_H
@@ -0,0 +1,24 @@
+#ifndef RAYSCRATCH_H
+#define RAYSCRATCH_H
+
+#include <vector>
+
+/**
+ * @brief Reusable buffers for the ray queries.
+ *
+ * The queries only clear these vectors, so once they have grown to the largest
+ * query seen they stop allocating. local() returns the arena of the calling
+ * thread: callers that do not pass their own scratch share it, and every thread
+ * recycles its own traversal stack.
+ */
+struct RayScratch {
+    std::vector<int>    hits;       //faces intersected by the last query
+    std::vector<int>    stack;      //traversal stack of the face tree
+
+    static RayScratch& local(){
+        static thread_local RayScratch scratch;
+        return scratch;
+    }
+};
+
+#endif // RAYSCRATCH_H
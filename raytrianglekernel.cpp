@@ -0,0 +1,124 @@
+#include "raytrianglekernel.h"
+
+#include <cmath>
+
+#define SMALL_NUM   0.0000000001 // anything that avoids division overflow
+
+namespace {
+
+//RAY_LANES triangles against one ray. The pointers never alias and the lanes have no
+//branches (bitwise operators instead of &&), so with -fno-trapping-math the loop becomes
+//straight SIMD code
+void intersectLanes(const double* __restrict ax, const double* __restrict ay, const double* __restrict az,
+                    const double* __restrict bx, const double* __restrict by, const double* __restrict bz,
+                    const double* __restrict cx, const double* __restrict cy, const double* __restrict cz,
+                    const double* __restrict mx, const double* __restrict my, const double* __restrict mz,
+                    double ox, double oy, double oz, double dx, double dy, double dz,
+                    int* __restrict result, double* __restrict t){
+    for(int l = 0; l < RAY_LANES; l++){
+        //w0 = p0 - v0
+        double wx = ox - ax[l], wy = oy - ay[l], wz = oz - az[l];
+        double nd = mx[l]*dx + my[l]*dy + mz[l]*dz;             // n . dir
+        double nw = mx[l]*wx + my[l]*wy + mz[l]*wz;             // n . w0
+        //pvec = dir x e2, det = e1 . pvec = -(n . dir)
+        double px = dy*cz[l] - dz*cy[l];
+        double py = dz*cx[l] - dx*cz[l];
+        double pz = dx*cy[l] - dy*cx[l];
+        double det = bx[l]*px + by[l]*py + bz[l]*pz;
+        double inv = 1.0 / det;
+        //qvec = w0 x e1
+        double qx = wy*bz[l] - wz*by[l];
+        double qy = wz*bx[l] - wx*bz[l];
+        double qz = wx*by[l] - wy*bx[l];
+        double u = (wx*px + wy*py + wz*pz) * inv;
+        double v = (dx*qx + dy*qy + dz*qz) * inv;
+        double r = (cx[l]*qx + cy[l]*qy + cz[l]*qz) * inv;
+
+        int degenerate = (mx[l] == 0) & (my[l] == 0) & (mz[l] == 0);
+        int parallel = std::fabs(nd) < SMALL_NUM;
+        int inside = (u >= 0) & (u <= 1) & (v >= 0) & (u + v <= 1) & (r >= 0);
+        int code = parallel ? ((nw == 0) << 1) : inside;
+        result[l] = degenerate ? -1 : code;
+        t[l] = r;
+    }
+}
+
+}
+
+TriangleSoA::TriangleSoA() : count(0){
+}
+
+TriangleSoA::TriangleSoA(const DrawableEigenMesh& mesh) : count(0){
+    reserve(mesh.getNumberFaces());
+    for(unsigned int i = 0; i < mesh.getNumberFaces(); i++){
+        Pointi f = mesh.getFace(i);
+        add(mesh.getVertex(f.x()), mesh.getVertex(f.y()), mesh.getVertex(f.z()));
+    }
+    endBlock();
+}
+
+//room for n triangles (padding included), so that add() never reallocates
+void TriangleSoA::reserve(unsigned int n){
+    v0x.reserve(n); v0y.reserve(n); v0z.reserve(n);
+    e1x.reserve(n); e1y.reserve(n); e1z.reserve(n);
+    e2x.reserve(n); e2y.reserve(n); e2z.reserve(n);
+    nx.reserve(n);  ny.reserve(n);  nz.reserve(n);
+}
+
+void TriangleSoA::add(const Pointd& v0, const Pointd& v1, const Pointd& v2){
+    Vec3 e1 = v1 - v0;
+    Vec3 e2 = v2 - v0;
+    Vec3 n = e1.cross(e2);
+    v0x.push_back(v0.x()); v0y.push_back(v0.y()); v0z.push_back(v0.z());
+    e1x.push_back(e1.x()); e1y.push_back(e1.y()); e1z.push_back(e1.z());
+    e2x.push_back(e2.x()); e2y.push_back(e2.y()); e2z.push_back(e2.z());
+    nx.push_back(n.x());   ny.push_back(n.y());   nz.push_back(n.z());
+    count++;
+}
+
+//pads the current block: the padding becomes part of it and the next triangle starts a new block
+void TriangleSoA::endBlock(){
+    pad();
+    count = paddedSize();
+}
+
+void TriangleSoA::clear(){
+    count = 0;
+    v0x.clear(); v0y.clear(); v0z.clear();
+    e1x.clear(); e1y.clear(); e1z.clear();
+    e2x.clear(); e2y.clear(); e2z.clear();
+    nx.clear();  ny.clear();  nz.clear();
+}
+
+unsigned int TriangleSoA::size() const{
+    return count;
+}
+
+unsigned int TriangleSoA::paddedSize() const{
+    return nx.size();
+}
+
+//fills the last block with degenerate triangles (zero edges and normal)
+void TriangleSoA::pad(){
+    unsigned int padded = (count + RAY_LANES - 1) / RAY_LANES * RAY_LANES;
+    v0x.resize(padded); v0y.resize(padded); v0z.resize(padded);
+    e1x.resize(padded); e1y.resize(padded); e1z.resize(padded);
+    e2x.resize(padded); e2y.resize(padded); e2z.resize(padded);
+    nx.resize(padded);  ny.resize(padded);  nz.resize(padded);
+    for(unsigned int i = count; i < padded; i++){
+        v0x[i] = v0y[i] = v0z[i] = 0;
+        e1x[i] = e1y[i] = e1z[i] = 0;
+        e2x[i] = e2y[i] = e2z[i] = 0;
+        nx[i] = ny[i] = nz[i] = 0;
+    }
+}
+
+void TriangleSoA::intersect(const Pointd& p0, const Pointd& p1, unsigned int first, int* result, double* t) const{
+    intersectLanes(&v0x[first], &v0y[first], &v0z[first],
+                   &e1x[first], &e1y[first], &e1z[first],
+                   &e2x[first], &e2y[first], &e2z[first],
+                   &nx[first], &ny[first], &nz[first],
+                   p0.x(), p0.y(), p0.z(),
+                   p1.x() - p0.x(), p1.y() - p0.y(), p1.z() - p0.z(),
+                   result, t);
+}
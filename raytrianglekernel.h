@@ -0,0 +1,58 @@
+#ifndef RAYTRIANGLEKERNEL_H
+#define RAYTRIANGLEKERNEL_H
+
+#include <eigenmesh/eigenmesh/gui/drawableeigenmesh.h>
+
+#include <vector>
+
+#define RAY_LANES   8   // triangles tested together by one kernel call
+
+/**
+ * @brief Triangles in structure-of-arrays layout, with edges and normals precomputed,
+ * tested against a ray RAY_LANES at a time (Möller–Trumbore).
+ *
+ * The lane loop has no branches and no dependencies between lanes, so the compiler
+ * maps it onto SIMD registers. endBlock() pads the triangles added so far to a multiple
+ * of RAY_LANES with degenerate triangles; intersect() tests the RAY_LANES lanes starting
+ * at first, a multiple of RAY_LANES within a closed block. For every triangle the kernel writes the same codes of the old
+ * PolylinesCheck::intersect3D_RayTriangle:
+ *   -1 = triangle is degenerate (a segment or point)
+ *    0 = disjoint (no intersect)
+ *    1 = intersect in unique point p0 + t*(p1-p0), t >= 0
+ *    2 = the ray lies in the triangle plane
+ * The ray starts at p0 and passes through p1; it is not bounded by p1.
+ */
+class TriangleSoA
+{
+    public:
+        TriangleSoA();
+
+        TriangleSoA(const DrawableEigenMesh& mesh);
+
+        void            reserve         (unsigned int n);
+
+        void            add             (const Pointd& v0, const Pointd& v1, const Pointd& v2);
+
+        void            endBlock        ();
+
+        void            clear           ();
+
+        unsigned int    size            () const;
+
+        unsigned int    paddedSize      () const;
+
+        void            intersect       (const Pointd& p0, const Pointd& p1, unsigned int first,
+                                         int* result, double* t) const;
+
+    private:
+
+        void            pad             ();
+
+        std::vector<double> v0x, v0y, v0z;
+        std::vector<double> e1x, e1y, e1z;
+        std::vector<double> e2x, e2y, e2z;
+        std::vector<double> nx, ny, nz;
+        unsigned int        count;
+};
+
+#endif // RAYTRIANGLEKERNEL_H
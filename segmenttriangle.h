@@ -0,0 +1,187 @@
+#ifndef SEGMENTTRIANGLE_H
+#define SEGMENTTRIANGLE_H
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+/**
+ * Closed segment against closed triangle, shared by the ray backends so that they all
+ * report the faces of CGAL::do_intersect.
+ *
+ * The answer depends only on the signs of orient3d/orient2d, and those are exact:
+ * the determinant is computed in double and, when it is closer to zero than its
+ * rounding error bound (Shewchuk's filter), recomputed exactly as a floating point
+ * expansion. Grazing rays through edges and vertices, common in the sweeps, get the
+ * same answer as the exact predicates of CGAL; the exact path costs only on them.
+ */
+
+namespace SegmentTriangle {
+
+namespace Exact {
+
+//error bounds of the double evaluation (Shewchuk, "Adaptive precision floating-point
+//arithmetic and fast robust geometric predicates")
+const double EPS = DBL_EPSILON / 2;
+const double CCW_BOUND = (3.0 + 16.0 * EPS) * EPS;
+const double O3D_BOUND = (7.0 + 56.0 * EPS) * EPS;
+
+//x + y = a + b exactly
+inline void twoSum(double a, double b, double& x, double& y){
+    x = a + b;
+    double bv = x - a;
+    double av = x - bv;
+    y = (a - av) + (b - bv);
+}
+
+//sum of a nonoverlapping expansion e[0..n) (increasing magnitude, no zeros), b is added in place
+inline int grow(double* e, int n, double b){
+    double q = b, h;
+    int m = 0;
+    for (int i = 0; i < n; i++){
+        twoSum(q, e[i], q, h);
+        if (h != 0) e[m++] = h;
+    }
+    if (q != 0) e[m++] = q;
+    return m;
+}
+
+//adds s*x*y*z to the expansion: x*y = p + e exactly (fma), and so are p*z and e*z
+inline int addProduct(double* e, int n, double s, double x, double y, double z){
+    double p = x * y, pe = std::fma(x, y, -p);
+    double p1 = p * z, e1 = std::fma(p, z, -p1);
+    double p2 = pe * z, e2 = std::fma(pe, z, -p2);
+    n = grow(e, n, s * e2);
+    n = grow(e, n, s * p2);
+    n = grow(e, n, s * e1);
+    return grow(e, n, s * p1);
+}
+
+//the sign of an expansion is the one of its largest component
+inline double sign(const double* e, int n){
+    return n == 0 ? 0 : (e[n-1] > 0 ? 1 : -1);
+}
+
+//det | a 1 ; b 1 ; c 1 | = orient2d(a,b,c), from its 6 products
+inline double orient2d(const double* a, const double* b, const double* c){
+    double e[32];
+    int n = 0;
+    n = addProduct(e, n,  1, a[0], b[1], 1);
+    n = addProduct(e, n, -1, a[0], c[1], 1);
+    n = addProduct(e, n, -1, a[1], b[0], 1);
+    n = addProduct(e, n,  1, a[1], c[0], 1);
+    n = addProduct(e, n,  1, b[0], c[1], 1);
+    n = addProduct(e, n, -1, b[1], c[0], 1);
+    return sign(e, n);
+}
+
+//det | 1 a ; 1 b ; 1 c ; 1 d | = orient3d(a,b,c,d), expanded along the column of ones:
+//24 products of three coordinates
+inline double orient3d(const double* a, const double* b, const double* c, const double* d){
+    const double* rows[4] = {a, b, c, d};
+    double e[128];
+    int n = 0;
+    for (int i = 0; i < 4; i++){
+        const double* p = rows[i == 0 ? 1 : 0];
+        const double* q = rows[i <= 1 ? 2 : 1];
+        const double* r = rows[i <= 2 ? 3 : 2];
+        double s = (i % 2 == 0) ? 1 : -1;
+        n = addProduct(e, n,  s, p[0], q[1], r[2]);
+        n = addProduct(e, n, -s, p[0], q[2], r[1]);
+        n = addProduct(e, n, -s, p[1], q[0], r[2]);
+        n = addProduct(e, n,  s, p[1], q[2], r[0]);
+        n = addProduct(e, n,  s, p[2], q[0], r[1]);
+        n = addProduct(e, n, -s, p[2], q[1], r[0]);
+    }
+    return sign(e, n);
+}
+
+}
+
+//(b-a) . ((c-a) x (d-a)): the double value when its sign is certain, else the exact sign
+inline double orient3d(const double* a, const double* b, const double* c, const double* d){
+    double adx = a[0]-d[0], ady = a[1]-d[1], adz = a[2]-d[2];
+    double bdx = b[0]-d[0], bdy = b[1]-d[1], bdz = b[2]-d[2];
+    double cdx = c[0]-d[0], cdy = c[1]-d[1], cdz = c[2]-d[2];
+    double bdxcdy = bdx*cdy, cdxbdy = cdx*bdy;
+    double cdxady = cdx*ady, adxcdy = adx*cdy;
+    double adxbdy = adx*bdy, bdxady = bdx*ady;
+    double det = -(adz*(bdxcdy - cdxbdy) + bdz*(cdxady - adxcdy) + cdz*(adxbdy - bdxady));
+    double permanent = (std::fabs(bdxcdy) + std::fabs(cdxbdy)) * std::fabs(adz) +
+                       (std::fabs(cdxady) + std::fabs(adxcdy)) * std::fabs(bdz) +
+                       (std::fabs(adxbdy) + std::fabs(bdxady)) * std::fabs(cdz);
+    double bound = Exact::O3D_BOUND * permanent;
+    if (det > bound || -det > bound) return det;
+    return Exact::orient3d(a, b, c, d);
+}
+
+//(b-a) x (c-a): the double value when its sign is certain, else the exact sign
+inline double orient2d(const double* a, const double* b, const double* c){
+    double left = (a[0]-c[0])*(b[1]-c[1]), right = (a[1]-c[1])*(b[0]-c[0]);
+    double det = left - right, sum;
+    if (left > 0){
+        if (right <= 0) return det;
+        sum = left + right;
+    }
+    else if (left < 0){
+        if (right >= 0) return det;
+        sum = -left - right;
+    }
+    else return det;
+    double bound = Exact::CCW_BOUND * sum;
+    if (det >= bound || -det >= bound) return det;
+    return Exact::orient2d(a, b, c);
+}
+
+inline bool opposite(double a, double b){
+    return (a > 0 && b < 0) || (a < 0 && b > 0);
+}
+
+inline bool onSegment2d(const double* a, const double* b, const double* p){
+    return std::min(a[0],b[0]) <= p[0] && p[0] <= std::max(a[0],b[0]) &&
+           std::min(a[1],b[1]) <= p[1] && p[1] <= std::max(a[1],b[1]);
+}
+
+inline bool segmentSegment2d(const double* p, const double* q, const double* a, const double* b){
+    double d1 = orient2d(a,b,p), d2 = orient2d(a,b,q);
+    double d3 = orient2d(p,q,a), d4 = orient2d(p,q,b);
+    if (opposite(d1,d2) && opposite(d3,d4)) return true;
+    return (d1 == 0 && onSegment2d(a,b,p)) || (d2 == 0 && onSegment2d(a,b,q)) ||
+           (d3 == 0 && onSegment2d(p,q,a)) || (d4 == 0 && onSegment2d(p,q,b));
+}
+
+inline bool pointInTriangle2d(const double* p, const double* a, const double* b, const double* c){
+    double s1 = orient2d(a,b,p), s2 = orient2d(b,c,p), s3 = orient2d(c,a,p);
+    return (s1 >= 0 && s2 >= 0 && s3 >= 0) || (s1 <= 0 && s2 <= 0 && s3 <= 0);
+}
+
+//segment and triangle on the same plane: drop an axis along which the normal is not zero
+//(the components of the normal are the orient2d of the projections, exact as well)
+inline bool coplanar(const double* p, const double* q, const double* a, const double* b, const double* c){
+    double n[3];
+    for (int k = 0; k < 3; k++){
+        int i = (k + 1) % 3, j = (k + 2) % 3;
+        double a2[2] = {a[i], a[j]}, b2[2] = {b[i], b[j]}, c2[2] = {c[i], c[j]};
+        n[k] = std::fabs(orient2d(a2, b2, c2));
+    }
+    if (n[0] == 0 && n[1] == 0 && n[2] == 0) return false; // degenerate triangle
+    int drop = (n[0] >= n[1] && n[0] >= n[2]) ? 0 : (n[1] >= n[2] ? 1 : 2);
+    int i = (drop + 1) % 3, j = (drop + 2) % 3;
+    double p2[2] = {p[i], p[j]}, q2[2] = {q[i], q[j]};
+    double a2[2] = {a[i], a[j]}, b2[2] = {b[i], b[j]}, c2[2] = {c[i], c[j]};
+    return pointInTriangle2d(p2, a2, b2, c2) || pointInTriangle2d(q2, a2, b2, c2) ||
+           segmentSegment2d(p2, q2, a2, b2) || segmentSegment2d(p2, q2, b2, c2) ||
+           segmentSegment2d(p2, q2, c2, a2);
+}
+
+inline bool intersect(const double* p, const double* q, const double* a, const double* b, const double* c){
+    double sp = orient3d(a,b,c,p), sq = orient3d(a,b,c,q);
+    if ((sp > 0 && sq > 0) || (sp < 0 && sq < 0)) return false;
+    if (sp == 0 && sq == 0) return coplanar(p,q,a,b,c);
+    double s1 = orient3d(p,q,a,b), s2 = orient3d(p,q,b,c), s3 = orient3d(p,q,c,a);
+    return (s1 >= 0 && s2 >= 0 && s3 >= 0) || (s1 <= 0 && s2 <= 0 && s3 <= 0);
+}
+
+}
+
+#endif // SEGMENTTRIANGLE_H
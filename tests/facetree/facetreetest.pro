@@ -0,0 +1,23 @@
+#facetreetest: checks FaceTree against a brute force scan of the faces, on meshes with
+#many coincident faces. Command line only, exits with 1 on the first mismatch
+TEMPLATE = app
+TARGET = facetreetest
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+include (../../common/common.pri)
+include (../../viewer/viewer.pri)
+include (../../eigenmesh/eigenmesh.pri)
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    main.cpp \
+    ../../facetree.cpp \
+    ../../raytrianglekernel.cpp
+
+HEADERS += \
+    ../../facetree.h \
+    ../../raytrianglekernel.h \
+    ../../rayscratch.h \
+    ../../segmenttriangle.h
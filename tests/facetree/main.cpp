@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <facetree.h>
+#include <segmenttriangle.h>
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const char* what){
+    if (!ok){
+        std::cerr << "FAILED : " << what << std::endl;
+        failures++;
+    }
+}
+
+//stack copies of the same triangle, plus a grid of nGrid x nGrid unit squares on z = 1
+void buildMesh(DrawableEigenMesh& mesh, int copies, int nGrid){
+    int nVertices = 3 + (nGrid + 1) * (nGrid + 1);
+    mesh.resizeVertices(nVertices);
+    mesh.resizeFaces(copies + 2 * nGrid * nGrid);
+    mesh.setVertex(0, 0, 0, 0);
+    mesh.setVertex(1, 1, 0, 0);
+    mesh.setVertex(2, 0, 1, 0);
+    for (int f = 0; f < copies; f++){
+        mesh.setFace(f, 0, 1, 2);
+    }
+    for (int i = 0; i <= nGrid; i++){
+        for (int j = 0; j <= nGrid; j++){
+            mesh.setVertex(3 + i*(nGrid+1) + j, i - nGrid/2.0, j - nGrid/2.0, 1);
+        }
+    }
+    int f = copies;
+    for (int i = 0; i < nGrid; i++){
+        for (int j = 0; j < nGrid; j++){
+            int a = 3 + i*(nGrid+1) + j, b = a + nGrid + 1;
+            mesh.setFace(f++, a, b, b + 1);
+            mesh.setFace(f++, a, b + 1, a + 1);
+        }
+    }
+}
+
+std::vector<int> bruteForce(const DrawableEigenMesh& mesh, const Pointd& p1, const Pointd& p2){
+    std::vector<int> faces;
+    double p[3] = {p1.x(), p1.y(), p1.z()};
+    double q[3] = {p2.x(), p2.y(), p2.z()};
+    for (unsigned int i = 0; i < mesh.getNumberFaces(); i++){
+        Pointi f = mesh.getFace(i);
+        double v[3][3];
+        for (int k = 0; k < 3; k++){
+            Pointd c = mesh.getVertex(f[k]);
+            v[k][0] = c.x(); v[k][1] = c.y(); v[k][2] = c.z();
+        }
+        if (SegmentTriangle::intersect(p, q, v[0], v[1], v[2])) faces.push_back(i);
+    }
+    return faces;
+}
+
+void testRay(const DrawableEigenMesh& mesh, const FaceTree& tree, const Pointd& p1, const Pointd& p2,
+             int expectedHits, const char* what){
+    std::vector<int> faces;
+    tree.getIntersectEigenFaces(p1, p2, faces);
+    std::sort(faces.begin(), faces.end());
+    check(faces == bruteForce(mesh, p1, p2), what);
+
+    std::vector<RayHit> hits;
+    tree.getRayHits(p1, p2, hits);
+    check((int)hits.size() == expectedHits, what);
+    for (unsigned int i = 1; i < hits.size(); i++){
+        check(hits[i-1] < hits[i], what);
+    }
+}
+
+}
+
+int main(){
+    //all the faces coincide: the centroids have no extent along any axis
+    {
+        DrawableEigenMesh mesh;
+        buildMesh(mesh, 50, 0);
+        FaceTree tree(mesh, true);
+        testRay(mesh, tree, Pointd(0.2, 0.2, -1), Pointd(0.2, 0.2, 1), 50, "50 coincident faces");
+        testRay(mesh, tree, Pointd(2, 2, -1), Pointd(2, 2, 1), 0, "50 coincident faces, ray outside");
+    }
+    //a stack of coincident faces inside a larger mesh
+    {
+        DrawableEigenMesh mesh;
+        buildMesh(mesh, 20, 10);
+        FaceTree tree(mesh, true);
+        testRay(mesh, tree, Pointd(0.2, 0.3, -1), Pointd(0.2, 0.3, 2), 20 + 1, "20 coincident faces and a grid");
+        testRay(mesh, tree, Pointd(-3.3, 2.6, -1), Pointd(-3.3, 2.6, 2), 1, "grid only");
+    }
+    if (failures > 0){
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "facetreetest: all checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <string>
+
+#include <trimesh/trimesh.h>
+
+// meshconvert [-float] [-mesh-only] [-bits n] input.{obj,off,ply,stl,tmb,tmz} output.{tmb,tmz,obj}
+//
+// .tmb output: the coordinates (double, or float with -float), the triangles and, unless
+// -mesh-only, adjacency, normals and bounding box precomputed, so that opening it later
+// costs nothing but copying the arrays
+//
+// .tmz output: compressed archive, coordinates quantized to n bits per axis (default 20)
+
+namespace
+{
+
+void usage()
+{
+    std::cerr << "usage: meshconvert [-float] [-mesh-only] [-bits n] input.{obj,off,ply,stl,tmb,tmz} output.{tmb,tmz,obj}" << std::endl;
+}
+
+bool endsWith(const std::string & s, const char * suffix)
+{
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+template<typename real>
+int convert(const char * input, const char * output, bool meshOnly, int bits)
+{
+    Trimesh<real> mesh;
+    if (!mesh.load(input)) return 1;
+    if (endsWith(output, ".tmb"))
+    {
+        int pieces = meshOnly ? 0 : Trimesh<real>::ADJACENCY | Trimesh<real>::TRIANGLE_NORMALS | Trimesh<real>::VERTEX_NORMALS | Trimesh<real>::BBOX;
+        mesh.saveBinary(output, pieces);
+    }
+    else if (endsWith(output, ".tmz"))
+    {
+        if (!saveArchive(output, mesh.vectorCoords(), mesh.vectorTriangles(), bits)) return 1;
+    }
+    else if (endsWith(output, ".obj") || endsWith(output, ".OBJ"))
+    {
+        if (!saveObj(output, mesh.vectorCoords(), mesh.vectorTriangles(), OBJ_EXACT_PRECISION)) return 1;
+    }
+    else
+    {
+        usage();
+        return 1;
+    }
+    return 0;
+}
+
+}
+
+int main(int argc, char * argv[])
+{
+    bool useFloat = false, meshOnly = false;
+    int bits = MeshArchive::DEFAULT_BITS;
+    int first = 1;
+    for(; first<argc && argv[first][0] == '-'; ++first)
+    {
+        if      (strcmp(argv[first], "-float")     == 0) useFloat = true;
+        else if (strcmp(argv[first], "-mesh-only") == 0) meshOnly = true;
+        else if (strcmp(argv[first], "-bits")      == 0 && first + 1 < argc) bits = atoi(argv[++first]);
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (argc - first != 2)
+    {
+        usage();
+        return 1;
+    }
+
+    return useFloat ? convert<float> (argv[first], argv[first+1], meshOnly, bits)
+                    : convert<double>(argv[first], argv[first+1], meshOnly, bits);
+}
@@ -0,0 +1,16 @@
+#meshconvert: converts OBJ/OFF/PLY/STL meshes to the binary .tmb format of the trimesh module,
+#to the compressed .tmz archive (and back to OBJ). Command line only, no viewer
+TEMPLATE = app
+TARGET = meshconvert
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+unix:!macx{
+    QMAKE_CXXFLAGS_RELEASE += -O3
+}
+
+include (../../common/common.pri)
+include (../../trimesh/trimesh.pri)
+
+SOURCES += \
+    main.cpp
@@ -7,14 +7,32 @@ MODULES +=  TRIMESH
 
 HEADERS += \
     $$PWD/trimesh/trimesh.h \
+    $$PWD/trimesh/csr_adjacency.h \
+    $$PWD/trimesh/parallel.h \
+    $$PWD/trimesh/geometry_kernels.h \
+    $$PWD/trimesh/morton.h \
+    $$PWD/trimesh/bvh.h \
+    $$PWD/trimesh/compact_trimesh.h \
+    $$PWD/trimesh/fast_parse.h \
+    $$PWD/trimesh/mapped_file.h \
+    $$PWD/trimesh/binary_mesh.h \
+    $$PWD/trimesh/mesh_archive.h \
+    $$PWD/trimesh/weld.h \
+    $$PWD/trimesh/load_progress.h \
     $$PWD/trimesh/load_save_trimesh.h
 
 SOURCES += \
     $$PWD/trimesh/load_save_trimesh.cpp \
+    $$PWD/trimesh/mapped_file.cpp \
+    $$PWD/trimesh/binary_mesh.cpp \
+    $$PWD/trimesh/mesh_archive.cpp
 
 contains(DEFINES, VIEWER_DEFINED){
     #WARNING: BUG on qmake: comment the following line if viewer is not included
     include ($$PWD/trimesh/gui/trimeshmanager.pri)
 }
 
+#std::thread (parallel.h)
+CONFIG += thread
+
 INCLUDEPATH += $$PWD
@@ -0,0 +1,157 @@
+#include "binary_mesh.h"
+
+#include <stdio.h>
+#include <iostream>
+
+namespace
+{
+
+const char     magic[8]  = { 'T', 'R', 'I', 'M', 'E', 'S', 'H', 'B' };
+const uint32_t byteOrder = 0x01020304;
+
+inline uint64_t alignUp(uint64_t offset)
+{
+    return (offset + BinaryMesh::ALIGNMENT - 1) / BinaryMesh::ALIGNMENT * BinaryMesh::ALIGNMENT;
+}
+
+}
+
+bool BinaryMeshFile::open(const char * filename)
+{
+    sections.clear();
+    if (!file.open(filename))
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : open() : couldn't open input file " << filename << std::endl;
+        return false;
+    }
+
+    BinaryMesh::FileHeader header;
+    if (file.size() < sizeof(header))
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : open() : " << filename << " is not a .tmb file" << std::endl;
+        file.close();
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, magic, sizeof(magic)) != 0)
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : open() : " << filename << " is not a .tmb file" << std::endl;
+        file.close();
+        return false;
+    }
+    if (header.byteOrder != byteOrder)
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : open() : " << filename << " was written with another byte order" << std::endl;
+        file.close();
+        return false;
+    }
+    if (header.version != BinaryMesh::VERSION)
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : open() : " << filename << " has version "
+                  << header.version << ", version " << BinaryMesh::VERSION << " is supported" << std::endl;
+        file.close();
+        return false;
+    }
+    uint64_t tableEnd = sizeof(header) + (uint64_t)header.numSections * sizeof(BinaryMesh::SectionEntry);
+    if (header.fileSize != file.size() || tableEnd > file.size())
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : open() : " << filename << " is truncated" << std::endl;
+        file.close();
+        return false;
+    }
+
+    sections.resize(header.numSections);
+    if (header.numSections > 0) memcpy(&sections[0], file.data() + sizeof(header), header.numSections * sizeof(BinaryMesh::SectionEntry));
+    for(int i=0; i<(int)sections.size(); ++i)
+    {
+        const BinaryMesh::SectionEntry & s = sections[i];
+        int size = BinaryMesh::elementSize(s.type);
+        bool fits = size > 0 && s.count <= (uint64_t)0x7fffffff && s.offset % BinaryMesh::ALIGNMENT == 0 &&
+                    s.offset >= tableEnd && s.offset <= file.size() && s.count * size <= file.size() - s.offset;
+        if (!fits)
+        {
+            std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : open() : " << filename << " has an invalid section (id " << s.id << ")" << std::endl;
+            sections.clear();
+            file.close();
+            return false;
+        }
+    }
+    return true;
+}
+
+const BinaryMesh::SectionEntry * BinaryMeshFile::find(int id) const
+{
+    for(int i=0; i<(int)sections.size(); ++i)
+    {
+        if ((int)sections[i].id == id) return &sections[i];
+    }
+    return nullptr;
+}
+
+const void * BinaryMeshFile::data(int id, int & type, size_t & count) const
+{
+    const BinaryMesh::SectionEntry * s = find(id);
+    if (!s) return nullptr;
+    type  = (int)s->type;
+    count = (size_t)s->count;
+    return file.data() + s->offset;
+}
+
+void BinaryMeshWriter::add(int id, int type, const void * data, size_t count)
+{
+    Section s = { id, type, data, count };
+    sections.push_back(s);
+}
+
+bool BinaryMeshWriter::write(const char * filename) const
+{
+    BinaryMesh::FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version     = BinaryMesh::VERSION;
+    header.byteOrder   = byteOrder;
+    header.numSections = (uint32_t)sections.size();
+
+    std::vector<BinaryMesh::SectionEntry> table(sections.size());
+    uint64_t offset = alignUp(sizeof(header) + table.size() * sizeof(BinaryMesh::SectionEntry));
+    for(int i=0; i<(int)sections.size(); ++i)
+    {
+        memset(&table[i], 0, sizeof(table[i]));
+        table[i].id     = sections[i].id;
+        table[i].type   = sections[i].type;
+        table[i].offset = offset;
+        table[i].count  = sections[i].count;
+        offset = alignUp(offset + sections[i].count * BinaryMesh::elementSize(sections[i].type));
+    }
+    header.fileSize = offset;
+
+    FILE * fp = fopen(filename, "wb");
+    if (!fp)
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : write() : couldn't open output file " << filename << std::endl;
+        return false;
+    }
+
+    // every section is written straight from its array, the gaps are zeros
+    static const char zeros[BinaryMesh::ALIGNMENT] = {};
+    uint64_t written = 0;
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    written += sizeof(header);
+    if (ok && !table.empty()) ok = fwrite(&table[0], sizeof(BinaryMesh::SectionEntry), table.size(), fp) == table.size();
+    written += table.size() * sizeof(BinaryMesh::SectionEntry);
+    for(int i=0; i<(int)sections.size() && ok; ++i)
+    {
+        size_t padding = (size_t)(table[i].offset - written);
+        size_t bytes   = sections[i].count * BinaryMesh::elementSize(sections[i].type);
+        ok = fwrite(zeros, 1, padding, fp) == padding && (bytes == 0 || fwrite(sections[i].data, 1, bytes, fp) == bytes);
+        written = table[i].offset + bytes;
+    }
+    if (ok) ok = fwrite(zeros, 1, (size_t)(header.fileSize - written), fp) == header.fileSize - written;
+
+    if (fclose(fp) != 0 || !ok)
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : write() : couldn't write output file " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
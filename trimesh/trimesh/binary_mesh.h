@@ -0,0 +1,208 @@
+#ifndef BINARY_MESH_H
+#define BINARY_MESH_H
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "mapped_file.h"
+#include "parallel.h"
+
+/**
+ * @brief Native binary mesh file (.tmb): the arrays of a Trimesh as they are in memory.
+ *
+ * Layout, all in the byte order of the machine that wrote it (checked on open):
+ *
+ *   header   64 bytes   magic "TRIMESHB", version, byte order mark, number of sections
+ *   table    32 bytes per section: id, element type, offset, number of elements
+ *   sections every one starting at a multiple of 64 bytes
+ *
+ * Coordinates and triangles are always there; normals, bounding box and adjacency only if
+ * they were saved. Sections with an unknown id are skipped, so new ones can be added
+ * without changing the version.
+ */
+
+namespace BinaryMesh {
+
+enum { VERSION = 1, ALIGNMENT = 64 };
+
+enum ElementType
+{
+    INT8    = 1,
+    INT32   = 2,
+    FLOAT32 = 3,
+    FLOAT64 = 4
+};
+
+enum SectionId
+{
+    COORDS = 1,
+    TRIS,
+    BBOX,               // min x y z, max x y z, FLOAT64
+    TRIANGLE_NORMALS,
+    VERTEX_NORMALS,
+    VTX2TRI_OFFSETS,
+    VTX2TRI_INDICES,
+    VTX2VTX_OFFSETS,
+    VTX2VTX_INDICES,
+    TRI2TRI_OFFSETS,
+    TRI2TRI_INDICES,
+    EDGE2VTX,
+    TRI2EDGE,
+    EDGE2TRI_OFFSETS,
+    EDGE2TRI_INDICES,
+    EDGE_BOUNDARY,
+    NON_MANIFOLD_EDGES  // vertex pairs
+};
+
+inline int elementSize(int type)
+{
+    switch (type)
+    {
+        case INT8:    return 1;
+        case INT32:   return 4;
+        case FLOAT32: return 4;
+        case FLOAT64: return 8;
+        default:      return 0;
+    }
+}
+
+template<typename T> struct TypeOf;
+template<> struct TypeOf<char>   { enum { value = INT8    }; };
+template<> struct TypeOf<int>    { enum { value = INT32   }; };
+template<> struct TypeOf<float>  { enum { value = FLOAT32 }; };
+template<> struct TypeOf<double> { enum { value = FLOAT64 }; };
+
+struct FileHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t byteOrder;   // 0x01020304 as written
+    uint32_t numSections;
+    uint32_t reserved0;
+    uint64_t fileSize;
+    uint8_t  reserved1[32];
+};
+
+struct SectionEntry
+{
+    uint32_t id;
+    uint32_t type;
+    uint64_t offset;      // from the start of the file
+    uint64_t count;       // elements
+    uint64_t reserved;
+};
+
+static_assert(sizeof(FileHeader) == 64, "the header is 64 bytes");
+static_assert(sizeof(SectionEntry) == 32, "a section entry is 32 bytes");
+
+}
+
+/**
+ * @brief A .tmb file opened for reading: memory mapped, sections are read on demand.
+ */
+class BinaryMeshFile
+{
+    public:
+
+        BinaryMeshFile() {}
+
+        // false (with an error on std::cerr) if the file cannot be read or is not a valid .tmb
+        bool open(const char * filename);
+
+        bool has(int id) const { return find(id) != nullptr; }
+
+        // number of elements of the section, 0 if there is none
+        size_t count(int id) const
+        {
+            const BinaryMesh::SectionEntry * s = find(id);
+            return s ? (size_t)s->count : 0;
+        }
+
+        // the section as it is in the file (64 bytes aligned when the file is mapped), or nullptr
+        const void * data(int id, int & type, size_t & count) const;
+
+        // copies the section into out; floating point sections are converted to T.
+        // False if there is no such section or its type does not fit T
+        template<typename T>
+        bool read(int id, std::vector<T> & out) const
+        {
+            int type;
+            size_t n;
+            const char * src = (const char *)data(id, type, n);
+            if (!src) return false;
+
+            out.resize(n);
+            const int wanted = BinaryMesh::TypeOf<T>::value;
+            if (type == wanted)
+            {
+                Parallel::forChunks((int)((n + 65535) / 65536), [&](int begin, int end)
+                {
+                    size_t first = (size_t)begin * 65536, last = std::min(n, (size_t)end * 65536);
+                    memcpy(&out[first], src + first * sizeof(T), (last - first) * sizeof(T));
+                }, 1);
+                return true;
+            }
+            if (type == BinaryMesh::FLOAT32 && wanted == BinaryMesh::FLOAT64) return convert<float>(src, out);
+            if (type == BinaryMesh::FLOAT64 && wanted == BinaryMesh::FLOAT32) return convert<double>(src, out);
+            out.clear();
+            return false;
+        }
+
+    private:
+
+        BinaryMeshFile(const BinaryMeshFile &);
+        BinaryMeshFile & operator=(const BinaryMeshFile &);
+
+        const BinaryMesh::SectionEntry * find(int id) const;
+
+        template<typename S, typename T>
+        bool convert(const char * src, std::vector<T> & out) const
+        {
+            const S * in = (const S *)src;
+            Parallel::forChunks((int)out.size(), [&](int begin, int end)
+            {
+                for(int i=begin; i<end; ++i) out[i] = (T)in[i];
+            }, 65536);
+            return true;
+        }
+
+        MappedFile                              file;
+        std::vector<BinaryMesh::SectionEntry>   sections;
+};
+
+/**
+ * @brief Collects the sections of a .tmb file and writes them.
+ *
+ * The arrays are not copied: they must stay alive (and unchanged) until write().
+ */
+class BinaryMeshWriter
+{
+    public:
+
+        void add(int id, int type, const void * data, size_t count);
+
+        template<typename T>
+        void add(int id, const std::vector<T> & v)
+        {
+            add(id, BinaryMesh::TypeOf<T>::value, v.data(), v.size());
+        }
+
+        // false (with an error on std::cerr) if the file cannot be written
+        bool write(const char * filename) const;
+
+    private:
+
+        struct Section
+        {
+            int          id;
+            int          type;
+            const void * data;
+            size_t       count;
+        };
+
+        std::vector<Section> sections;
+};
+
+#endif // BINARY_MESH_H
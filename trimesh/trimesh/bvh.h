@@ -0,0 +1,530 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#include "parallel.h"
+
+/**
+ * @brief Bounding volume hierarchy over the triangles of a mesh.
+ *
+ * The tree is built top-down with a binned surface area heuristic, the subtrees of large
+ * nodes in parallel. Nodes are flattened in one array, 32 bytes each, with the root first:
+ * an inner node stores the index of its first child (the second one follows it), a leaf a
+ * range of the triangle permutation. Boxes are in single precision, rounded outwards.
+ *
+ * The tree does not keep pointers to the mesh: coordinates and triangles are passed to
+ * every call. After vertex moves refit() recomputes the boxes and keeps the tree, which
+ * gets slower to traverse as the deformation grows: build() again after large ones.
+ */
+
+struct bvhNode
+{
+    float min[3];
+    float max[3];
+    int   index; // leaf: first entry of the triangle permutation; inner node: first child
+    int   count; // leaf: number of triangles; inner node: 0
+};
+
+struct rayHit
+{
+    double t;    // the hit point is origin + t * direction
+    int    tid;
+    double u, v; // barycentric coordinates of the hit point, w.r.t. corners 1 and 2
+
+    inline bool operator<(const rayHit & other) const
+    {
+        return t < other.t || (t == other.t && tid < other.tid);
+    }
+};
+
+template<typename real>
+class BVH
+{
+    public:
+
+        BVH() {}
+
+        inline bool empty() const { return nodes.empty(); }
+
+        inline const std::vector<bvhNode> & vectorNodes() const { return nodes; }
+        inline const std::vector<int>     & vectorOrder() const { return order; }
+
+        void clear()
+        {
+            nodes.clear();
+            order.clear();
+        }
+
+        void build(const real * xyz, const int * tris, int nTris)
+        {
+            clear();
+            if (nTris == 0) return;
+
+            primMin.resize(nTris*3);
+            primMax.resize(nTris*3);
+            centroids.resize(nTris*3);
+            Parallel::forChunks(nTris, [&](int begin, int end)
+            {
+                for(int tid=begin; tid<end; ++tid)
+                {
+                    triangleBox(xyz, tris, tid, &primMin[tid*3], &primMax[tid*3]);
+                    for(int k=0; k<3; ++k) centroids[tid*3+k] = 0.5f * (primMin[tid*3+k] + primMax[tid*3+k]);
+                }
+            });
+
+            order.resize(nTris);
+            for(int i=0; i<nTris; ++i) order[i] = i;
+
+            nodes.resize(2*nTris - 1);
+            std::atomic<int> nNodes(1);
+            buildNode(0, 0, nTris, 0, nNodes);
+            nodes.resize(nNodes.load());
+
+            std::vector<float>().swap(primMin);
+            std::vector<float>().swap(primMax);
+            std::vector<float>().swap(centroids);
+        }
+
+        // new boxes for moved vertices, same tree. Children always come after their parent
+        void refit(const real * xyz, const int * tris)
+        {
+            Parallel::forEach((int)nodes.size(), [&](int nid)
+            {
+                bvhNode & node = nodes[nid];
+                if (node.count == 0) return;
+                emptyBox(node.min, node.max);
+                for(int i=node.index; i<node.index+node.count; ++i)
+                {
+                    float lo[3], hi[3];
+                    triangleBox(xyz, tris, order[i], lo, hi);
+                    growBox(node.min, node.max, lo, hi);
+                }
+            }, 1024);
+
+            for(int nid=(int)nodes.size()-1; nid>=0; --nid)
+            {
+                bvhNode & node = nodes[nid];
+                if (node.count > 0) continue;
+                const bvhNode & a = nodes[node.index];
+                const bvhNode & b = nodes[node.index + 1];
+                for(int k=0; k<3; ++k)
+                {
+                    node.min[k] = std::min(a.min[k], b.min[k]);
+                    node.max[k] = std::max(a.max[k], b.max[k]);
+                }
+            }
+        }
+
+        // rays are origin + t * direction, t in [0, tmax]; both sides of the triangles are hit
+
+        bool anyHit(const real * xyz, const int * tris, const double origin[3], const double direction[3], double tmax) const
+        {
+            rayHit hit;
+            return traverse(xyz, tris, origin, direction, tmax, ANY, hit, nullptr);
+        }
+
+        bool firstHit(const real * xyz, const int * tris, const double origin[3], const double direction[3], double tmax, rayHit & hit) const
+        {
+            return traverse(xyz, tris, origin, direction, tmax, FIRST, hit, nullptr);
+        }
+
+        // sorted by t
+        void allHits(const real * xyz, const int * tris, const double origin[3], const double direction[3], double tmax, std::vector<rayHit> & hits) const
+        {
+            rayHit hit;
+            hits.clear();
+            traverse(xyz, tris, origin, direction, tmax, ALL, hit, &hits);
+            std::sort(hits.begin(), hits.end());
+        }
+
+        // triangles whose bounding box overlaps [min, max], sorted
+        void boxOverlap(const real * xyz, const int * tris, const double min[3], const double max[3], std::vector<int> & tids) const
+        {
+            tids.clear();
+            if (nodes.empty()) return;
+
+            int stack[STACK_SIZE];
+            int top = 0;
+            stack[top++] = 0;
+            while (top > 0)
+            {
+                const bvhNode & node = nodes[stack[--top]];
+                if (!overlaps(node.min, node.max, min, max)) continue;
+                if (node.count == 0)
+                {
+                    stack[top++] = node.index;
+                    stack[top++] = node.index + 1;
+                    continue;
+                }
+                for(int i=node.index; i<node.index+node.count; ++i)
+                {
+                    float lo[3], hi[3];
+                    triangleBox(xyz, tris, order[i], lo, hi);
+                    if (overlaps(lo, hi, min, max)) tids.push_back(order[i]);
+                }
+            }
+            std::sort(tids.begin(), tids.end());
+        }
+
+    private:
+
+        enum Query { ANY, FIRST, ALL };
+
+        static const int BINS        = 16;
+        static const int MAX_LEAF    = 8;
+        static const int MAX_DEPTH   = 48;      // deeper nodes are split at the median: depth <= 48 + log2(n)
+        static const int STACK_SIZE  = 128;
+        static const int TASK_SIZE   = 4096;    // smaller subtrees are built by the thread that splits them
+        static const int CHUNK_SIZE  = 1 << 16; // larger nodes are binned in parallel
+
+        struct binSet
+        {
+            float min[3][BINS][3];
+            float max[3][BINS][3];
+            int   count[3][BINS];
+
+            binSet()
+            {
+                for(int a=0; a<3; ++a) for(int b=0; b<BINS; ++b)
+                {
+                    emptyBox(min[a][b], max[a][b]);
+                    count[a][b] = 0;
+                }
+            }
+        };
+
+        std::vector<bvhNode> nodes;
+        std::vector<int>     order;     // leaves index ranges of it
+
+        // triangle boxes and centroids, during build() only
+        std::vector<float>   primMin, primMax, centroids;
+
+        static inline float roundDown(real v)
+        {
+            float f = (float)v;
+            return (f > v) ? std::nextafter(f, -FLT_MAX) : f;
+        }
+
+        static inline float roundUp(real v)
+        {
+            float f = (float)v;
+            return (f < v) ? std::nextafter(f, FLT_MAX) : f;
+        }
+
+        static inline void emptyBox(float min[3], float max[3])
+        {
+            for(int k=0; k<3; ++k)
+            {
+                min[k] =  FLT_MAX;
+                max[k] = -FLT_MAX;
+            }
+        }
+
+        static inline void growBox(float min[3], float max[3], const float lo[3], const float hi[3])
+        {
+            for(int k=0; k<3; ++k)
+            {
+                min[k] = std::min(min[k], lo[k]);
+                max[k] = std::max(max[k], hi[k]);
+            }
+        }
+
+        static inline float halfArea(const float min[3], const float max[3])
+        {
+            float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+            return (dx < 0) ? 0 : dx*dy + dy*dz + dz*dx;
+        }
+
+        template<typename T>
+        static inline bool overlaps(const float min[3], const float max[3], const T lo[3], const T hi[3])
+        {
+            return min[0] <= hi[0] && max[0] >= lo[0] &&
+                   min[1] <= hi[1] && max[1] >= lo[1] &&
+                   min[2] <= hi[2] && max[2] >= lo[2];
+        }
+
+        static inline void triangleBox(const real * xyz, const int * tris, int tid, float min[3], float max[3])
+        {
+            const real * v0 = &xyz[tris[tid*3+0]*3];
+            const real * v1 = &xyz[tris[tid*3+1]*3];
+            const real * v2 = &xyz[tris[tid*3+2]*3];
+            for(int k=0; k<3; ++k)
+            {
+                min[k] = roundDown(std::min(v0[k], std::min(v1[k], v2[k])));
+                max[k] = roundUp  (std::max(v0[k], std::max(v1[k], v2[k])));
+            }
+        }
+
+        inline int binOf(int prim, int axis, const float cmin[3], const float scale[3]) const
+        {
+            int b = (int)((centroids[prim*3+axis] - cmin[axis]) * scale[axis]);
+            return std::max(0, std::min(BINS-1, b));
+        }
+
+        void binRange(int begin, int end, const float cmin[3], const float scale[3], binSet & bins) const
+        {
+            for(int i=begin; i<end; ++i)
+            {
+                int prim = order[i];
+                for(int a=0; a<3; ++a)
+                {
+                    if (scale[a] == 0) continue;
+                    int b = binOf(prim, a, cmin, scale);
+                    growBox(bins.min[a][b], bins.max[a][b], &primMin[prim*3], &primMax[prim*3]);
+                    ++bins.count[a][b];
+                }
+            }
+        }
+
+        void buildNode(int nid, int begin, int end, int depth, std::atomic<int> & nNodes)
+        {
+            int n = end - begin;
+            bvhNode & node = nodes[nid];
+
+            // node box and centroid box
+            float cmin[3], cmax[3];
+            emptyBox(node.min, node.max);
+            emptyBox(cmin, cmax);
+            for(int i=begin; i<end; ++i)
+            {
+                int prim = order[i];
+                growBox(node.min, node.max, &primMin[prim*3], &primMax[prim*3]);
+                growBox(cmin, cmax, &centroids[prim*3], &centroids[prim*3]);
+            }
+
+            if (n <= 2)
+            {
+                makeLeaf(node, begin, n);
+                return;
+            }
+
+            float scale[3];
+            for(int a=0; a<3; ++a)
+            {
+                float extent = cmax[a] - cmin[a];
+                scale[a] = (extent > 0) ? BINS / extent : 0;
+            }
+
+            int mid = -1;
+            if (depth < MAX_DEPTH && (scale[0] > 0 || scale[1] > 0 || scale[2] > 0))
+            {
+                binSet bins;
+                if (n > CHUNK_SIZE)
+                {
+                    int nChunks = Parallel::numChunks(n, CHUNK_SIZE);
+                    std::vector<binSet> partial(nChunks);
+                    Parallel::forEachChunk(n, nChunks, [&](int chunk, int b, int e)
+                    {
+                        binRange(begin + b, begin + e, cmin, scale, partial[chunk]);
+                    });
+                    for(int c=0; c<nChunks; ++c) for(int a=0; a<3; ++a) for(int b=0; b<BINS; ++b)
+                    {
+                        growBox(bins.min[a][b], bins.max[a][b], partial[c].min[a][b], partial[c].max[a][b]);
+                        bins.count[a][b] += partial[c].count[a][b];
+                    }
+                }
+                else binRange(begin, end, cmin, scale, bins);
+
+                // cost of a split after bin s: 1 + (area(left) * n(left) + area(right) * n(right)) / area(node)
+                float bestCost = FLT_MAX;
+                int   bestAxis = -1, bestSplit = -1;
+                for(int a=0; a<3; ++a)
+                {
+                    if (scale[a] == 0) continue;
+                    float rightCost[BINS];
+                    float rmin[3], rmax[3];
+                    emptyBox(rmin, rmax);
+                    int rn = 0;
+                    for(int b=BINS-1; b>0; --b)
+                    {
+                        growBox(rmin, rmax, bins.min[a][b], bins.max[a][b]);
+                        rn += bins.count[a][b];
+                        rightCost[b] = halfArea(rmin, rmax) * rn;
+                    }
+                    float lmin[3], lmax[3];
+                    emptyBox(lmin, lmax);
+                    int ln = 0;
+                    for(int b=0; b<BINS-1; ++b)
+                    {
+                        growBox(lmin, lmax, bins.min[a][b], bins.max[a][b]);
+                        ln += bins.count[a][b];
+                        if (ln == 0 || ln == n) continue;
+                        float cost = halfArea(lmin, lmax) * ln + rightCost[b+1];
+                        if (cost < bestCost)
+                        {
+                            bestCost  = cost;
+                            bestAxis  = a;
+                            bestSplit = b;
+                        }
+                    }
+                }
+
+                float area = halfArea(node.min, node.max);
+                bestCost = 1 + (area > 0 ? bestCost / area : n);
+                if (bestAxis >= 0 && (bestCost < n || n > MAX_LEAF))
+                {
+                    mid = (int)(std::partition(order.begin() + begin, order.begin() + end, [&](int prim)
+                    {
+                        return binOf(prim, bestAxis, cmin, scale) <= bestSplit;
+                    }) - order.begin());
+                }
+                else if (n <= MAX_LEAF)
+                {
+                    makeLeaf(node, begin, n);
+                    return;
+                }
+            }
+            else if (n <= MAX_LEAF)
+            {
+                makeLeaf(node, begin, n);
+                return;
+            }
+
+            // no usable split (e.g. coincident centroids), or too deep: median on the widest centroid axis
+            if (mid <= begin || mid >= end)
+            {
+                int axis = 0;
+                for(int a=1; a<3; ++a) if (cmax[a] - cmin[a] > cmax[axis] - cmin[axis]) axis = a;
+                mid = begin + n/2;
+                std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](int p, int q)
+                {
+                    return centroids[p*3+axis] < centroids[q*3+axis];
+                });
+            }
+
+            int child = nNodes.fetch_add(2);
+            node.index = child;
+            node.count = 0;
+            if (n > TASK_SIZE)
+            {
+                Parallel::ThreadPool::shared().run(2, [&](int i)
+                {
+                    if (i == 0) buildNode(child,     begin, mid, depth + 1, nNodes);
+                    else        buildNode(child + 1, mid,   end, depth + 1, nNodes);
+                });
+            }
+            else
+            {
+                buildNode(child,     begin, mid, depth + 1, nNodes);
+                buildNode(child + 1, mid,   end, depth + 1, nNodes);
+            }
+        }
+
+        static inline void makeLeaf(bvhNode & node, int begin, int n)
+        {
+            node.index = begin;
+            node.count = n;
+        }
+
+        // entry distance of the ray in the box, or false
+        static inline bool rayBox(const bvhNode & node, const double origin[3], const double inv[3], double tmax, double & tnear)
+        {
+            double t0 = 0, t1 = tmax;
+            for(int k=0; k<3; ++k)
+            {
+                double a = (node.min[k] - origin[k]) * inv[k];
+                double b = (node.max[k] - origin[k]) * inv[k];
+                if (a > b) std::swap(a, b);
+                t0 = std::max(t0, a);
+                t1 = std::min(t1, b);
+                if (t0 > t1) return false;
+            }
+            tnear = t0;
+            return true;
+        }
+
+        // Moller-Trumbore
+        static inline bool rayTriangle(const real * xyz, const int * tris, int tid, const double o[3], const double d[3], double tmax, rayHit & hit)
+        {
+            const real * v0 = &xyz[tris[tid*3+0]*3];
+            const real * v1 = &xyz[tris[tid*3+1]*3];
+            const real * v2 = &xyz[tris[tid*3+2]*3];
+            double e1[3] = { (double)v1[0] - v0[0], (double)v1[1] - v0[1], (double)v1[2] - v0[2] };
+            double e2[3] = { (double)v2[0] - v0[0], (double)v2[1] - v0[1], (double)v2[2] - v0[2] };
+            double p[3]  = { d[1]*e2[2] - d[2]*e2[1], d[2]*e2[0] - d[0]*e2[2], d[0]*e2[1] - d[1]*e2[0] };
+            double det   = e1[0]*p[0] + e1[1]*p[1] + e1[2]*p[2];
+            if (det == 0) return false; // parallel to the plane, or degenerate
+            double inv   = 1 / det;
+            double s[3]  = { o[0] - v0[0], o[1] - v0[1], o[2] - v0[2] };
+            double u     = (s[0]*p[0] + s[1]*p[1] + s[2]*p[2]) * inv;
+            if (u < 0 || u > 1) return false;
+            double q[3]  = { s[1]*e1[2] - s[2]*e1[1], s[2]*e1[0] - s[0]*e1[2], s[0]*e1[1] - s[1]*e1[0] };
+            double v     = (d[0]*q[0] + d[1]*q[1] + d[2]*q[2]) * inv;
+            if (v < 0 || u + v > 1) return false;
+            double t     = (e2[0]*q[0] + e2[1]*q[1] + e2[2]*q[2]) * inv;
+            if (t < 0 || t > tmax) return false;
+            hit.t   = t;
+            hit.tid = tid;
+            hit.u   = u;
+            hit.v   = v;
+            return true;
+        }
+
+        bool traverse(const real * xyz, const int * tris, const double origin[3], const double direction[3], double tmax,
+                      Query query, rayHit & best, std::vector<rayHit> * hits) const
+        {
+            if (nodes.empty()) return false;
+
+            // zero components get a huge inverse instead of inf, so that 0 * inv is never NaN
+            double inv[3];
+            for(int k=0; k<3; ++k)
+            {
+                inv[k] = (direction[k] != 0) ? 1 / direction[k] : std::copysign(1e300, direction[k]);
+            }
+
+            bool found = false;
+            int stack[STACK_SIZE];
+            int top = 0;
+            double tnear;
+            if (!rayBox(nodes[0], origin, inv, tmax, tnear)) return false;
+            stack[top++] = 0;
+            while (top > 0)
+            {
+                const bvhNode & node = nodes[stack[--top]];
+                if (query == FIRST && !rayBox(node, origin, inv, tmax, tnear)) continue; // tmax has shrunk
+
+                if (node.count > 0)
+                {
+                    for(int i=node.index; i<node.index+node.count; ++i)
+                    {
+                        rayHit hit;
+                        if (!rayTriangle(xyz, tris, order[i], origin, direction, tmax, hit)) continue;
+                        if (query == FIRST && found && !(hit < best)) continue; // same t, higher tid
+                        found = true;
+                        if (query == ANY) return true;
+                        if (query == ALL)
+                        {
+                            hits->push_back(hit);
+                        }
+                        else
+                        {
+                            best = hit;
+                            tmax = hit.t;
+                        }
+                    }
+                    continue;
+                }
+
+                // the nearer child is visited first
+                double ta, tb;
+                bool a = rayBox(nodes[node.index],     origin, inv, tmax, ta);
+                bool b = rayBox(nodes[node.index + 1], origin, inv, tmax, tb);
+                if (a && b)
+                {
+                    bool aFirst = ta <= tb;
+                    stack[top++] = aFirst ? node.index + 1 : node.index;
+                    stack[top++] = aFirst ? node.index     : node.index + 1;
+                }
+                else if (a) stack[top++] = node.index;
+                else if (b) stack[top++] = node.index + 1;
+            }
+            return found;
+        }
+};
+
+#endif // BVH_H
@@ -0,0 +1,422 @@
+#ifndef COMPACT_TRIMESH_H
+#define COMPACT_TRIMESH_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "trimesh.h"
+
+/**
+ * @brief Read-only quantized copy of a Trimesh, for keeping large meshes resident.
+ *
+ * Positions: integers on a regular grid over the bounding box, 21 bits per axis packed in
+ * 8 bytes or 16 bits per axis in 6 bytes (24 bytes for 3 doubles).
+ * Normals: octahedral encoding, two 16 bit snorms in 4 bytes (24 bytes for 3 doubles).
+ * Triangles: 32 bit indices, or delta coded in blocks of BLOCK_SIZE triangles (zigzag
+ * varints of the difference from the previous index): 2-4 bytes per index instead of 4
+ * on a mesh with coherent indices (see Trimesh::reorder()), random access within a block.
+ *
+ * Error bounds:
+ *  - position, per axis: |decoded - original| <= extent / (2 * (2^bits - 1)) with extent the
+ *    bounding box size along the axis (rounding to the nearest grid point), i.e.
+ *    2.4e-7 * extent with 21 bits, 7.7e-6 * extent with 16 bits. vertex() decodes in double
+ *    and adds nothing to it; decodeVertices() to float adds the float rounding of the result.
+ *  - normals: the decoded normal is within 0.0025 degrees of the original unit normal
+ *    (the encoder picks the best of the four neighboring grid points; measured maximum
+ *    over 10^7 random directions: 0.00247 degrees).
+ *  - triangles: lossless.
+ *  - normals computed from the quantized positions (triangleNormals()) depend on the size of
+ *    the triangles w.r.t. the grid: 0.017 degrees (21 bits) and 0.48 degrees (16 bits) at
+ *    most on a 2M triangle height field spanning 1000 triangles per side.
+ *
+ * On that mesh the encoding takes 31% (21 bits) or 28% (16 bits) of the memory of double
+ * coordinates and normals with 32 bit indices.
+ *
+ * The kernels work on the encoded data: triangleNormals() takes the corner differences
+ * on the integers (exact) and scales them by the grid step, four triangles per SSE step.
+ */
+
+namespace Octahedral {
+
+inline double signNotZero(double v) { return v < 0 ? -1.0 : 1.0; }
+
+inline double fromSnorm(uint32_t q) { return std::max(-1.0, (double)(int16_t)(uint16_t)q / 32767.0); }
+
+// real: float or double, the math is done in it
+template<typename real>
+inline void decode(uint32_t code, real n[3])
+{
+    real x = (real)fromSnorm(code & 0xffff);
+    real y = (real)fromSnorm(code >> 16);
+    real z = 1 - std::fabs(x) - std::fabs(y);
+    if (z < 0)
+    {
+        real ox = x;
+        x = (1 - std::fabs(y))  * (real)signNotZero(ox);
+        y = (1 - std::fabs(ox)) * (real)signNotZero(y);
+    }
+    real len = std::sqrt(x*x + y*y + z*z);
+    n[0] = x / len;
+    n[1] = y / len;
+    n[2] = z / len;
+}
+
+// n is a unit vector (zero vectors are encoded as +z)
+template<typename real>
+inline uint32_t encode(const real n[3])
+{
+    double l1 = std::fabs((double)n[0]) + std::fabs((double)n[1]) + std::fabs((double)n[2]);
+    if (l1 == 0) return 0;
+    double x = n[0] / l1, y = n[1] / l1;
+    if (n[2] < 0)
+    {
+        double ox = x;
+        x = (1 - std::fabs(y))  * signNotZero(ox);
+        y = (1 - std::fabs(ox)) * signNotZero(y);
+    }
+
+    // nearest rounding is not the nearest direction: try the four grid points around (x, y)
+    double fx = std::floor(std::max(-1.0, std::min(1.0, x)) * 32767);
+    double fy = std::floor(std::max(-1.0, std::min(1.0, y)) * 32767);
+    uint32_t best = 0;
+    double bestDot = -2;
+    for(int i=0; i<4; ++i)
+    {
+        double qx = std::min(32767.0, fx + (i & 1)), qy = std::min(32767.0, fy + (i >> 1));
+        uint32_t code = (uint32_t)(uint16_t)(int16_t)qx | ((uint32_t)(uint16_t)(int16_t)qy << 16);
+        double d[3];
+        decode(code, d);
+        double dot = d[0]*n[0] + d[1]*n[1] + d[2]*n[2];
+        if (dot > bestDot)
+        {
+            bestDot = dot;
+            best    = code;
+        }
+    }
+    return best;
+}
+
+}
+
+class CompactTrimesh
+{
+    public:
+
+        enum { BLOCK_SIZE = 32 }; // triangles per delta coded block
+
+        CompactTrimesh() : bits(21), deltaIndices(false), nVertices(0), nTriangles(0) {}
+
+        // bits: 21 or 16 per coordinate
+        template<typename real>
+        CompactTrimesh(const Trimesh<real> & mesh, int bits = 21, bool deltaIndices = true)
+        {
+            encode(mesh, bits, deltaIndices);
+        }
+
+        template<typename real>
+        void encode(const Trimesh<real> & mesh, int bits = 21, bool deltaIndices = true)
+        {
+            assert(bits == 21 || bits == 16);
+            this->bits         = bits;
+            this->deltaIndices = deltaIndices;
+            nVertices  = mesh.numVertices();
+            nTriangles = mesh.numTriangles();
+
+            BoundingBox box = mesh.getBoundingBox();
+            double lo[3] = { box.getMin().x(), box.getMin().y(), box.getMin().z() };
+            double hi[3] = { box.getMax().x(), box.getMax().y(), box.getMax().z() };
+            double cells = (double)((1 << bits) - 1);
+            for(int k=0; k<3; ++k)
+            {
+                origin[k] = nVertices > 0 ? lo[k] : 0;
+                double extent = nVertices > 0 ? hi[k] - lo[k] : 0;
+                step[k]   = extent > 0 ? extent / cells : 0;
+            }
+
+            const std::vector<real> & xyz = mesh.vectorCoords();
+            const std::vector<real> & vn  = mesh.vectorVertexNormals();
+            if (bits == 21) positions21.resize(nVertices);
+            else            positions16.resize(nVertices*3);
+            normals.resize(nVertices);
+            Parallel::forChunks(nVertices, [&](int begin, int end)
+            {
+                for(int vid=begin; vid<end; ++vid)
+                {
+                    uint32_t q[3];
+                    for(int k=0; k<3; ++k)
+                    {
+                        double t = step[k] > 0 ? (xyz[vid*3+k] - origin[k]) / step[k] : 0;
+                        q[k] = (uint32_t)std::min(cells, std::max(0.0, std::floor(t + 0.5)));
+                    }
+                    if (bits == 21) positions21[vid] = (uint64_t)q[0] | ((uint64_t)q[1] << 21) | ((uint64_t)q[2] << 42);
+                    else for(int k=0; k<3; ++k) positions16[vid*3+k] = (uint16_t)q[k];
+
+                    normals[vid] = Octahedral::encode(&vn[vid*3]);
+                }
+            });
+
+            const std::vector<int> & tris = mesh.vectorTriangles();
+            indices.clear();
+            blockOffsets.clear();
+            stream.clear();
+            if (!deltaIndices)
+            {
+                indices.assign(tris.begin(), tris.end());
+            }
+            else
+            {
+                // blocks are encoded in parallel, then concatenated
+                int nBlocks = (nTriangles + BLOCK_SIZE - 1) / BLOCK_SIZE;
+                std::vector< std::vector<uint8_t> > encoded(nBlocks);
+                Parallel::forEach(nBlocks, [&](int b)
+                {
+                    int prev = 0;
+                    int end  = std::min(nTriangles, (b+1) * BLOCK_SIZE) * 3;
+                    for(int i=b*BLOCK_SIZE*3; i<end; ++i)
+                    {
+                        putVarint(encoded[b], zigzag(tris[i] - prev));
+                        prev = tris[i];
+                    }
+                }, 64);
+                blockOffsets.resize(nBlocks + 1);
+                blockOffsets[0] = 0;
+                for(int b=0; b<nBlocks; ++b) blockOffsets[b+1] = blockOffsets[b] + (uint32_t)encoded[b].size();
+                stream.resize(blockOffsets[nBlocks]);
+                Parallel::forEach(nBlocks, [&](int b)
+                {
+                    std::copy(encoded[b].begin(), encoded[b].end(), stream.begin() + blockOffsets[b]);
+                }, 64);
+            }
+        }
+
+        inline int  numVertices()       const { return nVertices;    }
+        inline int  numTriangles()      const { return nTriangles;   }
+        inline int  positionBits()      const { return bits;         }
+        inline bool hasDeltaIndices()   const { return deltaIndices; }
+
+        // bytes of encoded data
+        size_t memoryBytes() const
+        {
+            return positions21.size() * sizeof(uint64_t) + positions16.size() * sizeof(uint16_t) +
+                   normals.size() * sizeof(uint32_t) + indices.size() * sizeof(int) +
+                   blockOffsets.size() * sizeof(uint32_t) + stream.size();
+        }
+
+        // worst case position error along axis k (see the class comment)
+        inline double positionErrorBound(int k) const { return 0.5 * step[k]; }
+
+        inline void quantizedVertex(int vid, uint32_t q[3]) const
+        {
+            assert(vid >= 0 && vid < nVertices);
+            if (bits == 21)
+            {
+                uint64_t p = positions21[vid];
+                q[0] = (uint32_t)(p & 0x1fffff);
+                q[1] = (uint32_t)((p >> 21) & 0x1fffff);
+                q[2] = (uint32_t)(p >> 42);
+            }
+            else
+            {
+                q[0] = positions16[vid*3+0];
+                q[1] = positions16[vid*3+1];
+                q[2] = positions16[vid*3+2];
+            }
+        }
+
+        inline Pointd vertex(int vid) const
+        {
+            uint32_t q[3];
+            quantizedVertex(vid, q);
+            return Pointd(origin[0] + q[0] * step[0], origin[1] + q[1] * step[1], origin[2] + q[2] * step[2]);
+        }
+
+        inline Pointd vertexNormal(int vid) const
+        {
+            assert(vid >= 0 && vid < nVertices);
+            double n[3];
+            Octahedral::decode(normals[vid], n);
+            return Pointd(n[0], n[1], n[2]);
+        }
+
+        // the three vertices of tid
+        inline void triangle(int tid, int vids[3]) const
+        {
+            assert(tid >= 0 && tid < nTriangles);
+            if (!deltaIndices)
+            {
+                for(int i=0; i<3; ++i) vids[i] = indices[tid*3+i];
+                return;
+            }
+            int block[BLOCK_SIZE*3];
+            decodeBlock(tid / BLOCK_SIZE, block, (tid % BLOCK_SIZE + 1) * 3);
+            for(int i=0; i<3; ++i) vids[i] = block[(tid % BLOCK_SIZE)*3 + i];
+        }
+
+        // coordinates of the vertices in [begin, end), xyz xyz ...
+        template<typename real>
+        void decodeVertices(int begin, int end, real * xyz) const
+        {
+            for(int vid=begin; vid<end; ++vid)
+            {
+                uint32_t q[3];
+                quantizedVertex(vid, q);
+                for(int k=0; k<3; ++k) xyz[(vid-begin)*3+k] = (real)(origin[k] + q[k] * step[k]);
+            }
+        }
+
+        // back to a full precision mesh (coordinates within the error bound, same triangles)
+        template<typename real>
+        void decode(std::vector<real> & xyz, std::vector<int> & tris) const
+        {
+            xyz.resize(nVertices*3);
+            tris.resize(nTriangles*3);
+            Parallel::forChunks(nVertices, [&](int begin, int end) { decodeVertices(begin, end, &xyz[begin*3]); });
+            forEachBlock([&](int first, int count, const int * block)
+            {
+                std::copy(block, block + count*3, &tris[first*3]);
+            });
+        }
+
+        // unit normals (zero for degenerate triangles) of all the triangles, from the encoded data
+        void triangleNormals(std::vector<float> & out) const
+        {
+            out.resize(nTriangles*3);
+            float s[3] = { (float)step[0], (float)step[1], (float)step[2] };
+            forEachBlock([&](int first, int count, const int * block)
+            {
+                int i = 0;
+                #ifdef __SSE2__
+                for(; i+4<=count; i+=4) normals4(block + i*3, s, &out[(first+i)*3]);
+                #endif
+                for(; i<count; ++i) normal1(block + i*3, s, &out[(first+i)*3]);
+            });
+        }
+
+    private:
+
+        int      bits;
+        bool     deltaIndices;
+        int      nVertices;
+        int      nTriangles;
+        double   origin[3];
+        double   step[3];   // grid spacing, 0 on a flat axis
+
+        std::vector<uint64_t> positions21;  // x | y << 21 | z << 42
+        std::vector<uint16_t> positions16;  // x y z
+        std::vector<uint32_t> normals;      // octahedral, x | y << 16
+        std::vector<int>      indices;      // !deltaIndices
+        std::vector<uint32_t> blockOffsets; // deltaIndices: the varints of block b start at stream[blockOffsets[b]]
+        std::vector<uint8_t>  stream;
+
+        static inline uint32_t zigzag(int v)        { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+        static inline int      unzigzag(uint32_t v) { return (int)(v >> 1) ^ -(int)(v & 1); }
+
+        static inline void putVarint(std::vector<uint8_t> & out, uint32_t v)
+        {
+            while (v >= 0x80)
+            {
+                out.push_back((uint8_t)(v | 0x80));
+                v >>= 7;
+            }
+            out.push_back((uint8_t)v);
+        }
+
+        // the first n indices of block b
+        inline void decodeBlock(int b, int * out, int n) const
+        {
+            const uint8_t * p = &stream[blockOffsets[b]];
+            int prev = 0;
+            for(int i=0; i<n; ++i)
+            {
+                uint32_t v = 0;
+                int shift = 0;
+                for(;;)
+                {
+                    uint8_t byte = *p++;
+                    v |= (uint32_t)(byte & 0x7f) << shift;
+                    if (byte < 0x80) break;
+                    shift += 7;
+                }
+                prev += unzigzag(v);
+                out[i] = prev;
+            }
+        }
+
+        // f(first triangle, number of triangles, their indices) on blocks of triangles, in parallel
+        template<typename F>
+        void forEachBlock(F f) const
+        {
+            int nBlocks = (nTriangles + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            Parallel::forEach(nBlocks, [&](int b)
+            {
+                int first = b * BLOCK_SIZE;
+                int count = std::min((int)BLOCK_SIZE, nTriangles - first);
+                if (!deltaIndices)
+                {
+                    f(first, count, &indices[first*3]);
+                    return;
+                }
+                int block[BLOCK_SIZE*3];
+                decodeBlock(b, block, count*3);
+                f(first, count, (const int *)block);
+            }, 64);
+        }
+
+        inline void normal1(const int * tri, const float s[3], float * n) const
+        {
+            uint32_t q0[3], q1[3], q2[3];
+            quantizedVertex(tri[0], q0);
+            quantizedVertex(tri[1], q1);
+            quantizedVertex(tri[2], q2);
+            float u[3], v[3];
+            for(int k=0; k<3; ++k)
+            {
+                u[k] = (float)((int)q1[k] - (int)q0[k]) * s[k];
+                v[k] = (float)((int)q2[k] - (int)q0[k]) * s[k];
+            }
+            float x = u[1]*v[2] - u[2]*v[1];
+            float y = u[2]*v[0] - u[0]*v[2];
+            float z = u[0]*v[1] - u[1]*v[0];
+            float len = std::sqrt(x*x + y*y + z*z);
+            float inv = len > 0 ? 1 / len : 0;
+            n[0] = x * inv;
+            n[1] = y * inv;
+            n[2] = z * inv;
+        }
+
+        #ifdef __SSE2__
+        // four triangles: integer corners gathered per lane, differences in integers, math 4-wide
+        inline void normals4(const int * tris, const float s[3], float * out) const
+        {
+            uint32_t q[4][3][3];
+            for(int t=0; t<4; ++t) for(int j=0; j<3; ++j) quantizedVertex(tris[t*3+j], q[t][j]);
+
+            __m128 e[2][3];
+            for(int j=1; j<3; ++j) for(int k=0; k<3; ++k)
+            {
+                __m128i a = _mm_setr_epi32((int)q[0][0][k], (int)q[1][0][k], (int)q[2][0][k], (int)q[3][0][k]);
+                __m128i b = _mm_setr_epi32((int)q[0][j][k], (int)q[1][j][k], (int)q[2][j][k], (int)q[3][j][k]);
+                e[j-1][k] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(b, a)), _mm_set1_ps(s[k]));
+            }
+            __m128 x = _mm_sub_ps(_mm_mul_ps(e[0][1], e[1][2]), _mm_mul_ps(e[0][2], e[1][1]));
+            __m128 y = _mm_sub_ps(_mm_mul_ps(e[0][2], e[1][0]), _mm_mul_ps(e[0][0], e[1][2]));
+            __m128 z = _mm_sub_ps(_mm_mul_ps(e[0][0], e[1][1]), _mm_mul_ps(e[0][1], e[1][0]));
+            __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+            __m128 inv = _mm_and_ps(_mm_cmpgt_ps(len, _mm_setzero_ps()), _mm_div_ps(_mm_set1_ps(1.0f), len));
+            __m128 r0, r1, r2;
+            GeometryKernels<float>::toAoS(_mm_mul_ps(x, inv), _mm_mul_ps(y, inv), _mm_mul_ps(z, inv), r0, r1, r2);
+            _mm_storeu_ps(out,     r0);
+            _mm_storeu_ps(out + 4, r1);
+            _mm_storeu_ps(out + 8, r2);
+        }
+        #endif
+};
+
+#endif // COMPACT_TRIMESH_H
@@ -0,0 +1,108 @@
+#ifndef CSR_ADJACENCY_H
+#define CSR_ADJACENCY_H
+
+#include <assert.h>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Read-only view over a contiguous range of indices.
+ *
+ * It does not own the memory: it is valid as long as the adjacency it comes from
+ * is neither rebuilt nor destroyed. The conversion to std::vector<int> keeps old
+ * code that stored a copy of the neighborhood working.
+ */
+class IndexSpan
+{
+    public:
+
+        IndexSpan() : first(nullptr), last(nullptr) {}
+
+        IndexSpan(const int * first, const int * last) : first(first), last(last) {}
+
+        inline const int * begin() const { return first;                }
+        inline const int * end()   const { return last;                 }
+        inline int         size()  const { return (int)(last - first);  }
+        inline bool        empty() const { return first == last;        }
+
+        inline int operator[](int i) const
+        {
+            assert(i >= 0 && i < size());
+            return first[i];
+        }
+
+        inline operator std::vector<int>() const { return std::vector<int>(first, last); }
+
+    private:
+
+        const int * first;
+        const int * last;
+};
+
+/**
+ * @brief Compressed sparse row storage for a one-to-many relation (e.g. vertex -> triangles).
+ *
+ * The neighbors of element i are indices[offsets[i]] ... indices[offsets[i+1]-1]:
+ * two flat arrays instead of one heap block per element.
+ */
+class CSRAdjacency
+{
+    public:
+
+        CSRAdjacency() {}
+
+        inline int       size()                const { return offsets.empty() ? 0 : (int)offsets.size() - 1; }
+        inline int       numIndices()          const { return (int)indices.size(); }
+        inline IndexSpan operator[](int i)     const
+        {
+            assert(i >= 0 && i < size());
+            return IndexSpan(indices.data() + offsets[i], indices.data() + offsets[i+1]);
+        }
+
+        inline const std::vector<int> & vectorOffsets() const { return offsets; }
+        inline const std::vector<int> & vectorIndices() const { return indices; }
+
+        void clear()
+        {
+            offsets.clear();
+            indices.clear();
+        }
+
+        // takes the two arrays as they are (e.g. read from a file), the old ones are left in their place
+        void swap(std::vector<int> & newOffsets, std::vector<int> & newIndices)
+        {
+            assert(newOffsets.empty() || newOffsets.back() == (int)newIndices.size());
+            offsets.swap(newOffsets);
+            indices.swap(newIndices);
+        }
+
+        // pairs are (element, neighbor): the neighbors of each element
+        // keep the order in which they appear in pairs
+        void build(int numElements, const std::vector< std::pair<int,int> > & pairs)
+        {
+            offsets.assign(numElements + 1, 0);
+            for(int i=0; i<(int)pairs.size(); ++i)
+            {
+                assert(pairs[i].first >= 0 && pairs[i].first < numElements);
+                ++offsets[pairs[i].first + 1];
+            }
+            for(int i=0; i<numElements; ++i)
+            {
+                offsets[i+1] += offsets[i];
+            }
+
+            std::vector<int> next(offsets.begin(), offsets.end() - 1);
+            indices.resize(pairs.size());
+            for(int i=0; i<(int)pairs.size(); ++i)
+            {
+                indices[next[pairs[i].first]++] = pairs[i].second;
+            }
+        }
+
+    private:
+
+        std::vector<int> offsets;   // numElements + 1 entries
+        std::vector<int> indices;
+};
+
+#endif // CSR_ADJACENCY_H
@@ -0,0 +1,172 @@
+#ifndef FAST_PARSE_H
+#define FAST_PARSE_H
+
+#include <float.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <cmath>
+#include <locale.h>
+#include <locale>
+#include <sstream>
+#include <string>
+
+/**
+ * @brief Number parsing on [p, end) ranges of a text buffer (not null terminated).
+ *
+ * Decimal numbers with at most 19 significant digits, mantissa and power of ten both exactly
+ * representable (Clinger's fast path) are converted with one multiplication or division,
+ * which is correctly rounded. Anything else (long mantissas, large exponents) goes through
+ * strtod in the "C" locale. Floats are rounded from the double (see parseReal(float)).
+ */
+
+namespace FastParse {
+
+inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+inline const char * skipSpaces(const char * p, const char * end)
+{
+    while (p < end && isSpace(*p)) ++p;
+    return p;
+}
+
+// to the first space or end of line
+inline const char * skipToken(const char * p, const char * end)
+{
+    while (p < end && !isSpace(*p) && *p != '\n') ++p;
+    return p;
+}
+
+// [+-]digits, nullptr if there are none
+inline const char * parseInt(const char * p, const char * end, int & value)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+    const char * first = p;
+    long long v = 0;
+    while (p < end && *p >= '0' && *p <= '9' && v < (1ll << 40)) v = v * 10 + (*p++ - '0');
+    if (p == first) return nullptr;
+    value = (int)(negative ? -v : v);
+    return p;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+#define FAST_PARSE_STRTOD_L
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+inline locale_t cLocale()
+{
+    static locale_t c = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+    return c;
+}
+
+inline double strtoReal(const char * s, char ** e, double) { return strtod_l(s, e, cLocale()); }
+inline float  strtoReal(const char * s, char ** e, float)  { return strtof_l(s, e, cLocale()); }
+#endif
+
+// the token at p (up to a space, '/' or end of line) through the C library, in the "C"
+// locale: plain strtod would follow the locale of the application (e.g. ',' as decimal point)
+template<typename real>
+const char * parseSlow(const char * p, const char * end, real & value)
+{
+    const char * last = p;
+    while (last < end && !isSpace(*last) && *last != '\n' && *last != '/') ++last;
+    std::string token(p, last);
+
+    #ifdef FAST_PARSE_STRTOD_L
+    char * e;
+    value = strtoReal(token.c_str(), &e, real());
+    if (e == token.c_str()) return nullptr;
+    return p + (e - token.c_str());
+    #else
+    std::istringstream iss(token);
+    iss.imbue(std::locale::classic());
+    if (!(iss >> value)) return nullptr;
+    return iss.eof() ? last : p + (std::streamoff)iss.tellg();
+    #endif
+}
+
+// mantissa * 10^exponent, correctly rounded, for a mantissa below 2^53 and |exponent| <= 22
+inline double clinger(uint64_t mantissa, int exponent)
+{
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    double v = (double)mantissa;
+    return exponent < 0 ? v / powers[-exponent] : v * powers[exponent];
+}
+
+// the number at p into a double
+inline const char * parseDouble(const char * p, const char * end, double & value)
+{
+    const char * start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    const char * first = p;
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        if (mantissa == 0 && *p == '0') { ++p; continue; } // leading zeros are not significant
+        if (digits < 19) mantissa = mantissa * 10 + (*p - '0'), ++digits;
+        else ++exponent;
+        ++p;
+    }
+    bool any = p > first;
+    if (p < end && *p == '.')
+    {
+        ++p;
+        const char * fraction = p;
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            if (mantissa == 0 && *p == '0') { --exponent; ++p; continue; }
+            if (digits < 19) mantissa = mantissa * 10 + (*p - '0'), ++digits, --exponent;
+            ++p;
+        }
+        any = any || p > fraction;
+    }
+    if (!any) return parseSlow(start, end, value); // inf, nan, or not a number
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        int e;
+        const char * q = parseInt(p + 1, end, e);
+        if (!q) return parseSlow(start, end, value);
+        exponent += e;
+        p = q;
+    }
+
+    if (digits >= 19 || mantissa > (1ull << 53) || exponent < -22 || exponent > 22)
+    {
+        return parseSlow(start, end, value);
+    }
+    double v = clinger(mantissa, exponent);
+    value = negative ? -v : v;
+    return p;
+}
+
+inline const char * parseReal(const char * p, const char * end, double & value)
+{
+    return parseDouble(p, end, value);
+}
+
+// through the correctly rounded double: rounding it again to float gives the correctly
+// rounded float unless it falls exactly halfway between two floats, then strtof decides
+inline const char * parseReal(const char * p, const char * end, float & value)
+{
+    double d;
+    const char * q = parseDouble(p, end, d);
+    if (!q) return nullptr;
+    float f = (float)d;
+    if ((double)f != d && std::isfinite(f))
+    {
+        float other = (d > f) ? std::nextafter(f, FLT_MAX) : std::nextafter(f, -FLT_MAX);
+        if (((double)f + (double)other) / 2 == d) return parseSlow(p, end, value);
+    }
+    value = f;
+    return q;
+}
+
+}
+
+#endif // FAST_PARSE_H
@@ -0,0 +1,182 @@
+#ifndef GEOMETRY_KERNELS_H
+#define GEOMETRY_KERNELS_H
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief Per-vertex and per-triangle loops of Trimesh on interleaved (xyz xyz ...) storage.
+ *
+ * GeometryKernels<real> is the scalar code of ScalarGeometryKernels; GeometryKernels<float>
+ * is specialized with SSE: four vertices (12 floats, three registers) are transposed to x/y/z registers,
+ * processed, and transposed back. The version is picked at compile time from the
+ * scalar type of the mesh.
+ */
+
+template<typename real>
+struct ScalarGeometryKernels
+{
+    // min/max of the vertices in [0, n)
+    static void bbox(const real * xyz, int n, real min[3], real max[3])
+    {
+        for(int k=0; k<3; ++k)
+        {
+            min[k] =  std::numeric_limits<real>::max();
+            max[k] = -std::numeric_limits<real>::max();
+        }
+        for(int i=0; i<n; ++i)
+        {
+            for(int k=0; k<3; ++k)
+            {
+                min[k] = std::min(min[k], xyz[3*i+k]);
+                max[k] = std::max(max[k], xyz[3*i+k]);
+            }
+        }
+    }
+
+    // v = m * v + t for the vertices in [0, n), m is row major
+    static void transform(real * xyz, int n, const real m[9], const real t[3])
+    {
+        for(int i=0; i<n; ++i)
+        {
+            real x = xyz[3*i+0], y = xyz[3*i+1], z = xyz[3*i+2];
+            xyz[3*i+0] = m[0]*x + m[1]*y + m[2]*z + t[0];
+            xyz[3*i+1] = m[3]*x + m[4]*y + m[5]*z + t[1];
+            xyz[3*i+2] = m[6]*x + m[7]*y + m[8]*z + t[2];
+        }
+    }
+
+    // unit normals of the triangles in [begin, end), zero for degenerate ones
+    static void triangleNormals(const real * xyz, const int * tris, int begin, int end, real * normals)
+    {
+        for(int tid=begin; tid<end; ++tid)
+        {
+            const real * v0 = &xyz[tris[tid*3+0]*3];
+            const real * v1 = &xyz[tris[tid*3+1]*3];
+            const real * v2 = &xyz[tris[tid*3+2]*3];
+            real ux = v1[0] - v0[0], uy = v1[1] - v0[1], uz = v1[2] - v0[2];
+            real vx = v2[0] - v0[0], vy = v2[1] - v0[1], vz = v2[2] - v0[2];
+            real x = uy*vz - uz*vy;
+            real y = uz*vx - ux*vz;
+            real z = ux*vy - uy*vx;
+            real len = std::sqrt(x*x + y*y + z*z);
+            real inv = len > 0 ? 1 / len : 0;
+            normals[tid*3+0] = x * inv;
+            normals[tid*3+1] = y * inv;
+            normals[tid*3+2] = z * inv;
+        }
+    }
+};
+
+template<typename real>
+struct GeometryKernels : public ScalarGeometryKernels<real> {};
+
+#ifdef __SSE2__
+
+template<>
+struct GeometryKernels<float>
+{
+    // r0 = x0 y0 z0 x1, r1 = y1 z1 x2 y2, r2 = z2 x3 y3 z3  ->  x = x0..x3, y = y0..y3, z = z0..z3
+    static inline void toSoA(__m128 r0, __m128 r1, __m128 r2, __m128 & x, __m128 & y, __m128 & z)
+    {
+        x = _mm_shuffle_ps(_mm_shuffle_ps(r0, r0, _MM_SHUFFLE(0,3,0,0)), _mm_shuffle_ps(r1, r2, _MM_SHUFFLE(0,1,0,2)), _MM_SHUFFLE(2,0,2,0));
+        y = _mm_shuffle_ps(_mm_shuffle_ps(r0, r1, _MM_SHUFFLE(0,0,0,1)), _mm_shuffle_ps(r1, r2, _MM_SHUFFLE(0,2,0,3)), _MM_SHUFFLE(2,0,2,0));
+        z = _mm_shuffle_ps(_mm_shuffle_ps(r0, r1, _MM_SHUFFLE(0,1,0,2)), _mm_shuffle_ps(r2, r2, _MM_SHUFFLE(0,3,0,0)), _MM_SHUFFLE(2,0,2,0));
+    }
+
+    static inline void toAoS(__m128 x, __m128 y, __m128 z, __m128 & r0, __m128 & r1, __m128 & r2)
+    {
+        r0 = _mm_shuffle_ps(_mm_shuffle_ps(x, y, _MM_SHUFFLE(0,0,0,0)), _mm_shuffle_ps(z, x, _MM_SHUFFLE(0,1,0,0)), _MM_SHUFFLE(2,0,2,0));
+        r1 = _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(0,1,0,1)), _mm_shuffle_ps(x, y, _MM_SHUFFLE(0,2,0,2)), _MM_SHUFFLE(2,0,2,0));
+        r2 = _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(0,3,0,2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(0,3,0,3)), _MM_SHUFFLE(2,0,2,0));
+    }
+
+    static void bbox(const float * xyz, int n, float min[3], float max[3])
+    {
+        // the lanes of r0, r1, r2 always hold the same coordinates: xyzx, yzxy, zxyz
+        __m128 lo0 = _mm_set1_ps(FLT_MAX), lo1 = lo0, lo2 = lo0;
+        __m128 hi0 = _mm_set1_ps(-FLT_MAX), hi1 = hi0, hi2 = hi0;
+        int i = 0;
+        for(; i+4<=n; i+=4)
+        {
+            __m128 r0 = _mm_loadu_ps(xyz + 3*i);
+            __m128 r1 = _mm_loadu_ps(xyz + 3*i + 4);
+            __m128 r2 = _mm_loadu_ps(xyz + 3*i + 8);
+            lo0 = _mm_min_ps(lo0, r0); hi0 = _mm_max_ps(hi0, r0);
+            lo1 = _mm_min_ps(lo1, r1); hi1 = _mm_max_ps(hi1, r1);
+            lo2 = _mm_min_ps(lo2, r2); hi2 = _mm_max_ps(hi2, r2);
+        }
+        float lo[12], hi[12];
+        _mm_storeu_ps(lo, lo0); _mm_storeu_ps(lo + 4, lo1); _mm_storeu_ps(lo + 8, lo2);
+        _mm_storeu_ps(hi, hi0); _mm_storeu_ps(hi + 4, hi1); _mm_storeu_ps(hi + 8, hi2);
+        ScalarGeometryKernels<float>::bbox(xyz + 3*i, n - i, min, max);
+        for(int j=0; j<12; ++j)
+        {
+            min[j%3] = std::min(min[j%3], lo[j]);
+            max[j%3] = std::max(max[j%3], hi[j]);
+        }
+    }
+
+    static void transform(float * xyz, int n, const float m[9], const float t[3])
+    {
+        int i = 0;
+        for(; i+4<=n; i+=4)
+        {
+            __m128 x, y, z, r0, r1, r2;
+            toSoA(_mm_loadu_ps(xyz + 3*i), _mm_loadu_ps(xyz + 3*i + 4), _mm_loadu_ps(xyz + 3*i + 8), x, y, z);
+            __m128 nx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0]), x), _mm_mul_ps(_mm_set1_ps(m[1]), y)),
+                                   _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[2]), z), _mm_set1_ps(t[0])));
+            __m128 ny = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[3]), x), _mm_mul_ps(_mm_set1_ps(m[4]), y)),
+                                   _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[5]), z), _mm_set1_ps(t[1])));
+            __m128 nz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[6]), x), _mm_mul_ps(_mm_set1_ps(m[7]), y)),
+                                   _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[8]), z), _mm_set1_ps(t[2])));
+            toAoS(nx, ny, nz, r0, r1, r2);
+            _mm_storeu_ps(xyz + 3*i, r0);
+            _mm_storeu_ps(xyz + 3*i + 4, r1);
+            _mm_storeu_ps(xyz + 3*i + 8, r2);
+        }
+        ScalarGeometryKernels<float>::transform(xyz + 3*i, n - i, m, t);
+    }
+
+    static void triangleNormals(const float * xyz, const int * tris, int begin, int end, float * normals)
+    {
+        int tid = begin;
+        for(; tid+4<=end; tid+=4)
+        {
+            // the corners are gathered one at a time (random access), the math is 4-wide
+            __m128 c[3][3];
+            for(int j=0; j<3; ++j)
+            {
+                const float * a = &xyz[tris[(tid+0)*3+j]*3];
+                const float * b = &xyz[tris[(tid+1)*3+j]*3];
+                const float * d = &xyz[tris[(tid+2)*3+j]*3];
+                const float * e = &xyz[tris[(tid+3)*3+j]*3];
+                for(int k=0; k<3; ++k) c[j][k] = _mm_setr_ps(a[k], b[k], d[k], e[k]);
+            }
+            __m128 ux = _mm_sub_ps(c[1][0], c[0][0]), uy = _mm_sub_ps(c[1][1], c[0][1]), uz = _mm_sub_ps(c[1][2], c[0][2]);
+            __m128 vx = _mm_sub_ps(c[2][0], c[0][0]), vy = _mm_sub_ps(c[2][1], c[0][1]), vz = _mm_sub_ps(c[2][2], c[0][2]);
+            __m128 x = _mm_sub_ps(_mm_mul_ps(uy, vz), _mm_mul_ps(uz, vy));
+            __m128 y = _mm_sub_ps(_mm_mul_ps(uz, vx), _mm_mul_ps(ux, vz));
+            __m128 z = _mm_sub_ps(_mm_mul_ps(ux, vy), _mm_mul_ps(uy, vx));
+            __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+            __m128 positive = _mm_cmpgt_ps(len, _mm_setzero_ps());
+            __m128 inv = _mm_and_ps(positive, _mm_div_ps(_mm_set1_ps(1.0f), len));
+            __m128 r0, r1, r2;
+            toAoS(_mm_mul_ps(x, inv), _mm_mul_ps(y, inv), _mm_mul_ps(z, inv), r0, r1, r2);
+            _mm_storeu_ps(normals + 3*tid, r0);
+            _mm_storeu_ps(normals + 3*tid + 4, r1);
+            _mm_storeu_ps(normals + 3*tid + 8, r2);
+        }
+        ScalarGeometryKernels<float>::triangleNormals(xyz, tris, tid, end, normals);
+    }
+};
+
+#endif
+
+#endif // GEOMETRY_KERNELS_H
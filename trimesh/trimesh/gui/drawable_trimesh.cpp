@@ -29,33 +29,48 @@ void DrawableTrimesh::clear() {
     triangleColors.clear();
 }
 
+trimeshRemap DrawableTrimesh::reorder() {
+    trimeshRemap remap = Trimesh<double>::reorder();
+    std::vector<float> vColors(vertexColors.size()), tColors(triangleColors.size());
+    forEachVertex([&](int vid) {
+        for(int k=0; k<3; ++k) vColors[vid*3 + k] = vertexColors[remap.vertexNewToOld[vid]*3 + k];
+    });
+    forEachTriangle([&](int tid) {
+        for(int k=0; k<3; ++k) tColors[tid*3 + k] = triangleColors[remap.triangleNewToOld[tid]*3 + k];
+    });
+    vertexColors.swap(vColors);
+    triangleColors.swap(tColors);
+    return remap;
+}
+
 void DrawableTrimesh::draw() const {
+    require(TRIANGLE_NORMALS | VERTEX_NORMALS);
     DrawableMesh::draw(coords.size()/3, tris.size()/3, coords.data(), tris.data(), vertexNormals.data(), vertexColors.data(), triangleNormals.data(), triangleColors.data());
 }
 
 Pointd DrawableTrimesh::sceneCenter() const {
-    Pointd c = bbox.center();
+    Pointd c = getBoundingBox().center();
     return Pointd(c.x(), c.y(), c.z());
 }
 
 double DrawableTrimesh::sceneRadius() const {
-    return bbox.diag();
+    return getBoundingBox().diag();
 }
 
 void DrawableTrimesh::setVertexColor(float r, float g, float b) {
     vertexColors.resize(numVertices()*3);
-    for(int i=0; i<(int)vertexColors.size(); i+=3) {
-        vertexColors[i + 0] = r;
-        vertexColors[i + 1] = g;
-        vertexColors[i + 2] = b;
-    }
+    forEachVertex([&](int vid) {
+        vertexColors[vid*3 + 0] = r;
+        vertexColors[vid*3 + 1] = g;
+        vertexColors[vid*3 + 2] = b;
+    });
 }
 
 void DrawableTrimesh::setTriangleColor(float r, float g, float b) {
     triangleColors.resize(numTriangles()*3);
-    for(int i=0; i<(int)triangleColors.size(); i+=3) {
-        triangleColors[i + 0] = r;
-        triangleColors[i + 1] = g;
-        triangleColors[i + 2] = b;
-    }
+    forEachTriangle([&](int tid) {
+        triangleColors[tid*3 + 0] = r;
+        triangleColors[tid*3 + 1] = g;
+        triangleColors[tid*3 + 2] = b;
+    });
 }
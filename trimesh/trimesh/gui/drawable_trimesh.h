@@ -23,6 +23,9 @@ class DrawableTrimesh : public Trimesh<double> ,
         void init();
         void clear();
 
+        // Trimesh::reorder, colors included
+        trimeshRemap reorder();
+
         // Implementation of the
         // DrawableObject interface
         //
@@ -37,6 +40,7 @@ class DrawableTrimesh : public Trimesh<double> ,
 
         inline const float * vertexColor  (int vid) const { return &(vertexColors[vid*3]); }
         inline const float * triangleColor(int tid) const { return &(triangleColors[tid*3]); }
+        inline const std::vector<float> & vectorTriangleColors() const { return triangleColors; }
 
         inline void setVertexColor(int vid, float * color) {
             int vid_ptr = vid * 3;
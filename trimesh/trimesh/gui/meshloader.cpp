@@ -0,0 +1,66 @@
+#include "meshloader.h"
+
+#include "../load_save_trimesh.h"
+
+MeshLoader::MeshLoader(QObject *parent) :
+    QObject(parent) {
+    timer.setInterval(50);
+    connect(&timer, SIGNAL(timeout()), this, SLOT(pollProgress()));
+}
+
+MeshLoader::~MeshLoader() {
+    cancel();
+    wait();
+}
+
+bool MeshLoader::start(const QString &filename, std::function<bool()> load, int previewPoints) {
+    if (isRunning()) return false;
+    loadProgress.reset(new LoadProgress());
+    previewCoords.clear();
+    worker = std::thread(&MeshLoader::run, this, std::string(filename.toUtf8().constData()), load, previewPoints);
+    emit progress(0);
+    timer.start();
+    return true;
+}
+
+void MeshLoader::cancel() {
+    if (loadProgress) loadProgress->cancel();
+}
+
+void MeshLoader::wait() {
+    if (worker.joinable()) worker.join();
+    timer.stop();
+}
+
+bool MeshLoader::isRunning() const {
+    return worker.joinable();
+}
+
+void MeshLoader::pollProgress() {
+    if (loadProgress) emit progress((int)(loadProgress->fraction() * 100));
+}
+
+void MeshLoader::workerDone(bool ok) {
+    if (!worker.joinable()) return; // wait() came first
+    wait();
+    if (loadProgress->isCanceled())
+        emit canceled();
+    else if (!ok)
+        emit failed();
+    else {
+        emit progress(100);
+        emit loaded();
+    }
+}
+
+void MeshLoader::run(std::string filename, std::function<bool()> load, int previewPoints) {
+    // previewCoords is not touched by the GUI until previewReady() is delivered
+    if (!loadProgress->isCanceled() && loadPreview(filename.c_str(), previewCoords, previewPoints))
+        emit previewReady();
+    bool ok = false;
+    if (!loadProgress->isCanceled()) {
+        LoadProgress::Scope scope(*loadProgress);
+        ok = load();
+    }
+    QMetaObject::invokeMethod(this, "workerDone", Qt::QueuedConnection, Q_ARG(bool, ok));
+}
@@ -0,0 +1,69 @@
+#ifndef MESHLOADER_H
+#define MESHLOADER_H
+
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../load_progress.h"
+
+/**
+ * @brief Loads a mesh on a worker thread, so that the GUI stays responsive.
+ *
+ * The worker first reads a preview of the file (loadPreview, a few MB whatever its size)
+ * and emits previewReady(): the caller shows it as a point cloud. Then it runs the load
+ * function given to start(), with a LoadProgress installed: the loaders of the trimesh
+ * module report to it and stop when cancel() is called. The load function fills a mesh
+ * the GUI does not draw yet (adjacency and normals included), the caller swaps it in on
+ * loaded(). Exactly one of loaded(), canceled() and failed() ends every start().
+ *
+ * progress() is polled on the GUI thread, every signal is delivered there.
+ */
+class MeshLoader : public QObject
+{
+        Q_OBJECT
+
+    public:
+        explicit MeshLoader(QObject *parent = 0);
+        ~MeshLoader();
+
+        // false if a load is already running. load runs on the worker, false if it failed
+        bool start(const QString &filename, std::function<bool()> load, int previewPoints = 65536);
+
+        // the load stops at the next chunk of the file; canceled() follows
+        void cancel();
+
+        // waits for the worker: the queued signals of the load are not emitted any more
+        void wait();
+
+        bool isRunning() const;
+
+        // the preview of the last load, valid from previewReady() to the next start()
+        inline const std::vector<double> & preview() const { return previewCoords; }
+
+    signals:
+        void previewReady();
+        void progress(int percent);
+        void loaded();
+        void canceled();
+        void failed();
+
+    private slots:
+        void pollProgress();
+        void workerDone(bool ok);
+
+    private:
+        void run(std::string filename, std::function<bool()> load, int previewPoints);
+
+        std::thread                   worker;
+        std::unique_ptr<LoadProgress> loadProgress; // one per load: it cannot be reset
+        std::vector<double>           previewCoords;
+        QTimer                        timer;
+};
+
+#endif // MESHLOADER_H
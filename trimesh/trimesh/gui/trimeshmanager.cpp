@@ -2,18 +2,32 @@
 #include "ui_trimeshmanager.h"
 
 #include "../load_save_trimesh.h"
+#include "../mesh_archive.h"
 #include <QFileDialog>
 #include <QColorDialog>
+#include <QMessageBox>
 
 TrimeshManager::TrimeshManager(QWidget *parent) :
     QFrame(parent),
     ui(new Ui::TrimeshManager),
     mainWindow((MainWindow*)parent),
-    trimesh(nullptr) {
+    trimesh(nullptr),
+    loadingTrimesh(nullptr),
+    previewTrimesh(nullptr) {
     ui->setupUi(this);
+    setLoading(false);
+    connect(&meshLoader, SIGNAL(progress(int)), ui->loadProgress, SLOT(setValue(int)));
+    connect(&meshLoader, SIGNAL(previewReady()), this, SLOT(meshPreviewReady()));
+    connect(&meshLoader, SIGNAL(loaded()), this, SLOT(meshLoaded()));
+    connect(&meshLoader, SIGNAL(canceled()), this, SLOT(meshLoadStopped()));
+    connect(&meshLoader, SIGNAL(failed()), this, SLOT(meshLoadFailed()));
 }
 
 TrimeshManager::~TrimeshManager() {
+    meshLoader.cancel();
+    meshLoader.wait();
+    delete loadingTrimesh;
+    removePreview();
     delete ui;
     if (trimesh != nullptr){
         mainWindow->deleteObj(trimesh);
@@ -42,18 +56,26 @@ void TrimeshManager::on_butLoadTrimesh_clicked() {
     QString filename = QFileDialog::getOpenFileName(mainWindow,
                        "Open Trimesh",
                        ".",
-                       "OBJ(*.obj)");
+                       "Mesh(*.obj *.off *.ply *.stl *.tmb *.tmz);;OBJ(*.obj);;OFF(*.off);;PLY(*.ply);;STL(*.stl);;Trimesh binary(*.tmb);;Trimesh archive(*.tmz)");
 
     if(filename != NULL){
 
         std::cout << "load: " << filename.toStdString() << std::endl;
 
         if (!filename.isEmpty()) {
-            trimesh = new DrawableTrimesh(filename.toStdString().c_str());
-
-            mainWindow->pushObj(trimesh, "Triemsh");
-            setButtonsTrimeshLoaded(true);
-            mainWindow->updateGlCanvas();
+            // parsing, adjacency and normals run on the worker: the mesh is drawn when all are ready
+            DrawableTrimesh* mesh = new DrawableTrimesh();
+            std::string path = filename.toStdString();
+            if (meshLoader.start(filename, [mesh, path]() {
+                    if (!mesh->load(path.c_str())) return false;
+                    mesh->prefetch(Trimesh<double>::ADJACENCY | Trimesh<double>::TRIANGLE_NORMALS |
+                                   Trimesh<double>::VERTEX_NORMALS | Trimesh<double>::BBOX);
+                    return true;
+                })) {
+                loadingTrimesh = mesh;
+                setLoading(true);
+            }
+            else delete mesh;
         }
 
     }
@@ -63,12 +85,17 @@ void TrimeshManager::on_butSaveTrimesh_clicked() {
     QString filename = QFileDialog::getSaveFileName(mainWindow,
                        "Save Trimesh",
                        ".",
-                       "OBJ(*.obj)");
+                       "OBJ(*.obj);;Trimesh binary(*.tmb);;Trimesh archive(*.tmz)");
 
     if(filename != NULL){
 
         std::cout << "save: " << filename.toStdString() << std::endl;
-        saveObj(filename.toStdString().c_str(), trimesh->vectorCoords(), trimesh->vectorTriangles());
+        if (filename.endsWith(".tmb"))
+            trimesh->saveBinary(filename.toStdString().c_str()); // with adjacency and normals: reloads without parsing
+        else if (filename.endsWith(".tmz"))
+            saveArchive(filename.toStdString().c_str(), trimesh->vectorCoords(), trimesh->vectorTriangles()); // compressed, for storage
+        else
+            saveObj(filename.toStdString().c_str(), trimesh->vectorCoords(), trimesh->vectorTriangles(), trimesh->vectorTriangleColors());
 
     }
 
@@ -143,3 +170,53 @@ void TrimeshManager::on_butSetWireframeColor_clicked() {
     trimesh->setWireframeColor(color.redF(), color.greenF(), color.blueF());
     mainWindow->updateGlCanvas();
 }
+
+void TrimeshManager::on_butCancelLoad_clicked() {
+    meshLoader.cancel();
+}
+
+void TrimeshManager::meshPreviewReady() {
+    previewTrimesh = new DrawableTrimesh(Trimesh<double>(meshLoader.preview(), std::vector<int>()));
+    previewTrimesh->setPointsShading();
+    mainWindow->pushObj(previewTrimesh, "Preview");
+    mainWindow->updateGlCanvas();
+}
+
+void TrimeshManager::meshLoaded() {
+    removePreview();
+    trimesh = loadingTrimesh;
+    loadingTrimesh = nullptr;
+    trimesh->init(); // colors for the vertices and triangles just read
+    setLoading(false);
+
+    mainWindow->pushObj(trimesh, "Triemsh");
+    setButtonsTrimeshLoaded(true);
+    mainWindow->updateGlCanvas();
+}
+
+void TrimeshManager::meshLoadStopped() {
+    removePreview();
+    delete loadingTrimesh;
+    loadingTrimesh = nullptr;
+    setLoading(false);
+    mainWindow->updateGlCanvas();
+}
+
+void TrimeshManager::meshLoadFailed() {
+    meshLoadStopped();
+    QMessageBox::warning(this, "Load Trimesh", "The mesh could not be loaded (see the console for details)");
+}
+
+void TrimeshManager::setLoading(bool b) {
+    ui->butLoadTrimesh->setEnabled(!b && trimesh == nullptr);
+    ui->loadProgress->setVisible(b);
+    ui->butCancelLoad->setVisible(b);
+}
+
+void TrimeshManager::removePreview() {
+    if (previewTrimesh != nullptr) {
+        mainWindow->deleteObj(previewTrimesh);
+        delete previewTrimesh;
+        previewTrimesh = nullptr;
+    }
+}
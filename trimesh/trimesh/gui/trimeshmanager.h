@@ -4,6 +4,7 @@
 #include <QFrame>
 #include <viewer/mainwindow.h>
 #include "drawable_trimesh.h"
+#include "meshloader.h"
 
 namespace Ui {
     class TrimeshManager;
@@ -52,10 +53,26 @@ class TrimeshManager : public QFrame
 
         void on_butSetWireframeColor_clicked();
 
+        void on_butCancelLoad_clicked();
+
+        void meshPreviewReady();
+
+        void meshLoaded();
+
+        void meshLoadStopped();
+
+        void meshLoadFailed();
+
     private:
+        void setLoading(bool b);
+        void removePreview();
+
         Ui::TrimeshManager *ui;
         MainWindow* mainWindow;
         DrawableTrimesh* trimesh;
+        DrawableTrimesh* loadingTrimesh; // filled by meshLoader, not drawn until loaded
+        DrawableTrimesh* previewTrimesh; // point cloud shown while loading
+        MeshLoader meshLoader;
 };
 
 template <typename  T>
@@ -9,9 +9,11 @@ FORMS += \
 
 HEADERS += \
     $$PWD/trimeshmanager.h \
-    $$PWD/drawable_trimesh.h
+    $$PWD/drawable_trimesh.h \
+    $$PWD/meshloader.h
 
 SOURCES += \
     $$PWD/trimeshmanager.cpp \
-    $$PWD/drawable_trimesh.cpp
+    $$PWD/drawable_trimesh.cpp \
+    $$PWD/meshloader.cpp
 
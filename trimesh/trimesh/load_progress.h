@@ -0,0 +1,76 @@
+#ifndef LOAD_PROGRESS_H
+#define LOAD_PROGRESS_H
+
+#include <algorithm>
+#include <atomic>
+
+/**
+ * @brief Progress and cancellation of a mesh load running on a worker thread.
+ *
+ * The worker installs a LoadProgress on its thread (LoadProgress::Scope) and calls the
+ * loaders of load_save_trimesh.h (or Trimesh::load): they advance it as the file is
+ * parsed and, once it is canceled, stop at the next chunk leaving the arrays as they
+ * were before the call. Any other thread can poll fraction() and call cancel().
+ *
+ * Without a LoadProgress installed the loaders behave exactly as before.
+ */
+class LoadProgress
+{
+    public:
+
+        LoadProgress() : done(0), canceled(false) {}
+
+        // the part of the file parsed so far, in [0,1]
+        inline double fraction() const { return done.load() / (double)SCALE; }
+
+        inline void cancel() { canceled = true; }
+
+        inline bool isCanceled() const { return canceled.load(); }
+
+        // called by the loaders, from any thread: the fraction never goes back (chunks parsed
+        // in parallel finish out of order). False once the load is canceled
+        inline bool advance(double fraction)
+        {
+            int value = (int)(std::min(1.0, std::max(0.0, fraction)) * SCALE);
+            int current = done.load();
+            while (value > current && !done.compare_exchange_weak(current, value)) {}
+            return !isCanceled();
+        }
+
+        // the LoadProgress installed on the calling thread, nullptr if none
+        static inline LoadProgress * current() { return slot(); }
+
+        // installs a LoadProgress on the calling thread for its lifetime
+        class Scope
+        {
+            public:
+
+                Scope(LoadProgress & progress) : previous(slot()) { slot() = &progress; }
+                ~Scope() { slot() = previous; }
+
+            private:
+
+                Scope(const Scope &);
+                Scope & operator=(const Scope &);
+
+                LoadProgress * previous;
+        };
+
+    private:
+
+        enum { SCALE = 1 << 20 };
+
+        static inline LoadProgress * & slot()
+        {
+            static thread_local LoadProgress * progress = nullptr;
+            return progress;
+        }
+
+        LoadProgress(const LoadProgress &);
+        LoadProgress & operator=(const LoadProgress &);
+
+        std::atomic<int>  done;
+        std::atomic<bool> canceled;
+};
+
+#endif // LOAD_PROGRESS_H
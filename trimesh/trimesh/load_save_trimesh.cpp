@@ -4,188 +4,1761 @@
 */
 
 #include "load_save_trimesh.h"
+#include "load_progress.h"
+#include "fast_parse.h"
+#include "mapped_file.h"
+#include "binary_mesh.h"
+#include "mesh_archive.h"
+#include "parallel.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <locale>
+#include <unordered_map>
 
 
 
 //using namespace std;
 
 
-void loadObj(const char     * filename,
-              std::vector<double> & xyz,
-              std::vector<int>    & tri)
+namespace
+{
+
+// the LoadProgress of the calling thread (if any), fed with the part of a file parsed.
+// at() and parsed() are false once the load is canceled; without a LoadProgress they are
+// always true
+struct FileProgress
+{
+    FileProgress(const char * begin, size_t size) : progress(LoadProgress::current()), begin(begin), size(size) {}
+
+    inline bool parsed(size_t bytes) const { return !progress || progress->advance(size > 0 ? (double)bytes / size : 1.0); }
+    inline bool at(const char * p) const { return parsed(p - begin); }
+    inline bool canceled() const { return progress && progress->isCanceled(); }
+
+    LoadProgress * progress; // the one of the thread that called the loader, chunks run on others
+    const char   * begin;
+    size_t         size;
+};
+
+// records between two progress checks of the sequential parsers
+enum { PROGRESS_STEP = 1 << 16 };
+
+// what one chunk of the file contributes to the mesh
+template<typename real>
+struct ObjChunk
+{
+    std::vector<real> xyz;
+    std::vector<int>  tri;     // absolute 0-based vertex ids, but see fixups
+    std::vector<int>  fixups;  // entries of tri from negative (relative) indices: they count
+                               // from the first vertex of the chunk, the chunk offset is added on merge
+    int               badFaces = 0;
+    int               badVertices = 0;
+};
+
+// the lines in [p, end): "v x y z", and "f a b c ..." with a, b, c in any of the forms
+// v, v/vt, v//vn, v/vt/vn, negative (relative) or not. Polygons are split in fans
+template<typename real>
+void parseObjChunk(const char * p, const char * end, ObjChunk<real> & chunk)
+{
+    using namespace FastParse;
+    std::vector<int> polygon;
+    std::vector<bool> relative;
+
+    while (p < end)
+    {
+        p = skipSpaces(p, end);
+        const char * eol = (const char *)memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+
+        if (eol - p > 1 && p[0] == 'v' && isSpace(p[1]))
+        {
+            real v[3];
+            const char * q = p + 1;
+            int k = 0;
+            for(; k<3; ++k)
+            {
+                q = skipSpaces(q, eol);
+                q = parseReal(q, eol, v[k]);
+                if (!q) break;
+            }
+            if (k < 3) // keep the numbering of the vertices after it
+            {
+                v[0] = v[1] = v[2] = 0;
+                ++chunk.badVertices;
+            }
+            chunk.xyz.insert(chunk.xyz.end(), v, v + 3);
+        }
+        else if (eol - p > 1 && p[0] == 'f' && isSpace(p[1]))
+        {
+            polygon.clear();
+            relative.clear();
+            bool ok = true;
+            const char * q = skipSpaces(p + 1, eol);
+            while (q < eol && *q != '\n')
+            {
+                int id;
+                q = parseInt(q, eol, id);
+                if (!q || id == 0)
+                {
+                    ok = false;
+                    break;
+                }
+                polygon.push_back(id > 0 ? id - 1 : (int)chunk.xyz.size()/3 + id);
+                relative.push_back(id < 0);
+                q = skipSpaces(skipToken(q, eol), eol); // /vt/vn
+            }
+            if (!ok || polygon.size() < 3)
+            {
+                ++chunk.badFaces;
+            }
+            else for(int i=1; i+1<(int)polygon.size(); ++i)
+            {
+                int corners[3] = { 0, i, i+1 };
+                for(int j=0; j<3; ++j)
+                {
+                    if (relative[corners[j]]) chunk.fixups.push_back((int)chunk.tri.size());
+                    chunk.tri.push_back(polygon[corners[j]]);
+                }
+            }
+        }
+        // vt, vn, comments, groups, materials...: skipped
+
+        p = (eol < end) ? eol + 1 : end;
+    }
+}
+
+}
+
+// the file is memory mapped and split in line aligned chunks that are parsed in parallel,
+// then concatenated in file order
+template<typename real>
+bool loadObj(const char        * filename,
+             std::vector<real> & xyz,
+             std::vector<int>  & tri)
 {
-    std::ifstream file(filename);
+    MappedFile file(filename);
 
-    if (!file.is_open())
+    if (!file.isOpen())
     {
         std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : load_OBJ() : couldn't open input file " << filename << std::endl;
-        exit(-1);
+        return false;
+    }
+
+    const char * data = file.data();
+    const char * end  = data + file.size();
+    int nChunks = (int)std::max<size_t>(1, std::min<size_t>(4096, file.size() >> 22)); // ~4MB each
+    std::vector<const char *> bounds(nChunks + 1, end);
+    bounds[0] = data;
+    for(int c=1; c<nChunks; ++c)
+    {
+        const char * p = data + file.size() / nChunks * c;
+        const char * eol = (p < end) ? (const char *)memchr(p, '\n', end - p) : nullptr;
+        bounds[c] = eol ? eol + 1 : end;
+        if (bounds[c] < bounds[c-1]) bounds[c] = bounds[c-1];
+    }
+
+    FileProgress progress(data, file.size());
+    std::atomic<size_t> parsed(0);
+    std::vector< ObjChunk<real> > chunks(nChunks);
+    Parallel::forEach(nChunks, [&](int c)
+    {
+        if (progress.canceled()) return;
+        size_t bytes = bounds[c+1] - bounds[c];
+        chunks[c].xyz.reserve(bytes / 16);
+        chunks[c].tri.reserve(bytes / 8);
+        parseObjChunk(bounds[c], bounds[c+1], chunks[c]);
+        progress.parsed(parsed += bytes);
+    }, 1);
+    if (progress.canceled()) return false; // nothing appended yet
+
+    std::vector<size_t> vOffset(nChunks + 1, 0), tOffset(nChunks + 1, 0);
+    int badFaces = 0, badVertices = 0;
+    for(int c=0; c<nChunks; ++c)
+    {
+        vOffset[c+1] = vOffset[c] + chunks[c].xyz.size();
+        tOffset[c+1] = tOffset[c] + chunks[c].tri.size();
+        badFaces += chunks[c].badFaces;
+        badVertices += chunks[c].badVertices;
+    }
+
+    // the ids of the file count from its first vertex, that follows the ones already in xyz
+    size_t xyzBase = xyz.size(), triBase = tri.size();
+    int base = (int)(xyzBase / 3);
+    xyz.resize(xyzBase + vOffset[nChunks]);
+    tri.resize(triBase + tOffset[nChunks]);
+    Parallel::forEach(nChunks, [&](int c)
+    {
+        std::copy(chunks[c].xyz.begin(), chunks[c].xyz.end(), xyz.begin() + xyzBase + vOffset[c]);
+        int * out = tri.data() + triBase + tOffset[c];
+        for(int i=0; i<(int)chunks[c].tri.size(); ++i) out[i] = chunks[c].tri[i] + base;
+        for(int i=0; i<(int)chunks[c].fixups.size(); ++i)
+        {
+            out[chunks[c].fixups[i]] += (int)(vOffset[c] / 3);
+        }
+        std::vector<real>().swap(chunks[c].xyz);
+        std::vector<int>().swap(chunks[c].tri);
+    }, 1);
+
+    // faces pointing outside the vertices of the file are dropped
+    int nv = (int)(xyz.size() / 3);
+    size_t last = triBase;
+    for(size_t i=triBase; i<tri.size(); i+=3)
+    {
+        if (tri[i] < base || tri[i] >= nv || tri[i+1] < base || tri[i+1] >= nv || tri[i+2] < base || tri[i+2] >= nv)
+        {
+            ++badFaces;
+            continue;
+        }
+        if (last != i) std::copy(tri.begin() + i, tri.begin() + i + 3, tri.begin() + last);
+        last += 3;
+    }
+    tri.resize(last);
+
+    if (badFaces > 0)
+    {
+        std::cerr << "WARNING : " << __FILE__ << ", line " << __LINE__ << " : load_OBJ() : "
+                  << badFaces << " malformed faces skipped in " << filename << std::endl;
+    }
+    if (badVertices > 0)
+    {
+        std::cerr << "WARNING : " << __FILE__ << ", line " << __LINE__ << " : load_OBJ() : "
+                  << badVertices << " vertices with less than 3 coordinates set to (0,0,0) in " << filename << std::endl;
+    }
+    return true;
+}
+
+namespace
+{
+
+// the next line that is neither empty nor a comment: [p, eol)
+inline const char * nextOffLine(const char * p, const char * end, const char * & eol)
+{
+    while (p < end)
+    {
+        p = FastParse::skipSpaces(p, end);
+        eol = (const char *)memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+        if (p < eol && *p != '#') return p;
+        p = (eol < end) ? eol + 1 : end;
+    }
+    eol = end;
+    return end;
+}
+
+}
+
+// "OFF", the counts, a vertex per line and a polygon per line (split in fans). What
+// follows the coordinates or the indices on a line (colors) is skipped
+template<typename real>
+bool loadOff(const char        * filename,
+             std::vector<real> & xyz,
+             std::vector<int>  & tri)
+{
+    using namespace FastParse;
+    MappedFile file(filename);
+
+    if (!file.isOpen())
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : load_OFF() : couldn't open input file " << filename << std::endl;
+        return false;
+    }
+
+    const char * end = file.data() + file.size();
+    const char * eol;
+    const char * p = nextOffLine(file.data(), end, eol);
+    if (p < eol && ((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z'))) // OFF, COFF, NOFF...
+    {
+        p = skipSpaces(skipToken(p, eol), eol);
+        if (p == eol) p = nextOffLine(eol, end, eol);
+    }
+
+    int nv = -1, nf = -1;
+    p = parseInt(p, eol, nv);
+    if (p) p = parseInt(skipSpaces(p, eol), eol, nf);
+    if (!p || nv < 0 || nf < 0)
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : load_OFF() : " << filename << " has no vertex and face counts" << std::endl;
+        return false;
+    }
+
+    FileProgress progress(file.data(), file.size());
+    size_t xyzBase = xyz.size(), triBase = tri.size();
+    int badFaces = 0;
+    xyz.reserve(xyzBase + nv * 3);
+    tri.reserve(tri.size() + nf * 3);
+    for(int vid=0; vid<nv; ++vid)
+    {
+        if (vid % PROGRESS_STEP == 0 && !progress.at(eol))
+        {
+            xyz.resize(xyzBase);
+            return false;
+        }
+        p = nextOffLine(eol, end, eol);
+        real v[3] = { 0, 0, 0 };
+        for(int k=0; k<3 && p; ++k) p = parseReal(skipSpaces(p, eol), eol, v[k]);
+        xyz.insert(xyz.end(), v, v + 3);
+    }
+
+    int base = (int)(xyzBase / 3), total = (int)(xyz.size() / 3);
+    std::vector<int> polygon;
+    for(int fid=0; fid<nf; ++fid)
+    {
+        if (fid % PROGRESS_STEP == 0 && !progress.at(eol))
+        {
+            xyz.resize(xyzBase);
+            tri.resize(triBase);
+            return false;
+        }
+        p = nextOffLine(eol, end, eol);
+        int n = 0;
+        p = parseInt(p, eol, n);
+        polygon.clear();
+        for(int i=0; i<n && p; ++i)
+        {
+            int id;
+            p = parseInt(skipSpaces(p, eol), eol, id);
+            if (p) polygon.push_back(base + id);
+        }
+        bool ok = p && n >= 3;
+        for(int i=0; i<(int)polygon.size() && ok; ++i) ok = polygon[i] >= base && polygon[i] < total;
+        if (!ok)
+        {
+            ++badFaces;
+            continue;
+        }
+        for(int i=1; i+1<n; ++i)
+        {
+            tri.push_back(polygon[0]);
+            tri.push_back(polygon[i]);
+            tri.push_back(polygon[i+1]);
+        }
     }
+    progress.parsed(file.size()); // anything after the faces is not read
 
-    std::string line;
-    while (std::getline(file, line))
+    if (badFaces > 0)
     {
+        std::cerr << "WARNING : " << __FILE__ << ", line " << __LINE__ << " : load_OFF() : "
+                  << badFaces << " malformed faces skipped in " << filename << std::endl;
+    }
+    return true;
+}
+
+namespace
+{
+
+// PLY property types, by size: the order of the table in plyTypeSize
+enum PlyType { PLY_NONE, PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64 };
+
+int plyTypeOf(const std::string & name)
+{
+    if (name == "char"   || name == "int8")    return PLY_INT8;
+    if (name == "uchar"  || name == "uint8")   return PLY_UINT8;
+    if (name == "short"  || name == "int16")   return PLY_INT16;
+    if (name == "ushort" || name == "uint16")  return PLY_UINT16;
+    if (name == "int"    || name == "int32")   return PLY_INT32;
+    if (name == "uint"   || name == "uint32")  return PLY_UINT32;
+    if (name == "float"  || name == "float32") return PLY_FLOAT32;
+    if (name == "double" || name == "float64") return PLY_FLOAT64;
+    return PLY_NONE;
+}
+
+inline int plyTypeSize(int type)
+{
+    static const int sizes[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+    return sizes[type];
+}
+
+struct PlyProperty
+{
+    std::string name;
+    int         type;
+    int         countType; // type of the length of a list, PLY_NONE if the property is not a list
+};
+
+struct PlyElement
+{
+    std::string              name;
+    long long                count;
+    std::vector<PlyProperty> properties;
+    int                      fixedSize; // bytes per record in binary files, -1 if there are lists
+
+    int find(const char * property) const
+    {
+        for(int i=0; i<(int)properties.size(); ++i)
+        {
+            if (properties[i].name == property) return i;
+        }
+        return -1;
+    }
+};
+
+enum PlyFormat { PLY_ASCII, PLY_BINARY_LE, PLY_BINARY_BE };
+
+struct PlyHeader
+{
+    int                     format;
+    std::vector<PlyElement> elements;
+    const char *            body;     // the first byte after end_header
+};
+
+inline bool littleEndianHost()
+{
+    const uint16_t one = 1;
+    unsigned char c;
+    memcpy(&c, &one, 1);
+    return c == 1;
+}
+
+// the value at p as stored in a binary file (byte swapped if the file has the other endianness)
+inline double plyValue(const char * p, int type, bool swap)
+{
+    char b[8];
+    int size = plyTypeSize(type);
+    if (swap) for(int i=0; i<size; ++i) b[i] = p[size-1-i];
+    else      memcpy(b, p, size);
+    switch (type)
+    {
+        case PLY_INT8:    { int8_t   v; memcpy(&v, b, 1); return v; }
+        case PLY_UINT8:   { uint8_t  v; memcpy(&v, b, 1); return v; }
+        case PLY_INT16:   { int16_t  v; memcpy(&v, b, 2); return v; }
+        case PLY_UINT16:  { uint16_t v; memcpy(&v, b, 2); return v; }
+        case PLY_INT32:   { int32_t  v; memcpy(&v, b, 4); return v; }
+        case PLY_UINT32:  { uint32_t v; memcpy(&v, b, 4); return v; }
+        case PLY_FLOAT32: { float    v; memcpy(&v, b, 4); return v; }
+        default:          { double   v; memcpy(&v, b, 8); return v; }
+    }
+}
+
+template<typename real> struct PlyTypeOf;
+template<> struct PlyTypeOf<float>  { enum { value = PLY_FLOAT32 }; };
+template<> struct PlyTypeOf<double> { enum { value = PLY_FLOAT64 }; };
+
+bool parsePlyHeader(const char * data, const char * end, PlyHeader & header, std::string & error)
+{
+    const char * p = data;
+    bool magic = false, format = false;
+    while (p < end)
+    {
+        const char * eol = (const char *)memchr(p, '\n', end - p);
+        if (!eol) break;
+        std::string line(p, (eol > p && eol[-1] == '\r') ? eol - 1 : eol);
+        p = eol + 1;
+
         std::istringstream iss(line);
+        std::string keyword;
+        iss >> keyword;
+        if (!magic)
+        {
+            if (keyword != "ply") break;
+            magic = true;
+        }
+        else if (keyword == "format")
+        {
+            std::string name;
+            iss >> name;
+            if      (name == "ascii")                header.format = PLY_ASCII;
+            else if (name == "binary_little_endian") header.format = PLY_BINARY_LE;
+            else if (name == "binary_big_endian")    header.format = PLY_BINARY_BE;
+            else
+            {
+                error = "unknown format " + name;
+                return false;
+            }
+            format = true;
+        }
+        else if (keyword == "element")
+        {
+            PlyElement e;
+            if (!(iss >> e.name >> e.count) || e.count < 0)
+            {
+                error = "invalid element line: " + line;
+                return false;
+            }
+            e.fixedSize = 0;
+            header.elements.push_back(e);
+        }
+        else if (keyword == "property")
+        {
+            if (header.elements.empty())
+            {
+                error = "property before any element";
+                return false;
+            }
+            PlyElement & e = header.elements.back();
+            PlyProperty prop;
+            std::string type;
+            iss >> type;
+            if (type == "list")
+            {
+                std::string countType;
+                iss >> countType >> type;
+                prop.countType = plyTypeOf(countType);
+                if (prop.countType == PLY_NONE || prop.countType == PLY_FLOAT32 || prop.countType == PLY_FLOAT64)
+                {
+                    error = "invalid list length type in: " + line;
+                    return false;
+                }
+                e.fixedSize = -1;
+            }
+            else prop.countType = PLY_NONE;
+            prop.type = plyTypeOf(type);
+            if (prop.type == PLY_NONE || !(iss >> prop.name))
+            {
+                error = "invalid property line: " + line;
+                return false;
+            }
+            if (e.fixedSize >= 0) e.fixedSize += plyTypeSize(prop.type);
+            e.properties.push_back(prop);
+        }
+        else if (keyword == "end_header")
+        {
+            if (!format) break;
+            header.body = p;
+            return true;
+        }
+        // comment, obj_info: skipped
+    }
+    error = magic ? "incomplete header" : "not a PLY file";
+    return false;
+}
 
-        std::string token;
-        iss >> token;
-        if (token.size() > 1) continue; // vn,fn  .... I don't care
+// the end of the binary value (or list) at p, nullptr if it goes past end
+inline const char * skipPlyProperty(const PlyProperty & prop, const char * p, const char * end, bool swap)
+{
+    if (prop.countType != PLY_NONE)
+    {
+        if (end - p < plyTypeSize(prop.countType)) return nullptr;
+        double n = plyValue(p, prop.countType, swap);
+        if (n < 0) return nullptr;
+        p += plyTypeSize(prop.countType);
+        if ((end - p) / plyTypeSize(prop.type) < n) return nullptr;
+        return p + (size_t)n * plyTypeSize(prop.type);
+    }
+    if (end - p < plyTypeSize(prop.type)) return nullptr;
+    return p + plyTypeSize(prop.type);
+}
+
+inline const char * skipPlyRecord(const PlyElement & e, const char * p, const char * end, bool swap)
+{
+    for(int i=0; i<(int)e.properties.size() && p; ++i) p = skipPlyProperty(e.properties[i], p, end, swap);
+    return p;
+}
 
-        if (token[0] == 'v')
+// the end of the element in a binary file, nullptr if it is truncated
+inline const char * skipPlyElement(const PlyElement & e, const char * p, const char * end, bool swap)
+{
+    if (e.fixedSize >= 0)
+    {
+        if (e.fixedSize > 0 && (end - p) / e.fixedSize < e.count) return nullptr;
+        return p + e.count * e.fixedSize;
+    }
+    for(long long r=0; r<e.count && p; ++r) p = skipPlyRecord(e, p, end, swap);
+    return p;
+}
+
+// x, y, z of the binary vertex records at p into xyz. Fixed size records are read in
+// parallel, and copied as they are when they hold just x, y, z of the type of xyz
+template<typename real>
+const char * readPlyVertices(const PlyElement & e, const char * p, const char * end, bool swap, std::vector<real> & xyz)
+{
+    int ids[3] = { e.find("x"), e.find("y"), e.find("z") };
+    if (e.count > end - p) return nullptr; // at least a byte per record
+    size_t base = xyz.size();
+    xyz.resize(base + e.count * 3);
+
+    if (e.fixedSize < 0)
+    {
+        for(long long r=0; r<e.count && p; ++r)
         {
-            double x, y, z;
-            iss >> x >> y >> z;
-            xyz.push_back(x);
-            xyz.push_back(y);
-            xyz.push_back(z);
-            //cout << "v " << x << " " << y << " " << z << endl;
+            const char * q = p;
+            for(int i=0; i<(int)e.properties.size() && q; ++i)
+            {
+                for(int k=0; k<3; ++k)
+                {
+                    if (ids[k] == i && e.properties[i].countType == PLY_NONE && end - q >= plyTypeSize(e.properties[i].type))
+                        xyz[base + r*3 + k] = (real)plyValue(q, e.properties[i].type, swap);
+                }
+                q = skipPlyProperty(e.properties[i], q, end, swap);
+            }
+            p = q;
         }
-        else if (token[0] == 'f')
+        return p;
+    }
+
+    const char * last = skipPlyElement(e, p, end, swap);
+    if (!last) return nullptr;
+    int offsets[3], types[3];
+    for(int k=0; k<3; ++k)
+    {
+        offsets[k] = 0;
+        for(int i=0; i<ids[k]; ++i) offsets[k] += plyTypeSize(e.properties[i].type);
+        types[k] = e.properties[ids[k]].type;
+    }
+    const int size = sizeof(real);
+    bool packed = !swap && types[0] == PlyTypeOf<real>::value && types[1] == types[0] && types[2] == types[0] &&
+                  offsets[1] == offsets[0] + size && offsets[2] == offsets[1] + size;
+    int recordSize = e.fixedSize;
+
+    if (packed && recordSize == 3 * size)
+    {
+        memcpy(&xyz[base], p, e.count * recordSize);
+        return last;
+    }
+    Parallel::forChunks((int)e.count, [&](int begin, int end)
+    {
+        for(int r=begin; r<end; ++r)
         {
-            int v0, v1, v2;
-            iss >> v0 >> v1 >> v2;
-            tri.push_back(v0-1);
-            tri.push_back(v1-1);
-            tri.push_back(v2-1);
-            //cout << "f " << v0 << " " << v1 << " " << v2 << endl;
+            const char * record = p + (size_t)r * recordSize;
+            real * out = &xyz[base + (size_t)r * 3];
+            if (packed) memcpy(out, record + offsets[0], 3 * size);
+            else for(int k=0; k<3; ++k) out[k] = (real)plyValue(record + offsets[k], types[k], swap);
         }
+    }, 65536);
+    return last;
+}
+
+// the polygons (vertex_indices or vertex_index) of the binary face records at p, split in fans.
+// If every face is a triangle the records have a fixed size: then they are read in parallel
+const char * readPlyFaces(const PlyElement & e, const char * p, const char * end, bool swap, std::vector<int> & tri)
+{
+    int list = e.find("vertex_indices");
+    if (list < 0) list = e.find("vertex_index");
+    if (list < 0 || e.properties[list].countType == PLY_NONE) return skipPlyElement(e, p, end, swap);
+
+    const PlyProperty & prop = e.properties[list];
+    int countSize = plyTypeSize(prop.countType), indexSize = plyTypeSize(prop.type);
+    int listOffset = 0, triangleSize = 0;
+    bool otherLists = false;
+    for(int i=0; i<(int)e.properties.size(); ++i)
+    {
+        if (i == list) listOffset = triangleSize;
+        if (i != list && e.properties[i].countType != PLY_NONE) otherLists = true;
+        triangleSize += (i == list) ? countSize + 3 * indexSize : plyTypeSize(e.properties[i].type);
     }
-    file.close();
+
+    bool triangles = !otherLists && (end - p) / triangleSize >= e.count;
+    if (triangles)
+    {
+        // counted as ints: the partial results of a std::vector<bool> would share bytes
+        int others = Parallel::reduce((int)e.count, 0, [&](int r)
+        {
+            return plyValue(p + (size_t)r * triangleSize + listOffset, prop.countType, swap) == 3 ? 0 : 1;
+        }, [](int a, int b) { return a + b; }, 65536);
+        triangles = others == 0;
+    }
+    if (triangles)
+    {
+        size_t base = tri.size();
+        tri.resize(base + e.count * 3);
+        bool direct = !swap && (prop.type == PLY_INT32 || prop.type == PLY_UINT32);
+        Parallel::forChunks((int)e.count, [&](int begin, int end)
+        {
+            for(int r=begin; r<end; ++r)
+            {
+                const char * indices = p + (size_t)r * triangleSize + listOffset + countSize;
+                int * out = &tri[base + (size_t)r * 3];
+                if (direct) memcpy(out, indices, 12);
+                else for(int i=0; i<3; ++i) out[i] = (int)(long long)plyValue(indices + i * indexSize, prop.type, swap);
+            }
+        }, 65536);
+        return p + e.count * triangleSize;
+    }
+
+    std::vector<int> polygon;
+    for(long long r=0; r<e.count && p; ++r)
+    {
+        for(int i=0; i<(int)e.properties.size() && p; ++i)
+        {
+            const PlyProperty & q = e.properties[i];
+            if (i != list)
+            {
+                p = skipPlyProperty(q, p, end, swap);
+                continue;
+            }
+            if (end - p < countSize) return nullptr;
+            double n = plyValue(p, q.countType, swap);
+            p += countSize;
+            if (n < 0 || (end - p) / indexSize < n) return nullptr;
+            polygon.resize((size_t)n);
+            for(int k=0; k<(int)n; ++k) polygon[k] = (int)(long long)plyValue(p + k * indexSize, q.type, swap);
+            p += (size_t)n * indexSize;
+            for(int k=1; k+1<(int)polygon.size(); ++k)
+            {
+                tri.push_back(polygon[0]);
+                tri.push_back(polygon[k]);
+                tri.push_back(polygon[k+1]);
+            }
+        }
+    }
+    return p;
 }
 
-void saveObj(const char *filename, const std::vector<double> &xyz, const std::vector<int> &tri)
+inline const char * skipBlanks(const char * p, const char * end)
 {
-    std::ofstream fp;
-    fp.open (filename);
-    fp.precision(6);
-    fp.setf( std::ios::fixed, std:: ios::floatfield ); // floatfield set to fixed
+    while (p < end && (FastParse::isSpace(*p) || *p == '\n')) ++p;
+    return p;
+}
 
-    if(!fp)
+// ascii body: values separated by blanks, records are not required to be one per line.
+// Stops early (returning where it got) if the load is canceled
+template<typename real>
+const char * readPlyAscii(const PlyHeader & header, const char * p, const char * end, const FileProgress & progress,
+                          std::vector<real> & xyz, std::vector<int> & tri)
+{
+    using namespace FastParse;
+    std::vector<int> polygon;
+    bool vertices = false, faces = false;
+    for(int j=0; j<(int)header.elements.size() && p; ++j)
     {
-        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : save_OBJ() : couldn't open output file " << filename << std::endl;
-        exit(-1);
+        const PlyElement & e = header.elements[j];
+        bool isVertex = !vertices && e.name == "vertex";
+        bool isFace   = !faces    && e.name == "face";
+        vertices = vertices || isVertex;
+        faces    = faces    || isFace;
+        int ids[3] = { e.find("x"), e.find("y"), e.find("z") };
+        int list = isFace ? std::max(e.find("vertex_indices"), e.find("vertex_index")) : -1;
+        if (isVertex) xyz.reserve(xyz.size() + e.count * 3);
+        if (isFace)   tri.reserve(tri.size() + e.count * 3);
+
+        for(long long r=0; r<e.count && p; ++r)
+        {
+            if (r % PROGRESS_STEP == 0 && !progress.at(p)) return p;
+            real v[3] = { 0, 0, 0 };
+            for(int i=0; i<(int)e.properties.size() && p; ++i)
+            {
+                const PlyProperty & prop = e.properties[i];
+                double d;
+                if (prop.countType == PLY_NONE)
+                {
+                    int k = isVertex ? (ids[0] == i ? 0 : ids[1] == i ? 1 : ids[2] == i ? 2 : -1) : -1;
+                    if (k >= 0) p = parseReal(skipBlanks(p, end), end, v[k]);
+                    else        p = parseDouble(skipBlanks(p, end), end, d);
+                    continue;
+                }
+                int n;
+                p = parseInt(skipBlanks(p, end), end, n);
+                if (!p || n < 0) return nullptr;
+                polygon.clear();
+                for(int k=0; k<n && p; ++k)
+                {
+                    p = parseDouble(skipBlanks(p, end), end, d);
+                    polygon.push_back((int)(long long)d);
+                }
+                if (i == list) for(int k=1; k+1<(int)polygon.size(); ++k)
+                {
+                    tri.push_back(polygon[0]);
+                    tri.push_back(polygon[k]);
+                    tri.push_back(polygon[k+1]);
+                }
+            }
+            if (isVertex) xyz.insert(xyz.end(), v, v + 3);
+        }
     }
+    return p;
+}
 
-    //cout << "v " << xyz[3] << " " << xyz[4] << " " << xyz[5] << endl;
+}
+
+// the header is parsed once, then binary files are read with one pass per element:
+// fixed size records (vertices, triangle-only faces) are copied in parallel, straight
+// from the memory mapped file. Other elements and properties are skipped
+template<typename real>
+bool loadPly(const char        * filename,
+             std::vector<real> & xyz,
+             std::vector<int>  & tri)
+{
+    MappedFile file(filename);
 
-    for(int i=0; i<(int)xyz.size(); i+=3)
+    if (!file.isOpen())
     {
-        fp << "v " << xyz[i] << " " << xyz[i+1] << " " << xyz[i+2] << std::endl;
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : load_PLY() : couldn't open input file " << filename << std::endl;
+        return false;
     }
 
-    for(int i=0; i<(int)tri.size(); i+=3)
+    const char * end = file.data() + file.size();
+    PlyHeader header;
+    std::string error;
+    if (!parsePlyHeader(file.data(), end, header, error))
     {
-        fp << "f " << tri[i]+1 << " " << tri[i+1]+1 << " " << tri[i+2]+1 << std::endl;
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : load_PLY() : " << filename << " : " << error << std::endl;
+        return false;
+    }
+    for(int j=0; j<(int)header.elements.size(); ++j)
+    {
+        const PlyElement & e = header.elements[j];
+        if (e.name == "vertex" && (e.find("x") < 0 || e.find("y") < 0 || e.find("z") < 0))
+        {
+            std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : load_PLY() : " << filename << " : vertices without x, y, z" << std::endl;
+            return false;
+        }
     }
 
-    fp.close();
+    FileProgress progress(file.data(), file.size());
+    size_t xyzBase = xyz.size(), triBase = tri.size();
+    const char * p = header.body;
+    if (header.format == PLY_ASCII)
+    {
+        p = readPlyAscii(header, p, end, progress, xyz, tri);
+    }
+    else
+    {
+        bool swap = (header.format == PLY_BINARY_LE) != littleEndianHost();
+        bool vertices = false, faces = false;
+        for(int j=0; j<(int)header.elements.size() && p && progress.at(p); ++j)
+        {
+            const PlyElement & e = header.elements[j];
+            if      (!vertices && e.name == "vertex") p = readPlyVertices(e, p, end, swap, xyz), vertices = true;
+            else if (!faces    && e.name == "face")   p = readPlyFaces(e, p, end, swap, tri),    faces = true;
+            else                                      p = skipPlyElement(e, p, end, swap);
+        }
+    }
+    if (progress.canceled() || !p)
+    {
+        if (!p) std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : load_PLY() : " << filename << " is truncated or malformed" << std::endl;
+        xyz.resize(xyzBase);
+        tri.resize(triBase);
+        return false;
+    }
+    progress.parsed(file.size());
+
+    // indices are relative to the vertices of this file; faces pointing outside them are dropped
+    // (checked in parallel, the compaction is needed only if there are any)
+    int base = (int)(xyzBase / 3), nv = (int)(xyz.size() / 3) - base;
+    int nt = (int)((tri.size() - triBase) / 3);
+    int * t = tri.data() + triBase;
+    int badFaces = Parallel::reduce(nt, 0, [&](int tid)
+    {
+        const int * c = t + tid * 3;
+        return (c[0] < 0 || c[0] >= nv || c[1] < 0 || c[1] >= nv || c[2] < 0 || c[2] >= nv) ? 1 : 0;
+    }, [](int a, int b) { return a + b; }, 65536);
+    if (badFaces > 0)
+    {
+        size_t last = triBase;
+        for(size_t i=triBase; i<tri.size(); i+=3)
+        {
+            if (tri[i] < 0 || tri[i] >= nv || tri[i+1] < 0 || tri[i+1] >= nv || tri[i+2] < 0 || tri[i+2] >= nv) continue;
+            for(int k=0; k<3; ++k) tri[last+k] = tri[i+k];
+            last += 3;
+        }
+        tri.resize(last);
+    }
+    if (base > 0) Parallel::forChunks((int)(tri.size() - triBase), [&](int begin, int end)
+    {
+        for(int i=begin; i<end; ++i) tri[triBase + i] += base;
+    }, 65536);
+
+    if (badFaces > 0)
+    {
+        std::cerr << "WARNING : " << __FILE__ << ", line " << __LINE__ << " : load_PLY() : "
+                  << badFaces << " malformed faces skipped in " << filename << std::endl;
+    }
+    return true;
 }
 
-void objToOff(const char *f1, const char *f2)
+namespace
 {
-    std::ifstream fObj;
-    std::ofstream fOff;
-    std::istringstream iss;
-    std::ostringstream oss;
-    std::string line;
-    std::string temp;
-    int n;
 
-    int nVertices=0;
-    int nFaces=0;
+// binary STL: 80 bytes of header, the number of facets (uint32), then 50 bytes per facet:
+// normal, three corners (12 little endian floats) and an attribute (uint16)
+enum { STL_HEADER = 84, STL_FACET = 50 };
 
-    fObj.open(f1);
-    fOff.open(f2);
+bool isBinaryStl(const char * data, size_t size, uint32_t & facets)
+{
+    if (size < STL_HEADER) return false;
+    facets = (uint32_t)plyValue(data + 80, PLY_UINT32, !littleEndianHost());
+    return (uint64_t)STL_HEADER + (uint64_t)facets * STL_FACET == size;
+}
 
-    fOff<<"OFF"<<std::endl;
+// "vertex x y z" lines, everything else (solid, facet normal, loops) is skipped.
+// Stops early if the load is canceled
+template<typename real>
+bool readStlAscii(const char * p, const char * end, const FileProgress & progress, std::vector<real> & xyz)
+{
+    for(int line=0; p < end; ++line)
+    {
+        if (line % PROGRESS_STEP == 0 && !progress.at(p)) return true;
+        p = FastParse::skipSpaces(p, end);
+        const char * eol = (const char *)memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+        if (eol - p > 6 && memcmp(p, "vertex", 6) == 0 && FastParse::isSpace(p[6]))
+        {
+            p += 6;
+            for(int k=0; k<3; ++k)
+            {
+                real v;
+                p = FastParse::parseReal(FastParse::skipSpaces(p, eol), eol, v);
+                if (!p) return false;
+                xyz.push_back(v);
+            }
+        }
+        p = (eol < end) ? eol + 1 : end;
+    }
+    return xyz.size() % 9 == 0;
+}
 
-    while(std::getline(fObj,line))
+}
+
+// every facet gets three vertices of its own: weldVertices (weld.h) merges them
+template<typename real>
+bool loadStl(const char        * filename,
+             std::vector<real> & xyz,
+             std::vector<int>  & tri)
+{
+    MappedFile file(filename);
+
+    if (!file.isOpen())
     {
-        iss=std::istringstream(line);
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : load_STL() : couldn't open input file " << filename << std::endl;
+        return false;
+    }
 
-        iss>>temp;
+    FileProgress progress(file.data(), file.size());
+    std::atomic<size_t> parsed(0);
+    size_t xyzBase = xyz.size();
+    uint32_t facets;
+    if (isBinaryStl(file.data(), file.size(), facets))
+    {
+        const char * data = file.data() + STL_HEADER;
+        bool swap = !littleEndianHost();
+        xyz.resize(xyzBase + (size_t)facets * 9);
+        real * out = xyz.data() + xyzBase;
+        Parallel::forChunks((int)facets, [&](int begin, int end)
+        {
+            if (progress.canceled()) return;
+            for(int fid=begin; fid<end; ++fid)
+            {
+                const char * corners = data + (size_t)fid * STL_FACET + 12;
+                for(int k=0; k<9; ++k) out[(size_t)fid*9 + k] = (real)plyValue(corners + k * 4, PLY_FLOAT32, swap);
+            }
+            progress.parsed(parsed += (size_t)(end - begin) * STL_FACET);
+        }, 16384);
+    }
+    else
+    {
+        const char * p = FastParse::skipSpaces(file.data(), file.data() + file.size());
+        bool solid = file.data() + file.size() - p > 5 && memcmp(p, "solid", 5) == 0;
+        std::vector<real> corners;
+        if (!solid || !readStlAscii(p, file.data() + file.size(), progress, corners))
+        {
+            std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : load_STL() : " << filename << " is truncated or malformed" << std::endl;
+            return false;
+        }
+        xyz.insert(xyz.end(), corners.begin(), corners.end());
+    }
+    if (progress.canceled())
+    {
+        xyz.resize(xyzBase);
+        return false;
+    }
+
+    int base = (int)(xyzBase / 3), nv = (int)(xyz.size() / 3) - base;
+    size_t triBase = tri.size();
+    tri.resize(triBase + nv);
+    Parallel::forChunks(nv, [&](int begin, int end)
+    {
+        for(int i=begin; i<end; ++i) tri[triBase + i] = base + i;
+    }, 65536);
+    return true;
+}
+
+namespace
+{
+
+// a text preview reads at most PREVIEW_WINDOWS windows of PREVIEW_WINDOW bytes
+enum { PREVIEW_WINDOWS = 256, PREVIEW_WINDOW = 1 << 14 };
+
+// the vertices in windows spread evenly over the lines in [begin, end): the first complete
+// lines of each window, up to its share of maxPoints. vertex(p, eol, v) tells whether the
+// line [p, eol) is a vertex, and parses it into v
+template<typename real, typename Vertex>
+void sampleLines(const char * begin, const char * end, int maxPoints, std::vector<real> & xyz, Vertex vertex)
+{
+    size_t size = end - begin;
+    int windows = (int)std::min<size_t>(PREVIEW_WINDOWS, std::max<size_t>(1, size / 64));
+    int quota = std::max(1, maxPoints / windows);
+    size_t length = std::min<size_t>(PREVIEW_WINDOW, size / windows + 1);
+    for(int w=0; w<windows; ++w)
+    {
+        const char * p = begin + size / windows * w;
+        const char * stop = std::min(end, p + length);
+        if (w > 0) // the line the window starts in is the last one of the previous window
+        {
+            const char * eol = (const char *)memchr(p, '\n', stop - p);
+            p = eol ? eol + 1 : stop;
+        }
+        for(int taken=0; p < stop && taken < quota; )
+        {
+            p = FastParse::skipSpaces(p, end);
+            if (p == end) break;
+            const char * eol = (const char *)memchr(p, '\n', end - p);
+            if (!eol) eol = end;
+            real v[3];
+            if (vertex(p, eol, v))
+            {
+                xyz.insert(xyz.end(), v, v + 3);
+                ++taken;
+            }
+            p = (eol < end) ? eol + 1 : end;
+        }
+    }
+}
+
+// the numbers on the line [p, eol) into values: how many they are, -1 if the line has
+// something else or more than n of them
+inline int parseNumbers(const char * p, const char * eol, double * values, int n)
+{
+    int k = 0;
+    for(p = FastParse::skipSpaces(p, eol); p < eol; p = FastParse::skipSpaces(p, eol))
+    {
+        if (k == n) return -1;
+        p = FastParse::parseDouble(p, eol, values[k++]);
+        if (!p) return -1;
+    }
+    return k;
+}
 
-        if(temp[0]=='v')
+// "n i1 ... in": a polygon of OFF, or a face of an ascii PLY
+inline bool isPolygon(const double * values, int k)
+{
+    return k >= 4 && values[0] == k - 1;
+}
+
+// OFF: the lines after the counts with three numbers or more that are not a polygon
+template<typename real>
+bool previewOff(const char * data, const char * end, int maxPoints, std::vector<real> & xyz)
+{
+    const char * eol;
+    const char * p = nextOffLine(data, end, eol);
+    if (p < eol && ((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z')))
+    {
+        p = FastParse::skipSpaces(FastParse::skipToken(p, eol), eol);
+        if (p == eol) p = nextOffLine(eol, end, eol);
+    }
+    if (p >= end) return false;
+    sampleLines(std::min(end, eol + 1), end, maxPoints, xyz, [](const char * p, const char * eol, real * v)
+    {
+        double values[16];
+        int k = parseNumbers(p, eol, values, 16);
+        if (k < 3 || isPolygon(values, k)) return false;
+        for(int i=0; i<3; ++i) v[i] = (real)values[i];
+        return true;
+    });
+    return true;
+}
+
+// PLY: the vertex records, with a fixed stride in binary files, from sampled lines with as
+// many numbers as the vertex properties in ascii ones. Vertices with list properties have
+// no preview
+template<typename real>
+bool previewPly(const char * data, const char * end, int maxPoints, std::vector<real> & xyz)
+{
+    PlyHeader header;
+    std::string error;
+    if (!parsePlyHeader(data, end, header, error)) return false;
+
+    bool swap = (header.format == PLY_BINARY_LE) != littleEndianHost();
+    const char * p = header.body;
+    for(int j=0; j<(int)header.elements.size() && p; ++j)
+    {
+        const PlyElement & e = header.elements[j];
+        if (e.name != "vertex")
+        {
+            if (header.format != PLY_ASCII) p = skipPlyElement(e, p, end, swap);
+            continue;
+        }
+
+        int ids[3] = { e.find("x"), e.find("y"), e.find("z") };
+        int nProperties = (int)e.properties.size();
+        if (ids[0] < 0 || ids[1] < 0 || ids[2] < 0 || e.fixedSize < 0 || e.count == 0) return false;
+        if (header.format == PLY_ASCII)
+        {
+            if (nProperties > 16) return false;
+            sampleLines(p, end, maxPoints, xyz, [&](const char * p, const char * eol, real * v)
+            {
+                double values[16];
+                int k = parseNumbers(p, eol, values, 16);
+                if (k != nProperties || isPolygon(values, k)) return false;
+                for(int i=0; i<3; ++i) v[i] = (real)values[ids[i]];
+                return true;
+            });
+            return true;
+        }
+
+        if (e.fixedSize == 0 || (end - p) / e.fixedSize < e.count) return false;
+        int offsets[3];
+        for(int k=0; k<3; ++k)
+        {
+            offsets[k] = 0;
+            for(int i=0; i<ids[k]; ++i) offsets[k] += plyTypeSize(e.properties[i].type);
+        }
+        long long stride = (e.count + maxPoints - 1) / maxPoints;
+        for(long long r=0; r<e.count; r+=stride)
+        {
+            const char * record = p + (size_t)r * e.fixedSize;
+            for(int k=0; k<3; ++k) xyz.push_back((real)plyValue(record + offsets[k], e.properties[ids[k]].type, swap));
+        }
+        return true;
+    }
+    return false;
+}
+
+// STL: the first corner of facets taken with a fixed stride (binary), or of sampled
+// "vertex" lines (ascii)
+template<typename real>
+bool previewStl(const char * data, size_t size, int maxPoints, std::vector<real> & xyz)
+{
+    uint32_t facets;
+    if (isBinaryStl(data, size, facets))
+    {
+        bool swap = !littleEndianHost();
+        uint32_t stride = std::max<uint32_t>(1, (facets + maxPoints - 1) / maxPoints);
+        for(uint32_t fid=0; fid<facets; fid+=stride)
+        {
+            const char * corner = data + STL_HEADER + (size_t)fid * STL_FACET + 12;
+            for(int k=0; k<3; ++k) xyz.push_back((real)plyValue(corner + k * 4, PLY_FLOAT32, swap));
+        }
+        return true;
+    }
+    sampleLines(data, data + size, maxPoints, xyz, [](const char * p, const char * eol, real * v)
+    {
+        if (eol - p <= 6 || memcmp(p, "vertex", 6) != 0 || !FastParse::isSpace(p[6])) return false;
+        p += 6;
+        for(int k=0; k<3 && p; ++k) p = FastParse::parseReal(FastParse::skipSpaces(p, eol), eol, v[k]);
+        return p != nullptr;
+    });
+    return true;
+}
+
+// .tmb: the stored coordinates with a fixed stride
+template<typename real>
+bool previewBinary(const char * filename, int maxPoints, std::vector<real> & xyz)
+{
+    BinaryMeshFile file;
+    int type;
+    size_t count;
+    const char * coords = file.open(filename) ? (const char *)file.data(BinaryMesh::COORDS, type, count) : nullptr;
+    if (!coords || (type != BinaryMesh::FLOAT32 && type != BinaryMesh::FLOAT64)) return false;
+    size_t nv = count / 3, stride = std::max<size_t>(1, (nv + maxPoints - 1) / maxPoints);
+    for(size_t vid=0; vid<nv; vid+=stride)
+    {
+        for(int k=0; k<3; ++k)
+        {
+            size_t i = vid * 3 + k;
+            if (type == BinaryMesh::FLOAT32) { float  c; memcpy(&c, coords + i * 4, 4); xyz.push_back((real)c); }
+            else                             { double c; memcpy(&c, coords + i * 8, 8); xyz.push_back((real)c); }
+        }
+    }
+    return true;
+}
+
+}
+
+// only a sample of the file is read: its pages are the only ones the mapping loads
+template<typename real>
+bool loadPreview(const char        * filename,
+                 std::vector<real> & xyz,
+                 int                 maxPoints)
+{
+    xyz.clear();
+    std::string str(filename);
+    std::string filetype = str.size() >= 3 ? str.substr(str.size()-3, 3) : str;
+    std::transform(filetype.begin(), filetype.end(), filetype.begin(), ::tolower);
+    maxPoints = std::max(1, maxPoints);
+
+    if (filetype == "tmb") return previewBinary(filename, maxPoints, xyz) && !xyz.empty();
+    if (filetype == "tmz") return loadArchivePreview(filename, xyz, maxPoints) && !xyz.empty();
+
+    MappedFile file(filename);
+    if (!file.isOpen()) return false;
+    const char * data = file.data();
+    const char * end  = data + file.size();
+    bool ok = false;
+    if (filetype == "obj")
+    {
+        sampleLines(data, end, maxPoints, xyz, [](const char * p, const char * eol, real * v)
+        {
+            if (eol - p <= 1 || p[0] != 'v' || !FastParse::isSpace(p[1])) return false;
+            ++p;
+            for(int k=0; k<3 && p; ++k) p = FastParse::parseReal(FastParse::skipSpaces(p, eol), eol, v[k]);
+            return p != nullptr;
+        });
+        ok = true;
+    }
+    else if (filetype == "off") ok = previewOff(data, end, maxPoints, xyz);
+    else if (filetype == "ply") ok = previewPly(data, end, maxPoints, xyz);
+    else if (filetype == "stl") ok = previewStl(data, file.size(), maxPoints, xyz);
+    return ok && !xyz.empty();
+}
+
+namespace
+{
+
+inline char * writeUnsigned(char * out, unsigned long long v, int minDigits = 1)
+{
+    char digits[24];
+    int n = 0;
+    do
+    {
+        digits[n++] = (char)('0' + v % 10);
+        v /= 10;
+    }
+    while (v > 0 || n < minDigits);
+    while (n > 0) *out++ = digits[--n];
+    return out;
+}
+
+// snprintf writes the decimal point of the current locale, the GUI may have installed one
+// with ','. The OBJ files always get the one of the C locale
+inline char * forcePoint(char * out, char * end)
+{
+    for(char * c=out; c<end; ++c)
+    {
+        if (*c == ',') *c = '.';
+    }
+    return end;
+}
+
+// v with precision digits after the point, as printf("%.*f") up to the rounding of halfway
+// cases (v * 10^precision is rounded half up). Out of range values go through snprintf
+inline char * writeFixed(char * out, double v, int precision)
+{
+    static const double             scale[]  = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17 };
+    static const unsigned long long iscale[] = { 1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull,
+                                                 1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull,
+                                                 100000000000000ull, 1000000000000000ull, 10000000000000000ull, 100000000000000000ull };
+    double s = std::fabs(v) * scale[precision];
+    if (!(s < 9e15)) return forcePoint(out, out + snprintf(out, 400, "%.*f", precision, v));
+
+    unsigned long long n = (unsigned long long)(s + 0.5);
+    if (v < 0) *out++ = '-';
+    out = writeUnsigned(out, n / iscale[precision]);
+    if (precision > 0)
+    {
+        *out++ = '.';
+        out = writeUnsigned(out, n % iscale[precision], precision);
+    }
+    return out;
+}
+
+// v with 17 significant digits (%.17g): parsed back it gives the same double
+inline char * writeExact(char * out, double v)
+{
+    return forcePoint(out, out + snprintf(out, 32, "%.17g", v));
+}
+
+template<typename real>
+void writeVertexLines(std::string & buffer, const std::vector<real> & xyz, int begin, int end, int precision)
+{
+    char line[1300]; // 3 * 400 for the snprintf fallback
+    buffer.reserve((end - begin) * (3 * (precision + 6) + 3));
+    for(int vid=begin; vid<end; ++vid)
+    {
+        char * p = line;
+        *p++ = 'v';
+        for(int k=0; k<3; ++k)
+        {
+            *p++ = ' ';
+            p = precision == OBJ_EXACT_PRECISION ? writeExact(p, xyz[vid*3+k]) : writeFixed(p, xyz[vid*3+k], precision);
+        }
+        *p++ = '\n';
+        buffer.append(line, p);
+    }
+}
+
+// materials: per triangle, empty if there are no colors. A usemtl line is written wherever
+// the material changes (the previous triangle of begin included)
+void writeFaceLines(std::string & buffer, const std::vector<int> & tri, const std::vector<int> & materials, int begin, int end)
+{
+    char line[64];
+    buffer.reserve((end - begin) * 24);
+    for(int tid=begin; tid<end; ++tid)
+    {
+        char * p = line;
+        if (!materials.empty() && (tid == 0 || materials[tid] != materials[tid-1]))
+        {
+            memcpy(p, "usemtl mat", 10);
+            p = writeUnsigned(p + 10, materials[tid]);
+            *p++ = '\n';
+        }
+        *p++ = 'f';
+        for(int i=0; i<3; ++i)
         {
-            nVertices++;
-            getline(iss,temp);
-            oss<<temp<<" "<<std::endl;
+            *p++ = ' ';
+            p = writeUnsigned(p, (unsigned long long)(tri[tid*3+i] + 1));
         }
-        if(temp[0]=='f')
+        *p++ = '\n';
+        buffer.append(line, p);
+    }
+}
+
+// the file is formatted by chunks of lines on the thread pool, a batch of chunks at a time,
+// and every batch is written in order
+template<typename real>
+bool writeObj(const char * filename, const std::vector<real> & xyz, const std::vector<int> & tri,
+              const std::vector<int> & materials, const std::string & header, int precision)
+{
+    FILE * fp = fopen(filename, "wb");
+    if (!fp)
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : save_OBJ() : couldn't open output file " << filename << std::endl;
+        return false;
+    }
+
+    const int chunkSize = 1 << 16;
+    int nv = (int)xyz.size() / 3, nt = (int)tri.size() / 3;
+    int vChunks = (nv + chunkSize - 1) / chunkSize, tChunks = (nt + chunkSize - 1) / chunkSize;
+    int nChunks = vChunks + tChunks;
+    int batch = 4 * Parallel::numThreads();
+
+    bool ok = fwrite(header.data(), 1, header.size(), fp) == header.size();
+    std::vector<std::string> buffers(batch);
+    for(int first=0; first<nChunks && ok; first+=batch)
+    {
+        int last = std::min(nChunks, first + batch);
+        Parallel::forEach(last - first, [&](int i)
         {
-            nFaces++;
-            iss>>n;
-            oss<<"3 "<<n-1<<" ";
-            iss>>n;
-            oss<<n-1<<" ";
-            iss>>n;
-            oss<<n-1<<" "<<std::endl;
+            int c = first + i;
+            buffers[i].clear();
+            if (c < vChunks) writeVertexLines(buffers[i], xyz, c * chunkSize, std::min(nv, (c+1) * chunkSize), precision);
+            else             writeFaceLines(buffers[i], tri, materials, (c - vChunks) * chunkSize, std::min(nt, (c - vChunks + 1) * chunkSize));
+        }, 1);
+        for(int i=0; i<last-first && ok; ++i)
+        {
+            ok = fwrite(buffers[i].data(), 1, buffers[i].size(), fp) == buffers[i].size();
         }
+    }
 
+    if (fclose(fp) != 0 || !ok)
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : save_OBJ() : couldn't write output file " << filename << std::endl;
+        return false;
     }
-    fOff<<nVertices<<" "<<nFaces<<" 0"<<std::endl;
+    return true;
+}
 
-    fOff<<oss.str();
+}
 
-    fObj.close();
-    fOff.close();
+template<typename real>
+bool saveObj(const char              * filename,
+             const std::vector<real> & xyz,
+             const std::vector<int>  & tri,
+             int                       precision)
+{
+    return writeObj(filename, xyz, tri, std::vector<int>(), std::string(), std::max(0, std::min(OBJ_EXACT_PRECISION, precision)));
 }
 
-void offToObj(const char *f1, const char *f2)
+template<typename real>
+bool saveObj(const char               * filename,
+             const std::vector<real>  & xyz,
+             const std::vector<int>   & tri,
+             const std::vector<float> & triangleColors,
+             int                        precision)
+{
+    int nt = (int)tri.size() / 3;
+    if ((int)triangleColors.size() < nt * 3)
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : save_OBJ() : " << triangleColors.size() / 3
+                  << " colors for " << nt << " triangles, saving without colors" << std::endl;
+        return saveObj(filename, xyz, tri, precision);
+    }
+
+    // one material per distinct color (8 bits per channel)
+    std::vector<int> materials(nt);
+    std::vector<unsigned int> colors;
+    std::unordered_map<unsigned int, int> materialOf;
+    for(int tid=0; tid<nt; ++tid)
+    {
+        unsigned int rgb = 0;
+        for(int k=0; k<3; ++k)
+        {
+            float c = std::max(0.f, std::min(1.f, triangleColors[tid*3+k]));
+            rgb = (rgb << 8) | (unsigned int)(c * 255 + 0.5f);
+        }
+        std::unordered_map<unsigned int, int>::iterator it = materialOf.find(rgb);
+        if (it == materialOf.end())
+        {
+            it = materialOf.insert(std::make_pair(rgb, (int)colors.size())).first;
+            colors.push_back(rgb);
+        }
+        materials[tid] = it->second;
+    }
+
+    std::string mtl(filename);
+    size_t dot = mtl.find_last_of('.');
+    size_t slash = mtl.find_last_of("/\\");
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) mtl.erase(dot);
+    mtl += ".mtl";
+
+    std::ofstream fp(mtl.c_str());
+    if (!fp)
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : save_OBJ() : couldn't open output file " << mtl << std::endl;
+        return false;
+    }
+    fp.imbue(std::locale::classic());
+    fp.precision(6);
+    fp.setf(std::ios::fixed, std::ios::floatfield);
+    for(int m=0; m<(int)colors.size(); ++m)
+    {
+        fp << "newmtl mat" << m << "\n"
+           << "Kd " << ((colors[m] >> 16) & 0xff) / 255.0 << " " << ((colors[m] >> 8) & 0xff) / 255.0 << " " << (colors[m] & 0xff) / 255.0 << "\n";
+    }
+    fp.close();
+    if (!fp)
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : save_OBJ() : couldn't write output file " << mtl << std::endl;
+        return false;
+    }
+
+    std::string header = "mtllib " + mtl.substr(slash == std::string::npos ? 0 : slash + 1) + "\n";
+    return writeObj(filename, xyz, tri, materials, header, std::max(0, std::min(OBJ_EXACT_PRECISION, precision)));
+}
+
+template bool loadObj<float> (const char * filename, std::vector<float>  & xyz, std::vector<int> & tri);
+template bool loadObj<double>(const char * filename, std::vector<double> & xyz, std::vector<int> & tri);
+template bool loadOff<float> (const char * filename, std::vector<float>  & xyz, std::vector<int> & tri);
+template bool loadOff<double>(const char * filename, std::vector<double> & xyz, std::vector<int> & tri);
+template bool loadPly<float> (const char * filename, std::vector<float>  & xyz, std::vector<int> & tri);
+template bool loadPly<double>(const char * filename, std::vector<double> & xyz, std::vector<int> & tri);
+template bool loadStl<float> (const char * filename, std::vector<float>  & xyz, std::vector<int> & tri);
+template bool loadStl<double>(const char * filename, std::vector<double> & xyz, std::vector<int> & tri);
+template bool loadPreview<float> (const char * filename, std::vector<float>  & xyz, int maxPoints);
+template bool loadPreview<double>(const char * filename, std::vector<double> & xyz, int maxPoints);
+template bool saveObj<float> (const char * filename, const std::vector<float>  & xyz, const std::vector<int> & tri, int precision);
+template bool saveObj<double>(const char * filename, const std::vector<double> & xyz, const std::vector<int> & tri, int precision);
+template bool saveObj<float> (const char * filename, const std::vector<float>  & xyz, const std::vector<int> & tri, const std::vector<float> & triangleColors, int precision);
+template bool saveObj<double>(const char * filename, const std::vector<double> & xyz, const std::vector<int> & tri, const std::vector<float> & triangleColors, int precision);
+
+namespace
+{
+
+// the lines of a file through a fixed size buffer: only the block being read is in memory
+// (the buffer grows only for a line longer than it)
+class LineReader
+{
+    public:
+
+        LineReader(const char * filename, size_t bufferSize = 1 << 20)
+            : fp(fopen(filename, "rb")), buffer(bufferSize), first(0), last(0), eof(false) {}
+
+        ~LineReader() { if (fp) fclose(fp); }
+
+        inline bool isOpen() const { return fp != nullptr; }
+
+        // the next line, '\n' excluded; false at the end of the file
+        bool next(const char * & begin, const char * & end)
+        {
+            for(;;)
+            {
+                const char * data = buffer.data();
+                const char * eol = (const char *)memchr(data + first, '\n', last - first);
+                if (eol || (eof && first < last))
+                {
+                    begin = data + first;
+                    end   = eol ? eol : data + last;
+                    first = eol ? (size_t)(eol - data) + 1 : last;
+                    return true;
+                }
+                if (eof) return false;
+
+                memmove(buffer.data(), data + first, last - first);
+                last -= first;
+                first = 0;
+                if (last == buffer.size()) buffer.resize(buffer.size() * 2);
+                size_t n = fread(buffer.data() + last, 1, buffer.size() - last, fp);
+                last += n;
+                if (n == 0) eof = true;
+            }
+        }
+
+    private:
+
+        LineReader(const LineReader &);
+        LineReader & operator=(const LineReader &);
+
+        FILE *            fp;
+        std::vector<char> buffer;
+        size_t            first, last; // unread data: [first, last)
+        bool              eof;
+};
+
+// output through a fixed size buffer, written when full
+class BufferedWriter
 {
-    std::ofstream fObj;
-    std::ifstream fOff;
-    std::string line;
-    std::istringstream iss;
-    std::string temp;
+    public:
 
-    int nVertices=-1, nFaces=-1;
+        BufferedWriter(const char * filename, size_t bufferSize = 1 << 20)
+            : fp(fopen(filename, "wb")), buffer(bufferSize), used(0), ok(fp != nullptr) {}
 
-    int numFaces;
-    double n;
+        ~BufferedWriter() { close(); }
 
-    fOff.open(f1);
-    fObj.open(f2);
+        inline bool isOpen() const { return fp != nullptr; }
 
-    while(std::getline(fOff,line))
+        // room for at least n more bytes at the returned pointer, committed by advance()
+        inline char * reserve(size_t n)
+        {
+            if (used + n > buffer.size())
+            {
+                flush();
+                if (n > buffer.size()) buffer.resize(n);
+            }
+            return buffer.data() + used;
+        }
+
+        inline void advance(char * p) { used = p - buffer.data(); }
+
+        inline void write(const char * begin, const char * end)
+        {
+            char * p = reserve(end - begin);
+            memcpy(p, begin, end - begin);
+            advance(p + (end - begin));
+        }
+
+        // overwrites bytes already written (the output is a regular file)
+        void patch(long offset, const char * data, size_t n)
+        {
+            flush();
+            ok = ok && fseek(fp, offset, SEEK_SET) == 0 && fwrite(data, 1, n, fp) == n && fseek(fp, 0, SEEK_END) == 0;
+        }
+
+        void flush()
+        {
+            if (used > 0 && fp) ok = ok && fwrite(buffer.data(), 1, used, fp) == used;
+            used = 0;
+        }
+
+        // false if anything failed
+        bool close()
+        {
+            if (!fp) return false;
+            flush();
+            ok = (fclose(fp) == 0) && ok;
+            fp = nullptr;
+            return ok;
+        }
+
+    private:
+
+        BufferedWriter(const BufferedWriter &);
+        BufferedWriter & operator=(const BufferedWriter &);
+
+        FILE *            fp;
+        std::vector<char> buffer;
+        size_t            used;
+        bool              ok;
+};
+
+// prefix and the first n tokens of [p, end), separated by single spaces, as a line.
+// Nothing is written if there are fewer tokens
+inline bool copyTokens(BufferedWriter & out, const char * prefix, const char * p, const char * end, int n)
+{
+    using namespace FastParse;
+    size_t prefixSize = strlen(prefix);
+    char * o = out.reserve(prefixSize + (end - p) + 1);
+    memcpy(o, prefix, prefixSize);
+    o += prefixSize;
+    for(int i=0; i<n; ++i)
     {
-        iss=std::istringstream(line);
-        iss>>temp;
+        p = skipSpaces(p, end);
+        const char * last = skipToken(p, end);
+        if (last == p) return false;
+        if (i > 0) *o++ = ' ';
+        memcpy(o, p, last - p);
+        o += last - p;
+        p = last;
+    }
+    *o++ = '\n';
+    out.advance(o);
+    return true;
+}
+
+// room for the counts, written when they are known
+const char offHeader[] = "OFF\n                                        \n";
+
+bool conversionFailed(const char * function, const char * message, const char * filename)
+{
+    std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : " << function << "() : " << message << " " << filename << std::endl;
+    return false;
+}
+
+}
+
+// one pass over f1: the OFF header is reserved and the counts are written into it at the end.
+// Vertices are copied as text, polygons are kept as they are (indices made 0-based)
+bool objToOff(const char *f1, const char *f2)
+{
+    using namespace FastParse;
+    LineReader in(f1);
+    if (!in.isOpen()) return conversionFailed("objToOff", "couldn't open input file", f1);
+    BufferedWriter out(f2);
+    if (!out.isOpen()) return conversionFailed("objToOff", "couldn't open output file", f2);
 
-        if((temp.compare("OFF")==0)||(temp[0]=='#')) continue;
+    // the vertices must come before the faces in OFF: the faces are written to a temporary
+    // file first, then appended (both through bounded buffers)
+    std::string facesFile = std::string(f2) + ".faces";
+    BufferedWriter faces(facesFile.c_str());
+    if (!faces.isOpen()) return conversionFailed("objToOff", "couldn't open temporary file", facesFile.c_str());
 
-        if((nVertices==-1)||(nFaces==-1))
+    out.write(offHeader, offHeader + sizeof(offHeader) - 1);
+    long long nVertices = 0, nFaces = 0, badLines = 0;
+    const char * p, * end;
+    std::vector<long long> polygon;
+    while (in.next(p, end))
+    {
+        p = skipSpaces(p, end);
+        if (end - p > 1 && p[0] == 'v' && isSpace(p[1]))
         {
-            nVertices=atoi(temp.c_str());
-            iss>>nFaces;
-            break;
+            if (copyTokens(out, "", p + 1, end, 3)) ++nVertices;
+            else                                ++badLines;
+        }
+        else if (end - p > 1 && p[0] == 'f' && isSpace(p[1]))
+        {
+            polygon.clear();
+            const char * q = skipSpaces(p + 1, end);
+            while (q && q < end)
+            {
+                int id;
+                q = parseInt(q, end, id);
+                if (!q || id == 0 || (id < 0 && -id > nVertices)) q = nullptr;
+                else
+                {
+                    polygon.push_back(id > 0 ? id - 1 : nVertices + id);
+                    q = skipSpaces(skipToken(q, end), end); // /vt/vn
+                }
+            }
+            if (!q || polygon.size() < 3)
+            {
+                ++badLines;
+                continue;
+            }
+            char * o = faces.reserve(24 * (polygon.size() + 1));
+            o = writeUnsigned(o, polygon.size());
+            for(int i=0; i<(int)polygon.size(); ++i)
+            {
+                *o++ = ' ';
+                o = writeUnsigned(o, polygon[i]);
+            }
+            *o++ = '\n';
+            faces.advance(o);
+            ++nFaces;
         }
     }
+    bool ok = faces.close();
+
+    FILE * fp = ok ? fopen(facesFile.c_str(), "rb") : nullptr;
+    std::vector<char> block(1 << 20);
+    for(size_t n; fp && (n = fread(block.data(), 1, block.size(), fp)) > 0; ) out.write(block.data(), block.data() + n);
+    if (fp) fclose(fp);
+    remove(facesFile.c_str());
 
-    //std::cout<<nVertices<<" "<<nFaces<<std::endl;
-    for(int i=0;i<nVertices;++i)
+    char counts[64];
+    int n = snprintf(counts, sizeof(counts), "%lld %lld 0", nVertices, nFaces);
+    out.patch(4, counts, n);
+    if (!ok || !fp || !out.close()) return conversionFailed("objToOff", "couldn't write output file", f2);
+
+    if (badLines > 0)
     {
-        getline(fOff,line);
-        iss=std::istringstream(line);
-        getline(iss,temp);
-        fObj<<"v "<<temp<<std::endl;
+        std::cerr << "WARNING : " << __FILE__ << ", line " << __LINE__ << " : objToOff() : "
+                  << badLines << " malformed lines skipped in " << f1 << std::endl;
     }
+    return true;
+}
+
+// one pass, the counts are in the header. Vertices are copied as text, what follows the
+// coordinates or the indices on a line (colors) is dropped
+bool offToObj(const char *f1, const char *f2)
+{
+    using namespace FastParse;
+    LineReader in(f1);
+    if (!in.isOpen()) return conversionFailed("offToObj", "couldn't open input file", f1);
+    BufferedWriter out(f2);
+    if (!out.isOpen()) return conversionFailed("offToObj", "couldn't open output file", f2);
 
-    for(int i=0;i<nFaces;++i)
+    const char * p, * end;
+    long long nVertices = -1, nFaces = -1, badLines = 0;
+    bool header = false;
+    while (nFaces < 0 && in.next(p, end))
     {
-        getline(fOff,line);
-        iss=std::istringstream(line);
+        p = skipSpaces(p, end);
+        if (p == end || *p == '#' || *p == '\r') continue;
+        if (!header && ((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z'))) // OFF, COFF, NOFF...
+        {
+            header = true;
+            p = skipSpaces(skipToken(p, end), end);
+            if (p == end || *p == '\r') continue;
+        }
+        int nv, nf;
+        p = parseInt(p, end, nv);
+        if (p) p = parseInt(skipSpaces(p, end), end, nf);
+        if (!p || nv < 0 || nf < 0) return conversionFailed("offToObj", "no vertex and face counts in", f1);
+        nVertices = nv;
+        nFaces = nf;
+    }
+    if (nFaces < 0) return conversionFailed("offToObj", "no vertex and face counts in", f1);
 
-        iss>>numFaces;
-        fObj<<"f";
-        for(int j=0;j<numFaces;++j)
+    for(long long i=0; i<nVertices + nFaces && in.next(p, end); )
+    {
+        p = skipSpaces(p, end);
+        if (p == end || *p == '#' || *p == '\r') continue;
+        if (i < nVertices)
+        {
+            if (!copyTokens(out, "v ", p, end, 3)) ++badLines;
+        }
+        else
         {
-            iss>>n;
-            fObj<<" "<<n+1;
+            int n = 0;
+            p = parseInt(p, end, n);
+            char * o = out.reserve(24 * ((p && n > 0 ? n : 0) + 1));
+            char * start = o;
+            *o++ = 'f';
+            for(int j=0; p && j<n; ++j)
+            {
+                int id;
+                p = parseInt(skipSpaces(p, end), end, id);
+                if (!p || id < 0) p = nullptr;
+                else
+                {
+                    *o++ = ' ';
+                    o = writeUnsigned(o, (unsigned long long)id + 1);
+                }
+            }
+            *o++ = '\n';
+            if (p && n >= 3) out.advance(o);
+            else             out.advance(start), ++badLines;
         }
-        fObj<<std::endl;
+        ++i;
     }
 
-    fObj.close();
-    fOff.close();
+    if (!out.close()) return conversionFailed("offToObj", "couldn't write output file", f2);
+    if (badLines > 0)
+    {
+        std::cerr << "WARNING : " << __FILE__ << ", line " << __LINE__ << " : offToObj() : "
+                  << badLines << " malformed lines in " << f1 << std::endl;
+    }
+    return true;
+}
+
+// the conversions are independent: they run on the thread pool, each with its own buffers
+int objToOff(const std::vector<std::string> & objFiles, const std::vector<std::string> & offFiles)
+{
+    std::atomic<int> done(0);
+    Parallel::forEach((int)std::min(objFiles.size(), offFiles.size()), [&](int i)
+    {
+        if (objToOff(objFiles[i].c_str(), offFiles[i].c_str())) ++done;
+    }, 1);
+    return done;
+}
+
+int offToObj(const std::vector<std::string> & offFiles, const std::vector<std::string> & objFiles)
+{
+    std::atomic<int> done(0);
+    Parallel::forEach((int)std::min(offFiles.size(), objFiles.size()), [&](int i)
+    {
+        if (offToObj(offFiles[i].c_str(), objFiles[i].c_str())) ++done;
+    }, 1);
+    return done;
 }
@@ -11,20 +11,92 @@
 #include <fstream>
 #include <sstream>
 #include <stdlib.h>
+#include <string>
 
 
+// The loaders report to the LoadProgress installed on the calling thread, if any, and stop
+// when it is canceled (load_progress.h). They append to xyz and tri and return true; false
+// (with a message on cerr) if the file cannot be read or the load is canceled, and then
+// xyz and tri are left as they were
+
 // OBJ FILES
 //
-void loadObj(const char          * filename,
-              std::vector<double> & xyz,
-              std::vector<int>    & tri);
+// real: float or double (instantiated in load_save_trimesh.cpp), the coordinates
+// are parsed straight into it
+template<typename real>
+bool loadObj(const char        * filename,
+             std::vector<real> & xyz,
+             std::vector<int>  & tri);
+
+// precision: digits after the decimal point of the coordinates (at most 16), or
+// OBJ_EXACT_PRECISION: 17 significant digits (%.17g), every coordinate reads back the same
+const int OBJ_EXACT_PRECISION = 17;
+//
+// false (and a message on cerr) if the file (or the .mtl) cannot be written
+template<typename real>
+bool saveObj(const char              * filename,
+             const std::vector<real> & xyz,
+             const std::vector<int>  & tri,
+             int                       precision = 6);
+
+// triangleColors: rgb in [0,1], 3 per triangle. Every distinct color is a material of
+// filename.mtl (its extension replaced), written next to it
+template<typename real>
+bool saveObj(const char               * filename,
+             const std::vector<real>  & xyz,
+             const std::vector<int>   & tri,
+             const std::vector<float> & triangleColors,
+             int                        precision = 6);
+
+// OFF FILES
+//
+// polygons are split in triangle fans
+template<typename real>
+bool loadOff(const char        * filename,
+             std::vector<real> & xyz,
+             std::vector<int>  & tri);
+
+// PLY FILES
+//
+// ascii, binary little and big endian. Only x, y, z of the vertices and the vertex_indices
+// (or vertex_index) lists of the faces are read; polygons are split in triangle fans
+template<typename real>
+bool loadPly(const char        * filename,
+             std::vector<real> & xyz,
+             std::vector<int>  & tri);
+
+// STL FILES
+//
+// binary (told apart by its size) and ascii. Triangles do not share vertices, every facet
+// has three of its own: weld them with weldVertices (weld.h)
+template<typename real>
+bool loadStl(const char        * filename,
+             std::vector<real> & xyz,
+             std::vector<int>  & tri);
+
+// PREVIEW
+//
+// at most maxPoints vertices spread over the mesh in filename (any of the formats above,
+// .tmb or .tmz), read from a sample of the file of a few MB whatever its size: a point
+// cloud to show while the whole mesh loads. xyz is replaced. False if there is nothing to
+// show (unknown format, unreadable file, PLY vertices with list properties)
+template<typename real>
+bool loadPreview(const char        * filename,
+                 std::vector<real> & xyz,
+                 int                 maxPoints = 65536);
+
+// CONVERSIONS
+//
+// streamed through fixed size buffers: the memory used does not depend on the size of
+// the files. False (with an error on std::cerr) if a file cannot be read or written
+bool objToOff(const char* f1, const char* f2);
 
-void saveObj(const char          * filename,
-             const std::vector<double> & xyz,
-             const std::vector<int>    & tri);
+bool offToObj(const char* f1, const char* f2);
 
-void objToOff(const char* f1, const char* f2);
+// objFiles[i] <-> offFiles[i], several files at a time on the thread pool.
+// Returns the number of files converted
+int objToOff(const std::vector<std::string> & objFiles, const std::vector<std::string> & offFiles);
 
-void offToObj(const char* f1, const char* f2);
+int offToObj(const std::vector<std::string> & offFiles, const std::vector<std::string> & objFiles);
 
 #endif // OLDLOAD_SAVE_TRIMESH_H
@@ -0,0 +1,79 @@
+#include "mapped_file.h"
+
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAPPED_FILE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : opened(false), ptr(nullptr), length(0), mapped(false) {}
+
+MappedFile::MappedFile(const char * filename) : opened(false), ptr(nullptr), length(0), mapped(false)
+{
+    open(filename);
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const char * filename)
+{
+    close();
+
+    #ifdef MAPPED_FILE_MMAP
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    length = (size_t)st.st_size;
+    if (length > 0)
+    {
+        void * p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED)
+        {
+            madvise(p, length, MADV_SEQUENTIAL);
+            ptr    = (const char *)p;
+            mapped = true;
+        }
+    }
+    ::close(fd);
+    if (mapped || length == 0)
+    {
+        opened = true;
+        return true;
+    }
+    #endif
+
+    // no mmap (or it failed): plain read
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) return false;
+    length = (size_t)file.tellg();
+    buffer.resize(length);
+    file.seekg(0);
+    if (length > 0 && !file.read(&buffer[0], length)) return false;
+    ptr    = buffer.empty() ? nullptr : &buffer[0];
+    opened = true;
+    return true;
+}
+
+void MappedFile::close()
+{
+    #ifdef MAPPED_FILE_MMAP
+    if (mapped) munmap((void *)ptr, length);
+    #endif
+    std::vector<char>().swap(buffer);
+    opened = false;
+    mapped = false;
+    ptr    = nullptr;
+    length = 0;
+}
@@ -0,0 +1,40 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+#include <vector>
+
+/**
+ * @brief Read-only view of a whole file in memory.
+ *
+ * The file is memory mapped where mmap is available (pages are loaded on demand by the
+ * OS, no copy), elsewhere it is read into a buffer. The data is not null terminated.
+ */
+class MappedFile
+{
+    public:
+
+        MappedFile();
+        MappedFile(const char * filename);
+        ~MappedFile();
+
+        bool open(const char * filename);
+        void close();
+
+        inline bool         isOpen() const { return opened; }
+        inline const char * data()   const { return ptr;    }
+        inline size_t       size()   const { return length; }
+
+    private:
+
+        MappedFile(const MappedFile &);
+        MappedFile & operator=(const MappedFile &);
+
+        bool              opened;
+        const char      * ptr;
+        size_t            length;
+        bool              mapped;
+        std::vector<char> buffer; // when the file is not mapped
+};
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,674 @@
+#include "mesh_archive.h"
+#include "load_progress.h"
+#include "mapped_file.h"
+#include "parallel.h"
+
+#include <float.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+
+const char magic[8] = { 'T', 'R', 'I', 'M', 'E', 'S', 'H', 'Z' };
+
+// header: magic, version, bits, #vertices, #triangles, min x y z, step, reserved.
+// Then one entry (offset, size) per block: the vertex blocks, then the triangle blocks
+enum { HEADER_SIZE = 64, ENTRY_SIZE = 16 };
+
+// residuals are coded as their bit length (0 to 64, rANS) followed by the bits below the
+// leading one (raw)
+enum { ALPHABET = 65, PROB_BITS = 12, PROB_SCALE = 1 << PROB_BITS };
+const uint32_t RANS_L = 1u << 23; // the state stays in [RANS_L, 256 * RANS_L)
+
+enum Predictor { PREVIOUS = 0, LINEAR = 1 };
+
+// vertex blocks decoded for a preview, at most
+enum { PREVIEW_BLOCKS = 8 };
+
+inline void put32(std::vector<uint8_t> & out, uint32_t v)
+{
+    for(int i=0; i<4; ++i) out.push_back((uint8_t)(v >> (8*i)));
+}
+
+inline void put64(std::vector<uint8_t> & out, uint64_t v)
+{
+    for(int i=0; i<8; ++i) out.push_back((uint8_t)(v >> (8*i)));
+}
+
+inline void putDouble(std::vector<uint8_t> & out, double d)
+{
+    uint64_t v;
+    memcpy(&v, &d, sizeof(v));
+    put64(out, v);
+}
+
+// bounds checked little endian reads, ok is false after reading past the end
+struct ByteReader
+{
+    const uint8_t * p;
+    const uint8_t * end;
+    bool            ok;
+
+    ByteReader(const uint8_t * begin, const uint8_t * end) : p(begin), end(end), ok(true) {}
+
+    uint64_t get(int bytes)
+    {
+        if (end - p < bytes)
+        {
+            ok = false;
+            p = end;
+            return 0;
+        }
+        uint64_t v = 0;
+        for(int i=0; i<bytes; ++i) v |= (uint64_t)p[i] << (8*i);
+        p += bytes;
+        return v;
+    }
+
+    double getDouble()
+    {
+        uint64_t v = get(8);
+        double d;
+        memcpy(&d, &v, sizeof(d));
+        return d;
+    }
+
+    const uint8_t * skip(size_t bytes)
+    {
+        if ((size_t)(end - p) < bytes)
+        {
+            ok = false;
+            p = end;
+            return nullptr;
+        }
+        const uint8_t * begin = p;
+        p += bytes;
+        return begin;
+    }
+};
+
+inline uint64_t zigzag(int64_t v)    { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+inline int64_t  unzigzag(uint64_t u) { return (int64_t)(u >> 1) ^ -(int64_t)(u & 1); }
+
+inline int bitLength(uint64_t u)
+{
+    int n = 0;
+    if (u >> 32) { n += 32; u >>= 32; }
+    if (u >> 16) { n += 16; u >>= 16; }
+    if (u >> 8)  { n += 8;  u >>= 8;  }
+    while (u) { ++n; u >>= 1; }
+    return n;
+}
+
+class BitWriter
+{
+    public:
+
+        explicit BitWriter(std::vector<uint8_t> & out) : out(out), acc(0), count(0) {}
+
+        void put(uint64_t v, int n)
+        {
+            if (n > 32)
+            {
+                put(v & 0xffffffffu, 32);
+                put(v >> 32, n - 32);
+                return;
+            }
+            acc |= (v & ((1ull << n) - 1)) << count;
+            count += n;
+            for(; count >= 8; count -= 8, acc >>= 8) out.push_back((uint8_t)acc);
+        }
+
+        void flush()
+        {
+            if (count > 0) out.push_back((uint8_t)acc);
+            acc = 0;
+            count = 0;
+        }
+
+    private:
+
+        std::vector<uint8_t> & out;
+        uint64_t               acc;
+        int                    count;
+};
+
+class BitReader
+{
+    public:
+
+        BitReader(const uint8_t * begin, const uint8_t * end) : p(begin), end(end), acc(0), count(0), overrun(false) {}
+
+        uint64_t get(int n)
+        {
+            if (n > 32)
+            {
+                uint64_t low = get(32);
+                return low | (get(n - 32) << 32);
+            }
+            for(; count < n; count += 8)
+            {
+                if (p < end) acc |= (uint64_t)*p++ << count;
+                else         overrun = true;
+            }
+            uint64_t v = acc & ((1ull << n) - 1);
+            acc >>= n;
+            count -= n;
+            return v;
+        }
+
+        bool ok() const { return !overrun; }
+
+    private:
+
+        const uint8_t * p;
+        const uint8_t * end;
+        uint64_t        acc;
+        int             count;
+        bool            overrun;
+};
+
+// the frequencies of the bit lengths of one kind of residual, summing to PROB_SCALE
+// (all 0 if there are none)
+struct Model
+{
+    uint16_t freq[ALPHABET];
+    uint16_t start[ALPHABET];
+    uint8_t  symbol[PROB_SCALE]; // decoding: slot -> bit length
+
+    void normalize(const uint32_t counts[ALPHABET])
+    {
+        uint64_t total = 0;
+        for(int s=0; s<ALPHABET; ++s) total += counts[s];
+        int sum = 0, largest = 0;
+        for(int s=0; s<ALPHABET; ++s)
+        {
+            freq[s] = (counts[s] == 0) ? 0 : (uint16_t)std::max<uint64_t>(1, (uint64_t)counts[s] * PROB_SCALE / total);
+            sum += freq[s];
+            if (counts[s] > counts[largest]) largest = s;
+        }
+        if (total > 0 && sum < PROB_SCALE) freq[largest] += PROB_SCALE - sum;
+        while (sum > PROB_SCALE) // rounding up the rare symbols overshot: take from the common ones
+        {
+            int s = (int)(std::max_element(freq, freq + ALPHABET) - freq);
+            int cut = std::min(sum - PROB_SCALE, freq[s] - 1);
+            freq[s] -= cut;
+            sum -= cut;
+        }
+        buildStarts();
+    }
+
+    // false if the frequencies do not sum to PROB_SCALE (nor are all 0)
+    bool buildStarts()
+    {
+        int sum = 0;
+        for(int s=0; s<ALPHABET; ++s)
+        {
+            start[s] = (uint16_t)std::min(sum, (int)PROB_SCALE);
+            sum += freq[s];
+        }
+        return sum == PROB_SCALE || sum == 0;
+    }
+
+    void buildSymbols()
+    {
+        std::fill(symbol, symbol + PROB_SCALE, (uint8_t)0);
+        for(int s=0; s<ALPHABET; ++s)
+        {
+            std::fill(symbol + start[s], symbol + start[s] + freq[s], (uint8_t)s);
+        }
+    }
+};
+
+// residuals of different kinds get their own model: x, y and z of the vertices, first and
+// other corners of the triangles
+inline int numKinds(bool triangles)       { return triangles ? 2 : 3; }
+inline int kindOf(int i, bool triangles)  { return triangles ? (i % 3 != 0) : i % 3; }
+
+// the residuals of a block into out: models, rANS coded lengths, raw bits
+void encodeResiduals(const std::vector<uint64_t> & residuals, bool triangles, std::vector<uint8_t> & out)
+{
+    int n = (int)residuals.size();
+    std::vector<uint8_t> lengths(n);
+    uint32_t counts[3][ALPHABET] = {};
+    std::vector<uint8_t> raw;
+    BitWriter bits(raw);
+    for(int i=0; i<n; ++i)
+    {
+        int length = bitLength(residuals[i]);
+        lengths[i] = (uint8_t)length;
+        ++counts[kindOf(i, triangles)][length];
+        if (length > 1) bits.put(residuals[i], length - 1); // the leading one is implied
+    }
+    bits.flush();
+
+    Model models[3];
+    for(int m=0; m<numKinds(triangles); ++m)
+    {
+        models[m].normalize(counts[m]);
+        for(int s=0; s<ALPHABET; ++s) out.push_back((uint8_t)models[m].freq[s]), out.push_back((uint8_t)(models[m].freq[s] >> 8));
+    }
+
+    // rANS codes backwards: the bytes come out reversed, the final state last
+    std::vector<uint8_t> coded;
+    uint32_t x = RANS_L;
+    for(int i=n-1; i>=0; --i)
+    {
+        const Model & model = models[kindOf(i, triangles)];
+        uint32_t f = model.freq[lengths[i]];
+        uint32_t xMax = ((RANS_L >> PROB_BITS) << 8) * f;
+        for(; x >= xMax; x >>= 8) coded.push_back((uint8_t)x);
+        x = ((x / f) << PROB_BITS) + (x % f) + model.start[lengths[i]];
+    }
+    for(int i=3; i>=0; --i) coded.push_back((uint8_t)(x >> (8*i)));
+    std::reverse(coded.begin(), coded.end());
+
+    put32(out, (uint32_t)coded.size());
+    out.insert(out.end(), coded.begin(), coded.end());
+    put32(out, (uint32_t)raw.size());
+    out.insert(out.end(), raw.begin(), raw.end());
+}
+
+// the inverse of encodeResiduals, f(i, residual) in order. False if the block is corrupted
+template<typename F>
+bool decodeResiduals(ByteReader & in, int n, bool triangles, F f)
+{
+    Model models[3];
+    for(int m=0; m<numKinds(triangles); ++m)
+    {
+        for(int s=0; s<ALPHABET; ++s) models[m].freq[s] = (uint16_t)in.get(2);
+        if (!models[m].buildStarts()) return false;
+        models[m].buildSymbols();
+    }
+    size_t codedSize = (size_t)in.get(4);
+    const uint8_t * coded = in.skip(codedSize);
+    size_t rawSize = (size_t)in.get(4);
+    const uint8_t * raw = in.skip(rawSize);
+    if (!in.ok || codedSize < 4) return false;
+
+    const uint8_t * p = coded + 4, * end = coded + codedSize;
+    uint32_t x = (uint32_t)coded[0] | (uint32_t)coded[1] << 8 | (uint32_t)coded[2] << 16 | (uint32_t)coded[3] << 24;
+    BitReader bits(raw, raw + rawSize);
+    for(int i=0; i<n; ++i)
+    {
+        const Model & model = models[kindOf(i, triangles)];
+        uint32_t slot = x & (PROB_SCALE - 1);
+        int length = model.symbol[slot];
+        if (model.freq[length] == 0) return false;
+        x = model.freq[length] * (x >> PROB_BITS) + slot - model.start[length];
+        for(; x < RANS_L; ++p)
+        {
+            if (p == end) return false;
+            x = (x << 8) | *p;
+        }
+        uint64_t residual = (length <= 1) ? (uint64_t)length : (1ull << (length - 1)) | bits.get(length - 1);
+        f(i, residual);
+    }
+    return x == RANS_L && p == end && bits.ok();
+}
+
+inline int64_t predict(const int64_t * q, int i, int predictor)
+{
+    if (i < 3) return 0;
+    if (i < 6 || predictor == PREVIOUS) return q[i-3];
+    return 2 * q[i-3] - q[i-6];
+}
+
+// quantized coordinates of a block (first vertex predicted from 0): both predictors are
+// tried, the smaller result is kept
+std::vector<uint8_t> encodeVertices(const int64_t * q, int n)
+{
+    std::vector<uint8_t> best;
+    for(int predictor=PREVIOUS; predictor<=LINEAR; ++predictor)
+    {
+        std::vector<uint64_t> residuals(n * 3);
+        for(int i=0; i<n*3; ++i) residuals[i] = zigzag(q[i] - predict(q, i, predictor));
+        std::vector<uint8_t> out(1, (uint8_t)predictor);
+        encodeResiduals(residuals, false, out);
+        if (best.empty() || out.size() < best.size()) best.swap(out);
+    }
+    return best;
+}
+
+std::vector<uint8_t> encodeTriangles(const int * t, int n)
+{
+    std::vector<uint64_t> residuals(n * 3);
+    for(int tid=0; tid<n; ++tid)
+    {
+        const int * c = t + tid * 3;
+        residuals[tid*3]   = zigzag((int64_t)c[0] - (tid > 0 ? c[-3] : 0));
+        residuals[tid*3+1] = zigzag((int64_t)c[1] - c[0]);
+        residuals[tid*3+2] = zigzag((int64_t)c[2] - c[0]);
+    }
+    std::vector<uint8_t> out(1, 0);
+    encodeResiduals(residuals, true, out);
+    return out;
+}
+
+template<typename real>
+bool decodeVertices(ByteReader in, int n, int bits, const double min[3], double step, real * xyz)
+{
+    int predictor = (int)in.get(1);
+    if (predictor != PREVIOUS && predictor != LINEAR) return false;
+    std::vector<int64_t> q(n * 3);
+    int64_t top = (1ll << bits) - 1;
+    bool inside = true;
+    bool ok = decodeResiduals(in, n * 3, false, [&](int i, uint64_t residual)
+    {
+        if (!inside) return; // corrupted, and the predictions would overflow
+        q[i] = (int64_t)((uint64_t)predict(q.data(), i, predictor) + (uint64_t)unzigzag(residual));
+        inside = q[i] >= 0 && q[i] <= top;
+        xyz[i] = (real)(min[i % 3] + (double)q[i] * step);
+    });
+    return ok && inside;
+}
+
+bool decodeTriangles(ByteReader in, int n, int numVertices, int * tri)
+{
+    in.get(1);
+    bool inside = true;
+    bool ok = decodeResiduals(in, n * 3, true, [&](int i, uint64_t residual)
+    {
+        int64_t base = (i % 3 != 0) ? tri[i - i % 3] : (i > 0 ? tri[i-3] : 0);
+        int64_t vid = (int64_t)((uint64_t)base + (uint64_t)unzigzag(residual));
+        inside = inside && vid >= 0 && vid < numVertices;
+        tri[i] = inside ? (int)vid : 0;
+    });
+    return ok && inside;
+}
+
+inline int numBlocks(int n)
+{
+    return (n + MeshArchive::BLOCK_SIZE - 1) / MeshArchive::BLOCK_SIZE;
+}
+
+// the smallest block encodeVertices (encodeTriangles) can write: predictor, models, the
+// sizes of the coded and raw bytes and the final rANS state
+inline uint64_t minBlockSize(bool triangles)
+{
+    return 1 + numKinds(triangles) * ALPHABET * 2 + 4 + 4 + 4;
+}
+
+struct ArchiveHeader
+{
+    int                           bits;
+    int                           nv;
+    int                           nt;
+    double                        min[3];
+    double                        step;
+    int                           vertexBlocks;
+    int                           triangleBlocks;
+    std::vector<const uint8_t *>  blockBegin;  // the vertex blocks, then the triangle blocks
+    std::vector<const uint8_t *>  blockEnd;
+};
+
+// the header and the block table of the archive mapped in file. False (with an error on
+// std::cerr, from function) if it cannot be read or is not valid
+bool readHeader(const MappedFile & file, const char * filename, const char * function, ArchiveHeader & archive)
+{
+    if (!file.isOpen())
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : " << function << "() : couldn't open input file " << filename << std::endl;
+        return false;
+    }
+
+    const uint8_t * data = (const uint8_t *)file.data();
+    ByteReader header(data, data + file.size());
+    if (file.size() < HEADER_SIZE || memcmp(data, magic, sizeof(magic)) != 0)
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : " << function << "() : " << filename << " is not a .tmz file" << std::endl;
+        return false;
+    }
+    header.skip(sizeof(magic));
+    uint32_t version = (uint32_t)header.get(4);
+    if (version != MeshArchive::VERSION)
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : " << function << "() : " << filename << " has version "
+                  << version << ", version " << MeshArchive::VERSION << " is supported" << std::endl;
+        return false;
+    }
+    int bits = (int)header.get(4);
+    uint32_t nv = (uint32_t)header.get(4), nt = (uint32_t)header.get(4);
+    for(int k=0; k<3; ++k) archive.min[k] = header.getDouble();
+    archive.step = header.getDouble();
+    header.get(8);
+
+    const uint32_t maxElements = 0x7fffffff / 3;
+    bool valid = bits >= 1 && bits <= MeshArchive::MAX_BITS && nv <= maxElements && nt <= maxElements;
+    archive.bits = bits;
+    archive.nv = (int)nv;
+    archive.nt = (int)nt;
+    archive.vertexBlocks   = valid ? numBlocks((int)nv) : 0;
+    archive.triangleBlocks = valid ? numBlocks((int)nt) : 0;
+    archive.blockBegin.resize(archive.vertexBlocks + archive.triangleBlocks);
+    archive.blockEnd.resize(archive.vertexBlocks + archive.triangleBlocks);
+
+    // the blocks cannot be more than the bytes after the table hold: nv and nt are checked
+    // against the size of the file before the vertices and triangles are allocated
+    uint64_t payload = file.size() - std::min<uint64_t>(file.size(), HEADER_SIZE + (uint64_t)archive.blockBegin.size() * ENTRY_SIZE);
+    for(int b=0; b<(int)archive.blockBegin.size() && valid; ++b)
+    {
+        uint64_t offset = header.get(8), size = header.get(8);
+        valid = header.ok && offset <= file.size() && size <= file.size() - offset &&
+                size >= minBlockSize(b >= archive.vertexBlocks) && size <= payload;
+        if (valid)
+        {
+            archive.blockBegin[b] = data + offset, archive.blockEnd[b] = data + offset + size;
+            payload -= size;
+        }
+    }
+    if (!valid)
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : " << function << "() : " << filename << " is truncated or corrupted" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}
+
+template<typename real>
+bool saveArchive(const char              * filename,
+                 const std::vector<real> & xyz,
+                 const std::vector<int>  & tri,
+                 int                       bits)
+{
+    if (bits < 1 || bits > MeshArchive::MAX_BITS)
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : saveArchive() : " << bits << " bits per coordinate, 1 to "
+                  << MeshArchive::MAX_BITS << " are supported" << std::endl;
+        return false;
+    }
+
+    int nv = (int)(xyz.size() / 3), nt = (int)(tri.size() / 3);
+    double min[3] = { DBL_MAX, DBL_MAX, DBL_MAX }, max[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+    bool finite = true;
+    for(int i=0; i<nv*3; ++i)
+    {
+        min[i%3] = std::min(min[i%3], (double)xyz[i]);
+        max[i%3] = std::max(max[i%3], (double)xyz[i]);
+        finite = finite && std::isfinite((double)xyz[i]);
+    }
+    if (nv == 0) min[0] = min[1] = min[2] = max[0] = max[1] = max[2] = 0;
+    double extent = std::max(max[0] - min[0], std::max(max[1] - min[1], max[2] - min[2]));
+    if (!finite || !std::isfinite(extent))
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : saveArchive() : the coordinates are not finite" << std::endl;
+        return false;
+    }
+    int64_t top = (1ll << bits) - 1;
+    double step = extent / top;
+
+    // the same grid step on every axis: the error does not depend on the direction
+    std::vector<int64_t> q(nv * 3);
+    Parallel::forChunks(nv * 3, [&](int begin, int end)
+    {
+        for(int i=begin; i<end; ++i)
+        {
+            int64_t v = (step > 0) ? (int64_t)std::floor(((double)xyz[i] - min[i%3]) / step + 0.5) : 0;
+            q[i] = std::max<int64_t>(0, std::min(top, v));
+        }
+    }, 65536);
+
+    int vertexBlocks = numBlocks(nv), triangleBlocks = numBlocks(nt);
+    std::vector< std::vector<uint8_t> > blocks(vertexBlocks + triangleBlocks);
+    Parallel::forEach((int)blocks.size(), [&](int b)
+    {
+        if (b < vertexBlocks)
+        {
+            int first = b * MeshArchive::BLOCK_SIZE, n = std::min((int)MeshArchive::BLOCK_SIZE, nv - first);
+            blocks[b] = encodeVertices(q.data() + first * 3, n);
+        }
+        else
+        {
+            int first = (b - vertexBlocks) * MeshArchive::BLOCK_SIZE, n = std::min((int)MeshArchive::BLOCK_SIZE, nt - first);
+            blocks[b] = encodeTriangles(tri.data() + first * 3, n);
+        }
+    }, 1);
+
+    std::vector<uint8_t> header(magic, magic + sizeof(magic));
+    put32(header, MeshArchive::VERSION);
+    put32(header, (uint32_t)bits);
+    put32(header, (uint32_t)nv);
+    put32(header, (uint32_t)nt);
+    for(int k=0; k<3; ++k) putDouble(header, min[k]);
+    putDouble(header, step);
+    put64(header, 0);
+    uint64_t offset = HEADER_SIZE + (uint64_t)blocks.size() * ENTRY_SIZE;
+    for(int b=0; b<(int)blocks.size(); ++b)
+    {
+        put64(header, offset);
+        put64(header, blocks[b].size());
+        offset += blocks[b].size();
+    }
+
+    FILE * fp = fopen(filename, "wb");
+    if (!fp)
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : saveArchive() : couldn't open output file " << filename << std::endl;
+        return false;
+    }
+    bool ok = fwrite(header.data(), 1, header.size(), fp) == header.size();
+    for(int b=0; b<(int)blocks.size() && ok; ++b) ok = fwrite(blocks[b].data(), 1, blocks[b].size(), fp) == blocks[b].size();
+    if (fclose(fp) != 0 || !ok)
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : saveArchive() : couldn't write output file " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+template<typename real>
+bool loadArchive(const char        * filename,
+                 std::vector<real> & xyz,
+                 std::vector<int>  & tri)
+{
+    MappedFile file(filename);
+    ArchiveHeader header;
+    if (!readHeader(file, filename, "loadArchive", header)) return false;
+
+    // on cancel the blocks not started yet are skipped, and nothing is reported
+    LoadProgress * progress = LoadProgress::current();
+    std::atomic<int> blocksDone(0);
+    int nBlocks = (int)header.blockBegin.size();
+
+    // appended: the ids of the archive are shifted by the vertices already in xyz
+    size_t xyzBase = xyz.size(), triBase = tri.size();
+    if (xyzBase / 3 + header.nv > 0x7fffffff)
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : loadArchive() : too many vertices appending " << filename << std::endl;
+        return false;
+    }
+    int base = (int)(xyzBase / 3);
+    xyz.resize(xyzBase + (size_t)header.nv * 3);
+    tri.resize(triBase + (size_t)header.nt * 3);
+    std::vector<char> decoded(nBlocks);
+    Parallel::forEach(nBlocks, [&](int b)
+    {
+        if (progress && progress->isCanceled()) return;
+        ByteReader in(header.blockBegin[b], header.blockEnd[b]);
+        if (b < header.vertexBlocks)
+        {
+            int first = b * MeshArchive::BLOCK_SIZE, n = std::min((int)MeshArchive::BLOCK_SIZE, header.nv - first);
+            decoded[b] = decodeVertices(in, n, header.bits, header.min, header.step, xyz.data() + xyzBase + (size_t)first * 3);
+        }
+        else
+        {
+            int first = (b - header.vertexBlocks) * MeshArchive::BLOCK_SIZE, n = std::min((int)MeshArchive::BLOCK_SIZE, header.nt - first);
+            decoded[b] = decodeTriangles(in, n, header.nv, tri.data() + triBase + (size_t)first * 3);
+        }
+        if (progress) progress->advance((double)++blocksDone / nBlocks);
+    }, 1);
+
+    if (progress && progress->isCanceled())
+    {
+        xyz.resize(xyzBase);
+        tri.resize(triBase);
+        return false;
+    }
+    if (std::find(decoded.begin(), decoded.end(), 0) != decoded.end())
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : loadArchive() : " << filename << " is corrupted" << std::endl;
+        xyz.resize(xyzBase);
+        tri.resize(triBase);
+        return false;
+    }
+    if (base > 0)
+    {
+        Parallel::forChunks((int)(tri.size() - triBase), [&](int begin, int end)
+        {
+            for(int i=begin; i<end; ++i) tri[triBase + i] += base;
+        }, 65536);
+    }
+    return true;
+}
+
+// blocks are decoded whole: about maxPoints vertices taken with a fixed stride from
+// PREVIEW_BLOCKS vertex blocks spread evenly over the archive
+template<typename real>
+bool loadArchivePreview(const char        * filename,
+                        std::vector<real> & xyz,
+                        int                 maxPoints)
+{
+    xyz.clear();
+    MappedFile file(filename);
+    ArchiveHeader header;
+    if (!readHeader(file, filename, "loadArchivePreview", header)) return false;
+    if (header.vertexBlocks == 0) return true;
+
+    maxPoints = std::max(1, maxPoints);
+    int used = std::min(header.vertexBlocks, (int)PREVIEW_BLOCKS);
+    int quota = (maxPoints + used - 1) / used;
+    std::vector<std::vector<real>> blocks(used);
+    std::vector<char> decoded(used);
+    Parallel::forEach(used, [&](int i)
+    {
+        int b = (int)((long long)i * header.vertexBlocks / used);
+        int first = b * MeshArchive::BLOCK_SIZE, n = std::min((int)MeshArchive::BLOCK_SIZE, header.nv - first);
+        std::vector<real> block((size_t)n * 3);
+        decoded[i] = decodeVertices(ByteReader(header.blockBegin[b], header.blockEnd[b]), n, header.bits, header.min, header.step, block.data());
+        int stride = std::max(1, (n + quota - 1) / quota);
+        for(int vid=0; vid<n; vid+=stride) blocks[i].insert(blocks[i].end(), &block[vid*3], &block[vid*3] + 3);
+    }, 1);
+
+    if (std::find(decoded.begin(), decoded.end(), 0) != decoded.end())
+    {
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : loadArchivePreview() : " << filename << " is corrupted" << std::endl;
+        return false;
+    }
+    for(const std::vector<real> & block : blocks) xyz.insert(xyz.end(), block.begin(), block.end());
+    return true;
+}
+
+template bool saveArchive<float> (const char * filename, const std::vector<float>  & xyz, const std::vector<int> & tri, int bits);
+template bool saveArchive<double>(const char * filename, const std::vector<double> & xyz, const std::vector<int> & tri, int bits);
+template bool loadArchive<float> (const char * filename, std::vector<float>  & xyz, std::vector<int> & tri);
+template bool loadArchive<double>(const char * filename, std::vector<double> & xyz, std::vector<int> & tri);
+template bool loadArchivePreview<float> (const char * filename, std::vector<float>  & xyz, int maxPoints);
+template bool loadArchivePreview<double>(const char * filename, std::vector<double> & xyz, int maxPoints);
@@ -0,0 +1,54 @@
+#ifndef MESH_ARCHIVE_H
+#define MESH_ARCHIVE_H
+
+#include <vector>
+
+/**
+ * @brief Compressed mesh archive (.tmz): small files for storing many meshes, decoded in
+ * parallel.
+ *
+ * Coordinates are quantized on a uniform grid over the bounding box (bits per axis, the
+ * error is at most half a step) and predicted from the vertices before them. Triangles
+ * are delta coded: the first corner against the first corner of the previous triangle,
+ * the other two against the first. The residuals are split into a bit length, entropy
+ * coded (rANS, one frequency table per kind of residual), and the raw bits below it.
+ *
+ * Vertices and triangles are cut in blocks of BLOCK_SIZE that are coded independently:
+ * the blocks are encoded and decoded on the thread pool. The order of vertices and
+ * triangles is kept, ids refer to the same elements after a round trip.
+ *
+ * All values are stored little endian, whatever the machine.
+ */
+
+namespace MeshArchive {
+
+enum { VERSION = 1, BLOCK_SIZE = 1 << 16, DEFAULT_BITS = 20, MAX_BITS = 30 };
+
+}
+
+// bits: quantization of the coordinates, 1 to MAX_BITS bits per axis.
+// False (with an error on std::cerr) if the file cannot be written
+template<typename real>
+bool saveArchive(const char              * filename,
+                 const std::vector<real> & xyz,
+                 const std::vector<int>  & tri,
+                 int                       bits = MeshArchive::DEFAULT_BITS);
+
+// false (with an error on std::cerr) if the file cannot be read or is not a valid .tmz.
+// The mesh is appended to xyz and tri, as the loaders of load_save_trimesh.h do: its
+// triangles are shifted by the vertices already in xyz. Reports to the LoadProgress of
+// the calling thread, if any: once it is canceled the remaining blocks are skipped and
+// the result is false, with no error. On false xyz and tri are left as they were
+template<typename real>
+bool loadArchive(const char        * filename,
+                 std::vector<real> & xyz,
+                 std::vector<int>  & tri);
+
+// about maxPoints vertices of the archive, from a few of its blocks: a preview of the
+// mesh (load_save_trimesh.h, loadPreview). False as loadArchive. xyz is replaced
+template<typename real>
+bool loadArchivePreview(const char        * filename,
+                        std::vector<real> & xyz,
+                        int                 maxPoints);
+
+#endif // MESH_ARCHIVE_H
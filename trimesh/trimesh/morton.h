@@ -0,0 +1,43 @@
+#ifndef MORTON_H
+#define MORTON_H
+
+/**
+ * @brief 3D Morton (Z-order) codes: 21 bits per axis interleaved into 63 bits.
+ *
+ * Points close in space get close codes, so sorting by code gives a
+ * locality-preserving order.
+ */
+
+namespace Morton {
+
+// spreads the low 21 bits of v so that there are two zero bits between each of them
+inline unsigned long long spreadBits(unsigned int v)
+{
+    unsigned long long x = v & 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffull;
+    x = (x | x << 16) & 0x1f0000ff0000ffull;
+    x = (x | x << 8)  & 0x100f00f00f00f00full;
+    x = (x | x << 4)  & 0x10c30c30c30c30c3ull;
+    x = (x | x << 2)  & 0x1249249249249249ull;
+    return x;
+}
+
+inline unsigned long long encode(unsigned int x, unsigned int y, unsigned int z)
+{
+    return spreadBits(x) | (spreadBits(y) << 1) | (spreadBits(z) << 2);
+}
+
+// v in [min, max] to [0, 2^21 - 1]
+inline unsigned int quantize(double v, double min, double max)
+{
+    const double cells = (1 << 21) - 1;
+    if (max <= min) return 0;
+    double t = (v - min) / (max - min) * cells;
+    if (t < 0) t = 0;
+    if (t > cells) t = cells;
+    return (unsigned int)t;
+}
+
+}
+
+#endif // MORTON_H
@@ -0,0 +1,249 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Parallel loops for the per-element computations of the mesh.
+ *
+ * All the loops run on one shared pool of worker threads (created on first use, one
+ * thread per core besides the caller). Work is split into contiguous chunks of at least
+ * a grain size elements, and small inputs stay on the calling thread.
+ *
+ * The calling thread always works on its own loop until it is done, so loops can be
+ * nested (a loop body may start another loop) without deadlocks.
+ */
+
+namespace Parallel {
+
+inline int numThreads()
+{
+    int n = (int)std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+class ThreadPool
+{
+    public:
+
+        static ThreadPool & shared()
+        {
+            static ThreadPool pool(numThreads() - 1);
+            return pool;
+        }
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stop = true;
+            }
+            wakeUp.notify_all();
+            for(int i=0; i<(int)workers.size(); ++i) workers[i].join();
+        }
+
+        // threads running tasks, the caller included
+        inline int size() const { return (int)workers.size() + 1; }
+
+        // calls task(i) for i in [0, nTasks), returns when all of them are done
+        void run(int nTasks, const std::function<void(int)> & task)
+        {
+            if (nTasks <= 0) return;
+            if (nTasks == 1 || workers.empty())
+            {
+                for(int i=0; i<nTasks; ++i) task(i);
+                return;
+            }
+
+            std::shared_ptr<Job> job(new Job(nTasks, task));
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs.push_back(job);
+            }
+            wakeUp.notify_all();
+
+            work(*job);
+            std::unique_lock<std::mutex> lock(job->mutex);
+            job->finished.wait(lock, [&job]() { return job->done.load() == job->nTasks; });
+        }
+
+    private:
+
+        // the tasks of one run(): whoever is free takes the next index
+        struct Job
+        {
+            Job(int nTasks, const std::function<void(int)> & task) : nTasks(nTasks), task(task), next(0), done(0) {}
+
+            const int                         nTasks;
+            const std::function<void(int)>  & task;
+            std::atomic<int>                  next;
+            std::atomic<int>                  done;
+            std::mutex                        mutex;
+            std::condition_variable           finished;
+        };
+
+        ThreadPool(int nWorkers) : stop(false)
+        {
+            for(int i=0; i<nWorkers; ++i) workers.push_back(std::thread(&ThreadPool::loop, this));
+        }
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool & operator=(const ThreadPool &) = delete;
+
+        static void work(Job & job)
+        {
+            for(int i=job.next++; i<job.nTasks; i=job.next++)
+            {
+                job.task(i);
+                if (++job.done == job.nTasks)
+                {
+                    std::lock_guard<std::mutex> lock(job.mutex);
+                    job.finished.notify_all();
+                }
+            }
+        }
+
+        void loop()
+        {
+            for(;;)
+            {
+                std::shared_ptr<Job> job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wakeUp.wait(lock, [this]() { return stop || !jobs.empty(); });
+                    if (stop) return;
+                    job = jobs.front();
+                    if (job->next.load() >= job->nTasks)
+                    {
+                        jobs.pop_front(); // all taken, the threads still on it will finish it
+                        continue;
+                    }
+                }
+                work(*job);
+            }
+        }
+
+        std::vector<std::thread>          workers;
+        std::deque< std::shared_ptr<Job> > jobs;
+        std::mutex                        mutex;
+        std::condition_variable           wakeUp;
+        bool                              stop;
+};
+
+// number of chunks forChunks uses for n elements: one per thread, at least minChunk elements each
+inline int numChunks(int n, int minChunk = 4096)
+{
+    return std::max(1, std::min(numThreads(), (n + minChunk - 1) / minChunk));
+}
+
+// calls f(chunk, begin, end) for nChunks disjoint chunks covering [0, n), on the shared pool
+template<typename F>
+void forEachChunk(int n, int nChunks, F f)
+{
+    if (nChunks <= 1)
+    {
+        if (n > 0) f(0, 0, n);
+        return;
+    }
+
+    ThreadPool::shared().run(nChunks, [&](int c)
+    {
+        f(c, (int)((long long)n * c / nChunks), (int)((long long)n * (c+1) / nChunks));
+    });
+}
+
+// calls f(begin, end) on disjoint chunks covering [0, n)
+template<typename F>
+void forChunks(int n, F f, int minChunk = 4096)
+{
+    forEachChunk(n, numChunks(n, minChunk), [&f](int, int begin, int end) { f(begin, end); });
+}
+
+// calls f(i) for every i in [0, n). Elements are handed out in chunks of at least grain
+// of them, a few chunks per thread so that uneven work still balances
+template<typename F>
+void forEach(int n, F f, int grain = 4096)
+{
+    int nChunks = std::max(1, std::min(4 * numThreads(), (n + grain - 1) / grain));
+    forEachChunk(n, nChunks, [&f](int, int begin, int end)
+    {
+        for(int i=begin; i<end; ++i) f(i);
+    });
+}
+
+// combine(... combine(combine(identity, map(0)), map(1)) ..., map(n-1)), computed by chunks.
+// The partial results are combined in chunk order: the result does not depend on the
+// number of threads as long as combine is associative
+template<typename T, typename Map, typename Combine>
+T reduce(int n, T identity, Map map, Combine combine, int grain = 4096)
+{
+    int nChunks = std::max(1, std::min(4 * numThreads(), (n + grain - 1) / grain));
+    std::vector<T> partial(nChunks, identity);
+    forEachChunk(n, nChunks, [&](int chunk, int begin, int end)
+    {
+        T acc = identity;
+        for(int i=begin; i<end; ++i) acc = combine(acc, map(i));
+        partial[chunk] = acc;
+    });
+
+    T res = identity;
+    for(int c=0; c<nChunks; ++c) res = combine(res, partial[c]);
+    return res;
+}
+
+// std::sort on chunks in parallel, then merged pairwise in parallel
+template<typename It, typename Less>
+void sort(It first, It last, Less less, int minChunk = 1 << 15)
+{
+    int n = (int)(last - first);
+    int nChunks = std::min(numThreads(), n / minChunk);
+    if (nChunks <= 1)
+    {
+        std::sort(first, last, less);
+        return;
+    }
+
+    std::vector<int> bounds(nChunks + 1);
+    for(int c=0; c<=nChunks; ++c) bounds[c] = (int)((long long)n * c / nChunks);
+
+    forChunks(nChunks, [&](int begin, int end)
+    {
+        for(int c=begin; c<end; ++c) std::sort(first + bounds[c], first + bounds[c+1], less);
+    }, 1);
+
+    while (bounds.size() > 2)
+    {
+        int nPairs = (int)(bounds.size() - 1) / 2;
+        forChunks(nPairs, [&](int begin, int end)
+        {
+            for(int p=begin; p<end; ++p)
+            {
+                std::inplace_merge(first + bounds[2*p], first + bounds[2*p+1], first + bounds[2*p+2], less);
+            }
+        }, 1);
+
+        std::vector<int> merged;
+        for(int c=0; c<(int)bounds.size(); c+=2) merged.push_back(bounds[c]);
+        if (merged.back() != n) merged.push_back(n);
+        bounds.swap(merged);
+    }
+}
+
+template<typename It>
+void sort(It first, It last, int minChunk = 1 << 15)
+{
+    sort(first, last, std::less<typename std::iterator_traits<It>::value_type>(), minChunk);
+}
+
+}
+
+#endif // PARALLEL_H
@@ -8,13 +8,28 @@
 
 #include <assert.h>
 #include <float.h>
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdlib.h>
 
 #include <common/bounding_box.h>
 #include "load_save_trimesh.h"
+#include "load_progress.h"
+#include "csr_adjacency.h"
+#include "parallel.h"
+#include "geometry_kernels.h"
+#include "morton.h"
+#include "bvh.h"
+#include "binary_mesh.h"
+#include "mesh_archive.h"
+#include "weld.h"
 
 #ifdef IGL_DEFINED
 #include <igl/iglmesh.h>
@@ -34,6 +49,52 @@ inline edge uniqueEdge(int v0, int v1)
     return e;
 }
 
+// one entry per half edge, ordered by edge: the half edges of an edge are contiguous
+struct halfEdge
+{
+    unsigned long long key;  // min vertex in the high word, max vertex in the low one
+    int                slot; // tid * 3 + i, the half edge goes from corner i to corner (i+1)%3
+
+    inline bool operator<(const halfEdge & other) const
+    {
+        return key < other.key || (key == other.key && slot < other.slot);
+    }
+};
+
+inline unsigned long long edgeKey(int v0, int v1)
+{
+    edge e = uniqueEdge(v0,v1);
+    return ((unsigned long long)(unsigned int)e.first << 32) | (unsigned int)e.second;
+}
+
+// which derived data (adjacency, normals, bbox) is up to date, and which has been built at
+// least once for the current topology (so that it can be patched instead of rebuilt).
+// A copy gets the same flags and a mutex of its own, so that the mesh stays copyable
+struct derivedFlags
+{
+    std::atomic<int> valid;
+    std::atomic<int> built;
+    std::mutex       mutex;
+
+    derivedFlags() : valid(0), built(0) {}
+    derivedFlags(const derivedFlags & other) : valid(other.valid.load()), built(other.built.load()) {}
+    derivedFlags & operator=(const derivedFlags & other)
+    {
+        valid = other.valid.load();
+        built = other.built.load();
+        return *this;
+    }
+};
+
+// index tables produced by Trimesh::reorder()
+struct trimeshRemap
+{
+    std::vector<int> vertexNewToOld;
+    std::vector<int> vertexOldToNew;
+    std::vector<int> triangleNewToOld;
+    std::vector<int> triangleOldToNew;
+};
+
 template<typename C>
 inline bool checkBounds(const C & container, int index)
 {
@@ -42,23 +103,40 @@ inline bool checkBounds(const C & container, int index)
 
 /*-------------- INLINE UTILITY FUNCTIONS --------------*/
 
+/**
+ * Thread safety: the const member functions can be called by any number of concurrent
+ * readers, derived data included (the first reader that needs a piece computes it, the
+ * others wait for it). Non-const calls (setVertex, transform, reorder, invalidate, ...)
+ * need exclusive access to the mesh.
+ */
 template<typename real> class Trimesh
 {
 
     public:
 
+        // derived data, computed on first access (or by prefetch)
+        enum DerivedData
+        {
+            ADJACENCY        = 1,
+            TRIANGLE_NORMALS = 2,
+            VERTEX_NORMALS   = 4,
+            BBOX             = 8,
+            SPATIAL_INDEX    = 16, // BVH of the triangles, refit (not rebuilt) after vertex moves
+            ALL_DERIVED      = ADJACENCY | TRIANGLE_NORMALS | VERTEX_NORMALS | BBOX | SPATIAL_INDEX
+        };
+
         Trimesh(){}
 
+        // empty if filename cannot be read: load() tells it
         Trimesh(const char * filename)
         {
-            load(filename);
-            init();
+            load(filename); // no init(): it would drop the derived data stored in a .tmb
         }
 
         Trimesh(const std::vector<real> & coords,
                 const std::vector<int>  & tris)
         {
-            coords = coords;
+            this->coords = coords;
             this->tris   = tris;
             init();
         }
@@ -95,20 +173,35 @@ template<typename real> class Trimesh
         #endif
 
         inline BoundingBox getBoundingBox() const {
+            require(BBOX);
             return bbox;
         }
 
 
     protected:
 
-        BoundingBox                bbox;
         std::vector<real>          coords;
         std::vector<int>           tris;
-        std::vector<real>          vertexNormals;
-        std::vector<real>          triangleNormals;
-        std::vector< std::vector<int> > vtx2tri;
-        std::vector< std::vector<int> > vtx2vtx;
-        std::vector< std::vector<int> > tri2tri;
+
+        // derived data: mutable, it is filled by the const accessors through require()
+        mutable BoundingBox        bbox;
+        mutable std::vector<real>  vertexNormals;
+        mutable std::vector<real>  triangleNormals;
+        mutable CSRAdjacency       vtx2tri;
+        mutable CSRAdjacency       vtx2vtx;
+        mutable CSRAdjacency       tri2tri;
+        mutable std::vector<edge>  nonManifoldEdges;
+        mutable std::vector<int>   edge2vtx;   // 2 per edge, sorted (min, max); edges sorted by vertices
+        mutable std::vector<int>   tri2edge;   // 3 per triangle: edge i joins corners i and (i+1)%3
+        mutable CSRAdjacency       edge2tri;
+        mutable std::vector<char>  edgeBoundary;
+        mutable BVH<real>          bvh;
+        mutable derivedFlags       derived;
+
+        // the .tmb file the mesh was loaded from, and the derived data in it that is still
+        // up to date: require() copies it from there instead of computing it
+        mutable std::shared_ptr<const BinaryMeshFile> storedFile;
+        mutable int                                    storedPieces = 0;
 
         std::vector<real> toRealArray (const std::vector<double> & in) const
         {
@@ -137,160 +230,557 @@ template<typename real> class Trimesh
             vtx2vtx.clear();
             vtx2tri.clear();
             tri2tri.clear();
+            nonManifoldEdges.clear();
+            edge2vtx.clear();
+            tri2edge.clear();
+            edge2tri.clear();
+            edgeBoundary.clear();
+            bvh.clear();
+            invalidate(ALL_DERIVED);
+            storedFile.reset();
         }
 
+        // nothing is computed here: the derived data is built on first access
         void init()
         {
-            buildAdjacency();
-            updateNormals();
-            updateBbox();
+            invalidate(ALL_DERIVED);
         }
 
-        void buildAdjacency()
-        {
-            vtx2vtx.clear();
-            vtx2tri.clear();
-            tri2tri.clear();
-
-            vtx2vtx.resize(numVertices());
-            vtx2tri.resize(numVertices());
-            tri2tri.resize(numTriangles());
+        // the compute functions below are called with derived.mutex held, they read
+        // coords, tris and the members they depend on directly (no accessors)
 
-            std::set<edge>     edges;
-            std::map<edge,int> edge2tri;
+        void buildAdjacency() const
+        {
+            int nHalfEdges = numTriangles() * 3;
+            std::vector<halfEdge>             halfEdges(nHalfEdges);
+            std::vector< std::pair<int,int> > v2t(nHalfEdges), v2v, t2t, e2t(nHalfEdges);
 
-            for(int tid=0; tid<numTriangles(); ++tid)
+            Parallel::forChunks(numTriangles(), [&](int begin, int end)
             {
-                int tid_ptr = tid * 3;
-                for(int i=0; i<3; ++i)
+                for(int tid=begin; tid<end; ++tid)
                 {
-                    int vid = tris[tid_ptr + i];
-                    vtx2tri[vid].push_back(tid);
-
-                    int adj = tris[tid_ptr + (i+1)%3];
-                    edge e = uniqueEdge(vid,adj);
-                    edges.insert(e);
-
-                    std::map<edge,int>::iterator query = edge2tri.find(e);
-                    if (query == edge2tri.end())
-                    {
-                        edge2tri[e] = tid;
-                    }
-                    else
+                    int tid_ptr = tid * 3;
+                    for(int i=0; i<3; ++i)
                     {
-                        int nbr_tri = query->second;
-                        tri2tri[tid].push_back(nbr_tri);
-                        tri2tri[nbr_tri].push_back(tid);
+                        int vid = tris[tid_ptr + i];
+                        int adj = tris[tid_ptr + (i+1)%3];
+                        v2t[tid_ptr + i] = std::make_pair(vid, tid);
+                        halfEdges[tid_ptr + i].key  = edgeKey(vid, adj);
+                        halfEdges[tid_ptr + i].slot = tid_ptr + i;
                     }
                 }
+            });
+
+            Parallel::sort(halfEdges.begin(), halfEdges.end());
+
+            // every run of equal keys is an edge (its id is the index of the run), and its triangles
+            nonManifoldEdges.clear();
+            edge2vtx.clear();
+            edgeBoundary.clear();
+            tri2edge.resize(nHalfEdges);
+            v2v.reserve(nHalfEdges);
+            t2t.reserve(nHalfEdges);
+            for(int i=0, j=0; i<nHalfEdges; i=j)
+            {
+                while (j < nHalfEdges && halfEdges[j].key == halfEdges[i].key) ++j;
+
+                int eid = (int)edgeBoundary.size();
+                edge e((int)(halfEdges[i].key >> 32), (int)(halfEdges[i].key & 0xffffffff));
+                edge2vtx.push_back(e.first);
+                edge2vtx.push_back(e.second);
+                edgeBoundary.push_back(j - i == 1);
+                v2v.push_back(std::make_pair(e.first, e.second));
+                v2v.push_back(std::make_pair(e.second, e.first));
+                for(int k=i; k<j; ++k)
+                {
+                    tri2edge[halfEdges[k].slot] = eid;
+                    e2t[k] = std::make_pair(eid, halfEdges[k].slot / 3);
+                }
+
+                int t0 = halfEdges[i].slot / 3;
+                if (j - i == 2 && t0 != halfEdges[i+1].slot / 3)
+                {
+                    int t1 = halfEdges[i+1].slot / 3;
+                    t2t.push_back(std::make_pair(t0, t1));
+                    t2t.push_back(std::make_pair(t1, t0));
+                }
+                else if (j - i > 2)
+                {
+                    nonManifoldEdges.push_back(e);
+                }
             }
 
-            for(std::set<edge>::iterator it=edges.begin(); it!=edges.end(); ++it)
+            if (nonManifoldEdges.size() > 0)
             {
-                edge e = *it;
-                vtx2vtx[e.first].push_back(e.second);
-                vtx2vtx[e.second].push_back(e.first);
+                std::cerr << "WARNING : " << __FILE__ << ", line " << __LINE__ << " : buildAdjacency() : "
+                          << nonManifoldEdges.size() << " non-manifold edges, their triangles are left unlinked" << std::endl;
             }
+
+            vtx2tri.build(numVertices(),  v2t);
+            vtx2vtx.build(numVertices(),  v2v);
+            tri2tri.build(numTriangles(), t2t);
+            edge2tri.build((int)edgeBoundary.size(), e2t);
+        }
+
+        // cross product of the edges: the normal scaled by twice the area
+        inline void faceCross(int tid, real & x, real & y, real & z) const
+        {
+            const real * v0 = &coords[tris[tid*3+0]*3];
+            const real * v1 = &coords[tris[tid*3+1]*3];
+            const real * v2 = &coords[tris[tid*3+2]*3];
+            real ux = v1[0] - v0[0], uy = v1[1] - v0[1], uz = v1[2] - v0[2];
+            real vx = v2[0] - v0[0], vy = v2[1] - v0[1], vz = v2[2] - v0[2];
+            x = uy*vz - uz*vy;
+            y = uz*vx - ux*vz;
+            z = ux*vy - uy*vx;
+        }
+
+        static inline void normalizeTo(real x, real y, real z, real * out)
+        {
+            real len = std::sqrt(x*x + y*y + z*z);
+            real inv = len > 0 ? 1 / len : 0;
+            out[0] = x * inv;
+            out[1] = y * inv;
+            out[2] = z * inv;
         }
 
-        void updateTriangleNormals()
+        void updateTriangleNormals() const
         {
-            triangleNormals.clear();
             triangleNormals.resize(numTriangles()*3);
 
-            for(int tid=0; tid<numTriangles(); ++tid)
+            Parallel::forChunks(numTriangles(), [this](int begin, int end)
             {
-                int tid_ptr = tid * 3;
-
-                Point<real> v0 = vertex(tris[tid_ptr+0]);
-                Point<real> v1 = vertex(tris[tid_ptr+1]);
-                Point<real> v2 = vertex(tris[tid_ptr+2]);
+                GeometryKernels<real>::triangleNormals(coords.data(), tris.data(), begin, end, triangleNormals.data());
+            });
+        }
 
-                Point<real> u = v1 - v0;    u.normalize();
-                Point<real> v = v2 - v0;    v.normalize();
-                Point<real> n = u.cross(v); n.normalize();
+        // area weighted, no vtx2tri needed. The corners of the triangles are bucketed by vertex
+        // range (a counting sort over chunks of triangles), then every range sums the face
+        // crosses of its corners into its own vertices: no per-thread accumulators, the extra
+        // memory is a cross and three corner ids per triangle. Each vertex sums its triangles
+        // in index order, so the result does not depend on the number of threads
+        void updateVertexNormals() const
+        {
+            int nv = numVertices(), nt = numTriangles();
+            int nChunks = Parallel::numChunks(nt, 16384);
+            int nRanges = std::max(1, std::min(4 * Parallel::numThreads(), (nv + 16383) / 16384));
+            int rangeSize = std::max(1, (nv + nRanges - 1) / nRanges);
+
+            std::vector<real> cx(nt), cy(nt), cz(nt);
+            std::vector<int>  bucket(nChunks * nRanges, 0); // corners of chunk c in range r, then their first slot
+            Parallel::forEachChunk(nt, nChunks, [&](int chunk, int begin, int end)
+            {
+                int * count = &bucket[chunk * nRanges];
+                for(int tid=begin; tid<end; ++tid)
+                {
+                    faceCross(tid, cx[tid], cy[tid], cz[tid]);
+                    for(int i=0; i<3; ++i) ++count[tris[tid*3+i] / rangeSize];
+                }
+            });
 
-                triangleNormals[tid_ptr + 0] = n.x();
-                triangleNormals[tid_ptr + 1] = n.y();
-                triangleNormals[tid_ptr + 2] = n.z();
+            std::vector<int> rangeFirst(nRanges + 1);
+            int slot = 0;
+            for(int r=0; r<nRanges; ++r)
+            {
+                rangeFirst[r] = slot;
+                for(int c=0; c<nChunks; ++c)
+                {
+                    int n = bucket[c * nRanges + r];
+                    bucket[c * nRanges + r] = slot;
+                    slot += n;
+                }
             }
+            rangeFirst[nRanges] = slot;
+
+            std::vector<int> corners(slot); // tid*3+i, grouped by range, in triangle order within a range
+            Parallel::forEachChunk(nt, nChunks, [&](int chunk, int begin, int end)
+            {
+                int * next = &bucket[chunk * nRanges];
+                for(int tid=begin; tid<end; ++tid)
+                {
+                    for(int i=0; i<3; ++i) corners[next[tris[tid*3+i] / rangeSize]++] = tid*3+i;
+                }
+            });
+
+            vertexNormals.assign(nv*3, 0);
+            Parallel::forEach(nRanges, [&](int r)
+            {
+                for(int k=rangeFirst[r]; k<rangeFirst[r+1]; ++k)
+                {
+                    int tid = corners[k] / 3;
+                    real * n = &vertexNormals[tris[corners[k]]*3];
+                    n[0] += cx[tid];
+                    n[1] += cy[tid];
+                    n[2] += cz[tid];
+                }
+                for(int vid=r*rangeSize; vid<std::min(nv, (r+1)*rangeSize); ++vid)
+                {
+                    real * n = &vertexNormals[vid*3];
+                    normalizeTo(n[0], n[1], n[2], n);
+                }
+            }, 1);
         }
 
-        void updateVertexNormals()
+        // recomputes the normals (pieces: TRIANGLE_NORMALS and/or VERTEX_NORMALS) of the
+        // triangles incident to vids, and of their vertices
+        void updateNormalsAround(const std::vector<int> & vids, int pieces) const
         {
-                    vertexNormals.clear();
-                    vertexNormals.resize(numVertices()*3);
+            std::vector<int> tids, nbrs;
+            for(int i=0; i<(int)vids.size(); ++i)
+            {
+                IndexSpan vt = vtx2tri[vids[i]];
+                tids.insert(tids.end(), vt.begin(), vt.end());
+            }
+            std::sort(tids.begin(), tids.end());
+            tids.erase(std::unique(tids.begin(), tids.end()), tids.end());
+            for(int i=0; i<(int)tids.size(); ++i)
+            {
+                nbrs.insert(nbrs.end(), &tris[tids[i]*3], &tris[tids[i]*3] + 3);
+            }
+            std::sort(nbrs.begin(), nbrs.end());
+            nbrs.erase(std::unique(nbrs.begin(), nbrs.end()), nbrs.end());
 
-                    for(int vid=0; vid<numVertices(); ++vid)
+            if (pieces & TRIANGLE_NORMALS) Parallel::forChunks((int)tids.size(), [&](int begin, int end)
+            {
+                for(int i=begin; i<end; ++i)
+                {
+                    real x, y, z;
+                    faceCross(tids[i], x, y, z);
+                    normalizeTo(x, y, z, &triangleNormals[tids[i]*3]);
+                }
+            });
+            if (pieces & VERTEX_NORMALS) Parallel::forChunks((int)nbrs.size(), [&](int begin, int end)
+            {
+                for(int i=begin; i<end; ++i)
+                {
+                    IndexSpan vt = vtx2tri[nbrs[i]];
+                    real sx = 0, sy = 0, sz = 0;
+                    for(const int * t=vt.begin(); t!=vt.end(); ++t)
                     {
-                        std::vector<int> nbrs = adj_vtx2tri(vid);
-                        int vid_ptr = vid * 3;
-                        if (nbrs.size() == 0) {
-                            vertexNormals[vid_ptr + 0] = 0;
-                            vertexNormals[vid_ptr + 1] = 0;
-                            vertexNormals[vid_ptr + 2] = 0;
-                        }
-                        else {
-                            Point<real> sum(0,0,0);
-                            for(int i=0; i<(int)nbrs.size(); ++i)
-                            {
-                                sum += triangleNormal(nbrs[i]);
-                            }
-
-                            assert(nbrs.size() > 0);
-                            sum /= nbrs.size();
-                            sum.normalize();
-
-
-                            vertexNormals[vid_ptr + 0] = sum.x();
-                            vertexNormals[vid_ptr + 1] = sum.y();
-                            vertexNormals[vid_ptr + 2] = sum.z();
-                        }
+                        real x, y, z;
+                        faceCross(*t, x, y, z);
+                        sx += x;
+                        sy += y;
+                        sz += z;
                     }
+                    normalizeTo(sx, sy, sz, &vertexNormals[nbrs[i]*3]);
+                }
+            });
         }
 
-        void load(const char * filename)
+    public:
+
+        // false (and the mesh left empty) if the file cannot be read, or if the load is
+        // canceled through the LoadProgress installed on the calling thread (load_progress.h)
+        bool load(const char * filename)
         {
             clear();
-            std::vector<double> tmp_coords;
+            LoadProgress * progress = LoadProgress::current();
 
             std::string str(filename);
             std::string filetype = str.substr(str.size()-3,3);
 
+            std::shared_ptr<BinaryMeshFile> binary;
+            bool ok = true;
             if (filetype.compare("obj") == 0 ||
                 filetype.compare("OBJ") == 0)
             {
-                loadObj(filename, tmp_coords, tris);
+                ok = loadObj(filename, coords, tris); // parsed straight into real, no double copy
+            }
+            else if (filetype.compare("off") == 0 ||
+                     filetype.compare("OFF") == 0)
+            {
+                ok = loadOff(filename, coords, tris);
+            }
+            else if (filetype.compare("ply") == 0 ||
+                     filetype.compare("PLY") == 0)
+            {
+                ok = loadPly(filename, coords, tris);
+            }
+            else if (filetype.compare("stl") == 0 ||
+                     filetype.compare("STL") == 0)
+            {
+                ok = loadStl(filename, coords, tris);
+                if (ok) weldVertices(coords, tris, weldTolerance(coords));
+            }
+            else if (filetype.compare("tmz") == 0 ||
+                     filetype.compare("TMZ") == 0)
+            {
+                ok = loadArchive(filename, coords, tris);
+            }
+            else if (filetype.compare("tmb") == 0 ||
+                     filetype.compare("TMB") == 0)
+            {
+                binary = std::make_shared<BinaryMeshFile>();
+                if (!binary->open(filename) || !binary->read(BinaryMesh::COORDS, coords) || !binary->read(BinaryMesh::TRIS, tris) ||
+                    coords.size() % 3 != 0 || tris.size() % 3 != 0)
+                {
+                    std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : load() : couldn't read the mesh in " << filename << std::endl;
+                    ok = false;
+                }
             }
             else
             {
                 std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : load() : file format not supported yet " << std::endl;
-                exit(-1);
+                ok = false;
             }
 
-            coords = toRealArray(tmp_coords);
+            if (!ok || (progress && progress->isCanceled()))
+            {
+                clear();
+                return false;
+            }
+            if (progress) progress->advance(1.0); // .tmb files are copied, not parsed
 
             std::cout << tris.size() / 3   << " triangles read" << std::endl;
             std::cout << coords.size() / 3 << " vertices  read" << std::endl;
 
-            buildAdjacency();
-            updateNormals();
-            updateBbox();
+            invalidate(ALL_DERIVED);
+            if (binary)
+            {
+                storedPieces = storedPiecesIn(*binary);
+                if (storedPieces) storedFile = binary;
+            }
+            return true;
+        }
+
+    protected:
+
+        // the derived data in file that fits this mesh (by the sizes of the arrays:
+        // the content is trusted, the file was written by saveBinary)
+        int storedPiecesIn(const BinaryMeshFile & file) const
+        {
+            size_t nv = numVertices(), nt = numTriangles(), ne = file.count(BinaryMesh::EDGE_BOUNDARY);
+            int pieces = 0;
+            if (file.count(BinaryMesh::TRIANGLE_NORMALS) == nt*3) pieces |= TRIANGLE_NORMALS;
+            if (file.count(BinaryMesh::VERTEX_NORMALS)   == nv*3) pieces |= VERTEX_NORMALS;
+            if (file.count(BinaryMesh::BBOX)             == 6)    pieces |= BBOX;
+            bool adjacency = file.count(BinaryMesh::VTX2TRI_OFFSETS)  == nv+1 && file.count(BinaryMesh::VTX2TRI_INDICES) == nt*3 &&
+                             file.count(BinaryMesh::VTX2VTX_OFFSETS)  == nv+1 && file.count(BinaryMesh::VTX2VTX_INDICES) == ne*2 &&
+                             file.count(BinaryMesh::TRI2TRI_OFFSETS)  == nt+1 && file.has(BinaryMesh::TRI2TRI_INDICES) &&
+                             file.count(BinaryMesh::EDGE2VTX)         == ne*2 && file.count(BinaryMesh::TRI2EDGE)        == nt*3 &&
+                             file.count(BinaryMesh::EDGE2TRI_OFFSETS) == ne+1 && file.count(BinaryMesh::EDGE2TRI_INDICES) == nt*3 &&
+                             file.count(BinaryMesh::NON_MANIFOLD_EDGES) % 2 == 0 && file.has(BinaryMesh::NON_MANIFOLD_EDGES);
+            if (adjacency) pieces |= ADJACENCY;
+            return pieces;
+        }
+
+        // copies the pieces from storedFile (called with derived.mutex held)
+        void loadStored(int pieces) const
+        {
+            const BinaryMeshFile & file = *storedFile;
+            if (pieces & ADJACENCY)
+            {
+                std::vector<int> offsets, indices, pairs;
+                file.read(BinaryMesh::VTX2TRI_OFFSETS,  offsets); file.read(BinaryMesh::VTX2TRI_INDICES,  indices); vtx2tri.swap(offsets, indices);
+                file.read(BinaryMesh::VTX2VTX_OFFSETS,  offsets); file.read(BinaryMesh::VTX2VTX_INDICES,  indices); vtx2vtx.swap(offsets, indices);
+                file.read(BinaryMesh::TRI2TRI_OFFSETS,  offsets); file.read(BinaryMesh::TRI2TRI_INDICES,  indices); tri2tri.swap(offsets, indices);
+                file.read(BinaryMesh::EDGE2TRI_OFFSETS, offsets); file.read(BinaryMesh::EDGE2TRI_INDICES, indices); edge2tri.swap(offsets, indices);
+                file.read(BinaryMesh::EDGE2VTX,         edge2vtx);
+                file.read(BinaryMesh::TRI2EDGE,         tri2edge);
+                file.read(BinaryMesh::EDGE_BOUNDARY,    edgeBoundary);
+                file.read(BinaryMesh::NON_MANIFOLD_EDGES, pairs);
+                nonManifoldEdges.resize(pairs.size() / 2);
+                for(int i=0; i<(int)nonManifoldEdges.size(); ++i) nonManifoldEdges[i] = edge(pairs[i*2], pairs[i*2+1]);
+            }
+            if (pieces & TRIANGLE_NORMALS) file.read(BinaryMesh::TRIANGLE_NORMALS, triangleNormals);
+            if (pieces & VERTEX_NORMALS)   file.read(BinaryMesh::VERTEX_NORMALS,   vertexNormals);
+            if (pieces & BBOX)
+            {
+                std::vector<double> b;
+                file.read(BinaryMesh::BBOX, b);
+                bbox.setMin(Pointd(b[0], b[1], b[2]));
+                bbox.setMax(Pointd(b[3], b[4], b[5]));
+            }
+            storedPieces &= ~pieces;
+            if (!storedPieces) storedFile.reset(); // everything has been taken: unmap
+        }
+
+        void computeBbox() const
+        {
+            int nChunks = Parallel::numChunks(numVertices(), 65536);
+            std::vector<real> lo(nChunks*3), hi(nChunks*3);
+            Parallel::forEachChunk(numVertices(), nChunks, [&](int chunk, int begin, int end)
+            {
+                GeometryKernels<real>::bbox(&coords[begin*3], end - begin, &lo[chunk*3], &hi[chunk*3]);
+            });
+
+            bbox.reset();
+            for(int c=0; c<nChunks && numVertices()>0; ++c)
+            {
+                bbox.setMin(bbox.getMin().min(Pointd(lo[c*3+0], lo[c*3+1], lo[c*3+2])));
+                bbox.setMax(bbox.getMax().max(Pointd(hi[c*3+0], hi[c*3+1], hi[c*3+2])));
+            }
+        }
+
+        // the tree is kept as long as the topology is: vertex moves only refit it
+        void updateSpatialIndex() const
+        {
+            if (derived.built.load() & SPATIAL_INDEX) bvh.refit(coords.data(), tris.data());
+            else                                      bvh.build(coords.data(), tris.data(), numTriangles());
+        }
+
+        inline bool isValid(int pieces) const
+        {
+            return (derived.valid.load(std::memory_order_acquire) & pieces) == pieces;
+        }
+
+        inline void validate(int pieces) const
+        {
+            derived.built.fetch_or(pieces);
+            derived.valid.fetch_or(pieces, std::memory_order_release);
+        }
+
+        // computes the missing pieces; concurrent callers wait for the first one
+        void require(int pieces) const
+        {
+            if (isValid(pieces)) return;
+            std::lock_guard<std::mutex> lock(derived.mutex);
+            int missing = pieces & ~derived.valid.load();
+            int stored  = missing & storedPieces;
+            if (stored)                     loadStored(stored);
+            missing &= ~stored;
+            if (missing & ADJACENCY)        buildAdjacency();
+            if (missing & TRIANGLE_NORMALS) updateTriangleNormals();
+            if (missing & VERTEX_NORMALS)   updateVertexNormals();
+            if (missing & BBOX)             computeBbox();
+            if (missing & SPATIAL_INDEX)    updateSpatialIndex();
+            validate(missing | stored);
         }
 
     public:
 
         inline const std::vector<real> & vectorCoords() const { return coords;        }
         inline const std::vector<int>  & vectorTriangles() const { return tris;          }
-        inline const std::vector<real> & vectorVertexNormals() const { return vertexNormals; }
-        inline const std::vector<std::vector<int>> & vectorAdjTri2Tri() const {return tri2tri;}
+        inline const std::vector<real> & vectorVertexNormals() const { require(VERTEX_NORMALS); return vertexNormals; }
+        inline const std::vector<real> & vectorTriangleNormals() const { require(TRIANGLE_NORMALS); return triangleNormals; }
+        inline const CSRAdjacency      & vectorAdjTri2Tri() const { require(ADJACENCY); return tri2tri; }
+        inline const std::vector<edge> & vectorNonManifoldEdges() const { require(ADJACENCY); return nonManifoldEdges; } // more than two triangles
 
         inline int numVertices()  const { return coords.size()/3; }
         inline int numTriangles() const { return tris.size()/3;   }
+        inline int numEdges()     const { require(ADJACENCY); return edge2vtx.size()/2; }
+
+        // the spans point into the adjacency of the mesh: they are invalidated by buildAdjacency() and clear()
+        inline IndexSpan adj_vtx2tri(int vid) const { require(ADJACENCY); assert(checkBounds(vtx2tri, vid)); return vtx2tri[vid]; }
+        inline IndexSpan adj_vtx2vtx(int vid) const { require(ADJACENCY); assert(checkBounds(vtx2vtx, vid)); return vtx2vtx[vid]; }
+        inline IndexSpan adj_tri2tri(int tid) const { require(ADJACENCY); assert(checkBounds(tri2tri, tid)); return tri2tri[tid]; }
 
-        inline std::vector<int> adj_vtx2tri(int vid) const { assert(checkBounds(vtx2tri, vid)); return vtx2tri[vid]; }
-        inline std::vector<int> adj_vtx2vtx(int vid) const { assert(checkBounds(vtx2vtx, vid)); return vtx2vtx[vid]; }
-        inline std::vector<int> adj_tri2tri(int tid) const { assert(checkBounds(tri2tri, tid)); return tri2tri[tid]; }
+        // edges: ids are stable until the topology changes (invalidate(ADJACENCY))
+        inline IndexSpan adj_tri2edge(int tid) const { require(ADJACENCY); assert(tid*3+2 < (int)tri2edge.size()); return IndexSpan(&tri2edge[tid*3], &tri2edge[tid*3] + 3); }
+        inline IndexSpan adj_edge2tri(int eid) const { require(ADJACENCY); assert(checkBounds(edge2tri, eid)); return edge2tri[eid]; }
+        inline int  edge_vertex_id(int eid, int i) const { require(ADJACENCY); return edge2vtx[eid*2 + i]; }
+        inline bool isBoundaryEdge(int eid) const { require(ADJACENCY); return edgeBoundary[eid] != 0; }
+        inline bool isManifoldEdge(int eid) const { require(ADJACENCY); return edge2tri[eid].size() <= 2; }
+
+        std::vector<int> boundaryEdges() const
+        {
+            require(ADJACENCY);
+            std::vector<int> res;
+            for(int eid=0; eid<(int)edgeBoundary.size(); ++eid)
+            {
+                if (edgeBoundary[eid]) res.push_back(eid);
+            }
+            return res;
+        }
+
+        // edges between a triangle facing direction and one facing away from it: the
+        // silhouette for a view along direction, or the parting line for a mold opening along it.
+        // Only edges with two triangles are considered, boundaryEdges() gives the others
+        std::vector<int> silhouetteEdges(const Pointd & direction) const
+        {
+            require(ADJACENCY | TRIANGLE_NORMALS);
+            std::vector<int> res;
+            for(int eid=0; eid<(int)edgeBoundary.size(); ++eid)
+            {
+                IndexSpan tids = edge2tri[eid];
+                if (tids.size() != 2) continue;
+                const real * n0 = &triangleNormals[tids[0]*3];
+                const real * n1 = &triangleNormals[tids[1]*3];
+                double d0 = n0[0]*direction.x() + n0[1]*direction.y() + n0[2]*direction.z();
+                double d1 = n1[0]*direction.x() + n1[1]*direction.y() + n1[2]*direction.z();
+                if ((d0 > 0 && d1 <= 0) || (d0 <= 0 && d1 > 0)) res.push_back(eid);
+            }
+            return res;
+        }
+
+        // parallel loops on the shared thread pool: f(id) is called once per element, from any
+        // thread and in no particular order. f can use the const accessors; the derived data it
+        // needs is better prefetched, so that the loop does not start by waiting for it
+        template<typename F>
+        void forEachTriangle(F f, int grain = 4096) const
+        {
+            Parallel::forEach(numTriangles(), f, grain);
+        }
+
+        template<typename F>
+        void forEachVertex(F f, int grain = 4096) const
+        {
+            Parallel::forEach(numVertices(), f, grain);
+        }
+
+        template<typename F>
+        void forEachEdge(F f, int grain = 4096) const
+        {
+            Parallel::forEach(numEdges(), f, grain);
+        }
+
+        // combine of map(id) over all the elements (see Parallel::reduce), e.g. the total area:
+        // reduceTriangles(0.0, [&](int tid) { ... }, std::plus<double>())
+        template<typename T, typename Map, typename Combine>
+        T reduceTriangles(T identity, Map map, Combine combine, int grain = 4096) const
+        {
+            return Parallel::reduce(numTriangles(), identity, map, combine, grain);
+        }
+
+        template<typename T, typename Map, typename Combine>
+        T reduceVertices(T identity, Map map, Combine combine, int grain = 4096) const
+        {
+            return Parallel::reduce(numVertices(), identity, map, combine, grain);
+        }
+
+        template<typename T, typename Map, typename Combine>
+        T reduceEdges(T identity, Map map, Combine combine, int grain = 4096) const
+        {
+            return Parallel::reduce(numEdges(), identity, map, combine, grain);
+        }
+
+        // spatial queries on the BVH of the triangles (built on first use, refit after vertex moves).
+        // Rays are origin + t * direction with t in [0, tmax], both sides of the triangles are hit
+        inline const BVH<real> & spatialIndex() const { require(SPATIAL_INDEX); return bvh; }
+
+        bool rayAnyHit(const Pointd & origin, const Pointd & direction, double tmax = DBL_MAX) const
+        {
+            require(SPATIAL_INDEX);
+            double o[3] = { origin.x(), origin.y(), origin.z() }, d[3] = { direction.x(), direction.y(), direction.z() };
+            return bvh.anyHit(coords.data(), tris.data(), o, d, tmax);
+        }
+
+        bool rayFirstHit(const Pointd & origin, const Pointd & direction, rayHit & hit, double tmax = DBL_MAX) const
+        {
+            require(SPATIAL_INDEX);
+            double o[3] = { origin.x(), origin.y(), origin.z() }, d[3] = { direction.x(), direction.y(), direction.z() };
+            return bvh.firstHit(coords.data(), tris.data(), o, d, tmax, hit);
+        }
+
+        // sorted by t
+        void rayAllHits(const Pointd & origin, const Pointd & direction, std::vector<rayHit> & hits, double tmax = DBL_MAX) const
+        {
+            require(SPATIAL_INDEX);
+            double o[3] = { origin.x(), origin.y(), origin.z() }, d[3] = { direction.x(), direction.y(), direction.z() };
+            bvh.allHits(coords.data(), tris.data(), o, d, tmax, hits);
+        }
+
+        // triangles whose bounding box overlaps box, sorted
+        std::vector<int> trianglesInBox(const BoundingBox & box) const
+        {
+            require(SPATIAL_INDEX);
+            double min[3] = { box.getMin().x(), box.getMin().y(), box.getMin().z() };
+            double max[3] = { box.getMax().x(), box.getMax().y(), box.getMax().z() };
+            std::vector<int> res;
+            bvh.boxOverlap(coords.data(), tris.data(), min, max, res);
+            return res;
+        }
 
         inline int tri_vertex_id(int t_id, int v_id) const
         {
@@ -299,6 +789,7 @@ template<typename real> class Trimesh
 
         inline Point<real> triangleNormal(int tid) const
         {
+            require(TRIANGLE_NORMALS);
             int tid_ptr = tid * 3;
             assert(checkBounds(triangleNormals, tid_ptr+2));
             return Point<real>(triangleNormals[tid_ptr + 0],
@@ -308,6 +799,7 @@ template<typename real> class Trimesh
 
         inline Point<real> vertexNormal(int vid) const
         {
+            require(VERTEX_NORMALS);
             int vid_ptr = vid * 3;
             assert(checkBounds(vertexNormals, vid_ptr+2));
             return Point<real>(vertexNormals[vid_ptr + 0],
@@ -331,23 +823,209 @@ template<typename real> class Trimesh
             coords[vid_ptr + 0] = pos.x();
             coords[vid_ptr + 1] = pos.y();
             coords[vid_ptr + 2] = pos.z();
+            invalidate(TRIANGLE_NORMALS | VERTEX_NORMALS | BBOX | SPATIAL_INDEX);
         }
 
-        void updateNormals()
+        // v = matrix * v + translation on every vertex, matrix is row major
+        void transform(const double matrix[9], const Pointd & translation)
         {
-            updateTriangleNormals();
-            updateVertexNormals();
+            real m[9], t[3] = {(real)translation.x(), (real)translation.y(), (real)translation.z()};
+            for(int i=0; i<9; ++i) m[i] = (real)matrix[i];
+            Parallel::forChunks(numVertices(), [&](int begin, int end)
+            {
+                GeometryKernels<real>::transform(&coords[begin*3], end - begin, m, t);
+            }, 65536);
+            invalidate(TRIANGLE_NORMALS | VERTEX_NORMALS | BBOX | SPATIAL_INDEX);
         }
 
-        void updateBbox()
+        void translate(const Pointd & translation)
         {
-            bbox.reset();
-            for(int vid=0; vid<numVertices(); ++vid)
+            const double identity[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+            int normals = derived.valid.load() & (TRIANGLE_NORMALS | VERTEX_NORMALS);
+            transform(identity, translation);
+            derived.valid.fetch_or(normals); // a translation does not change the normals
+        }
+
+        // renumbers the triangles along the Morton curve of their centroids, then the vertices
+        // by first use in the new triangle order (unreferenced vertices go last), so that loops
+        // over tris walk coords almost sequentially. Optional, typically right after load.
+        // The tables bring indices and per-element results back to the original numbering
+        trimeshRemap reorder()
+        {
+            trimeshRemap remap;
+            int nt = numTriangles(), nv = numVertices();
+            BoundingBox box = getBoundingBox();
+            Pointd lo = box.getMin(), hi = box.getMax();
+
+            std::vector< std::pair<unsigned long long,int> > codes(nt);
+            Parallel::forChunks(nt, [&](int begin, int end)
             {
-                Point<real> v = vertex(vid);
-                bbox.setMin(bbox.getMin().min(Pointd(v.x(), v.y(), v.z())));
-                bbox.setMax(bbox.getMax().max(Pointd(v.x(), v.y(), v.z())));
+                for(int tid=begin; tid<end; ++tid)
+                {
+                    double c[3] = {0, 0, 0};
+                    for(int i=0; i<3; ++i)
+                    {
+                        for(int k=0; k<3; ++k) c[k] += coords[tris[tid*3+i]*3 + k] / 3.0;
+                    }
+                    codes[tid] = std::make_pair(Morton::encode(Morton::quantize(c[0], lo.x(), hi.x()),
+                                                               Morton::quantize(c[1], lo.y(), hi.y()),
+                                                               Morton::quantize(c[2], lo.z(), hi.z())), tid);
+                }
+            });
+            Parallel::sort(codes.begin(), codes.end());
+
+            remap.triangleNewToOld.resize(nt);
+            remap.triangleOldToNew.resize(nt);
+            for(int tid=0; tid<nt; ++tid)
+            {
+                remap.triangleNewToOld[tid] = codes[tid].second;
+                remap.triangleOldToNew[codes[tid].second] = tid;
             }
+
+            remap.vertexOldToNew.assign(nv, -1);
+            remap.vertexNewToOld.clear();
+            remap.vertexNewToOld.reserve(nv);
+            for(int tid=0; tid<nt; ++tid)
+            {
+                for(int i=0; i<3; ++i)
+                {
+                    int vid = tris[remap.triangleNewToOld[tid]*3 + i];
+                    if (remap.vertexOldToNew[vid] < 0)
+                    {
+                        remap.vertexOldToNew[vid] = (int)remap.vertexNewToOld.size();
+                        remap.vertexNewToOld.push_back(vid);
+                    }
+                }
+            }
+            for(int vid=0; vid<nv; ++vid)
+            {
+                if (remap.vertexOldToNew[vid] < 0)
+                {
+                    remap.vertexOldToNew[vid] = (int)remap.vertexNewToOld.size();
+                    remap.vertexNewToOld.push_back(vid);
+                }
+            }
+
+            std::vector<real> newCoords(coords.size());
+            std::vector<int>  newTris(tris.size());
+            Parallel::forChunks(nv, [&](int begin, int end)
+            {
+                for(int vid=begin; vid<end; ++vid)
+                {
+                    for(int k=0; k<3; ++k) newCoords[vid*3 + k] = coords[remap.vertexNewToOld[vid]*3 + k];
+                }
+            });
+            Parallel::forChunks(nt, [&](int begin, int end)
+            {
+                for(int tid=begin; tid<end; ++tid)
+                {
+                    for(int i=0; i<3; ++i) newTris[tid*3 + i] = remap.vertexOldToNew[tris[remap.triangleNewToOld[tid]*3 + i]];
+                }
+            });
+            coords.swap(newCoords);
+            tris.swap(newTris);
+
+            int bboxValid = derived.valid.load() & BBOX; // same vertices, same box
+            invalidate(ALL_DERIVED);
+            derived.valid.fetch_or(bboxValid);
+            return remap;
+        }
+
+        // marks derived data as stale; call it with ALL_DERIVED after editing tris directly
+        // (invalidating the adjacency means a new topology: nothing can be patched any more)
+        void invalidate(int pieces)
+        {
+            if (pieces & ADJACENCY) derived.built = 0;
+            storedPieces &= ~pieces; // the copies in the file are stale too
+            if (!storedPieces) storedFile.reset();
+            derived.valid.fetch_and(~pieces, std::memory_order_release);
+        }
+
+        // computes the missing pieces now, the independent ones concurrently on the thread pool
+        void prefetch(int pieces = ALL_DERIVED) const
+        {
+            if (isValid(pieces)) return;
+            std::lock_guard<std::mutex> lock(derived.mutex);
+            int missing = pieces & ~derived.valid.load();
+            int stored  = missing & storedPieces;
+            if (stored) loadStored(stored); // parallel copies
+            missing &= ~stored;
+            std::vector<void (Trimesh::*)() const> jobs;
+            if (missing & ADJACENCY)        jobs.push_back(&Trimesh::buildAdjacency);
+            if (missing & TRIANGLE_NORMALS) jobs.push_back(&Trimesh::updateTriangleNormals);
+            if (missing & VERTEX_NORMALS)   jobs.push_back(&Trimesh::updateVertexNormals);
+            if (missing & BBOX)             jobs.push_back(&Trimesh::computeBbox);
+            if (missing & SPATIAL_INDEX)    jobs.push_back(&Trimesh::updateSpatialIndex);
+            Parallel::ThreadPool::shared().run((int)jobs.size(), [&](int i) { (this->*jobs[i])(); });
+            validate(missing | stored);
+        }
+
+        // the mesh and the derived data in pieces (computed now if needed, the spatial
+        // index is never saved) as a .tmb file: loading it gives the same arrays back, with no parsing
+        void saveBinary(const char * filename, int pieces = ADJACENCY | TRIANGLE_NORMALS | VERTEX_NORMALS | BBOX) const
+        {
+            pieces &= ~SPATIAL_INDEX;
+            prefetch(pieces);
+
+            BinaryMeshWriter writer;
+            writer.add(BinaryMesh::COORDS, coords);
+            writer.add(BinaryMesh::TRIS,   tris);
+            if (pieces & TRIANGLE_NORMALS) writer.add(BinaryMesh::TRIANGLE_NORMALS, triangleNormals);
+            if (pieces & VERTEX_NORMALS)   writer.add(BinaryMesh::VERTEX_NORMALS,   vertexNormals);
+            double box[6] = { bbox.getMin().x(), bbox.getMin().y(), bbox.getMin().z(), bbox.getMax().x(), bbox.getMax().y(), bbox.getMax().z() };
+            if (pieces & BBOX) writer.add(BinaryMesh::BBOX, BinaryMesh::FLOAT64, box, 6);
+            if (pieces & ADJACENCY)
+            {
+                writer.add(BinaryMesh::VTX2TRI_OFFSETS,    vtx2tri.vectorOffsets());
+                writer.add(BinaryMesh::VTX2TRI_INDICES,    vtx2tri.vectorIndices());
+                writer.add(BinaryMesh::VTX2VTX_OFFSETS,    vtx2vtx.vectorOffsets());
+                writer.add(BinaryMesh::VTX2VTX_INDICES,    vtx2vtx.vectorIndices());
+                writer.add(BinaryMesh::TRI2TRI_OFFSETS,    tri2tri.vectorOffsets());
+                writer.add(BinaryMesh::TRI2TRI_INDICES,    tri2tri.vectorIndices());
+                writer.add(BinaryMesh::EDGE2VTX,           edge2vtx);
+                writer.add(BinaryMesh::TRI2EDGE,           tri2edge);
+                writer.add(BinaryMesh::EDGE2TRI_OFFSETS,   edge2tri.vectorOffsets());
+                writer.add(BinaryMesh::EDGE2TRI_INDICES,   edge2tri.vectorIndices());
+                writer.add(BinaryMesh::EDGE_BOUNDARY,      edgeBoundary);
+                writer.add(BinaryMesh::NON_MANIFOLD_EDGES, BinaryMesh::INT32, nonManifoldEdges.data(), nonManifoldEdges.size() * 2); // pairs of ints
+            }
+            if (!writer.write(filename))
+            {
+                std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : saveBinary() : couldn't save " << filename << std::endl;
+            }
+        }
+
+        void updateNormals()
+        {
+            invalidate(TRIANGLE_NORMALS | VERTEX_NORMALS);
+            require(TRIANGLE_NORMALS | VERTEX_NORMALS);
+        }
+
+        // after setVertex on the vertices in vids only: patches the normals around them
+        // (normals never built for this topology are computed in full)
+        void updateNormals(const std::vector<int> & vids)
+        {
+            int normals = TRIANGLE_NORMALS | VERTEX_NORMALS;
+            require(ADJACENCY);
+            std::lock_guard<std::mutex> lock(derived.mutex);
+            int built = derived.built.load() & normals;
+            if (!(built & TRIANGLE_NORMALS)) updateTriangleNormals();
+            if (!(built & VERTEX_NORMALS))   updateVertexNormals();
+            updateNormalsAround(vids, built);
+            validate(normals);
+        }
+
+        void updateBbox()
+        {
+            invalidate(BBOX);
+            require(BBOX);
+        }
+
+        // refit keeps the tree of the original shape: after large deformations a new one is faster to query
+        void rebuildSpatialIndex()
+        {
+            derived.built.fetch_and(~SPATIAL_INDEX);
+            invalidate(SPATIAL_INDEX);
         }
 
 
@@ -0,0 +1,393 @@
+#ifndef WELD_H
+#define WELD_H
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#include "morton.h"
+#include "parallel.h"
+
+/**
+ * @brief Merges coincident vertices of a triangle soup (e.g. STL) into an indexed mesh.
+ *
+ * The vertices are sorted by the cell of a grid they fall in (Morton code of the cell, or a
+ * hash of it for very fine grids), in parallel. Every vertex is compared with the ones of
+ * its cell and of the cells around it within the tolerance, and the pairs closer than the
+ * tolerance are joined (concurrent union find): a chain of close vertices collapses into
+ * one, even if its ends are farther apart than the tolerance, and takes the place and
+ * coordinates of its first vertex.
+ * With tolerance 0 only vertices with identical coordinates are merged.
+ *
+ * After the merge, triangles with two equal corners (degenerate) and triangles on the same
+ * three vertices as an earlier one, in any order (duplicate), are removed.
+ */
+
+struct weldReport
+{
+    int mergedVertices  = 0; // vertices removed
+    int degenerateFaces = 0;
+    int duplicateFaces  = 0;
+};
+
+namespace Weld {
+
+inline uint64_t mix(uint64_t h)
+{
+    h ^= h >> 33; h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+// cells of a grid with less than 2^21 - 2 cells per axis are keyed by their Morton code
+// (shifted by one, neighbors included): no collisions, and cells close in space are close
+// once sorted. Any other cell by a hash of its indices
+inline uint64_t cellKey(int64_t x, int64_t y, int64_t z, bool morton)
+{
+    if (morton) return Morton::encode((unsigned int)(x + 1), (unsigned int)(y + 1), (unsigned int)(z + 1));
+    return mix((uint64_t)x * 0x9e3779b97f4a7c15ull ^ mix((uint64_t)y + 0x632be59bd9b4e019ull) ^ mix((uint64_t)z * 0x85ebca77c2b2ae63ull + 1));
+}
+
+// the cell of a coordinate: the grid index, or the bits of the value when cells are points
+inline int64_t cellOf(double v, double min, double invSize)
+{
+    if (invSize > 0) return (int64_t)std::floor((v - min) * invSize);
+    v += 0.0; // -0 and +0 in the same cell
+    int64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+struct keyedVertex
+{
+    uint64_t key;
+    int      vid;
+
+    inline bool operator<(const keyedVertex & other) const
+    {
+        return key < other.key;
+    }
+};
+
+struct sortedTriangle
+{
+    int v[3]; // ascending
+    int tid;
+
+    inline bool operator<(const sortedTriangle & other) const
+    {
+        for(int i=0; i<3; ++i)
+        {
+            if (v[i] != other.v[i]) return v[i] < other.v[i];
+        }
+        return tid < other.tid;
+    }
+
+    inline bool sameVertices(const sortedTriangle & other) const
+    {
+        return v[0] == other.v[0] && v[1] == other.v[1] && v[2] == other.v[2];
+    }
+};
+
+// union find, safe to join from several threads: roots are only ever linked below a
+// lower numbered root (compare and swap), so the root of a set is its lowest element
+class DisjointSets
+{
+    public:
+
+        explicit DisjointSets(int n) : parent(n)
+        {
+            Parallel::forChunks(n, [&](int begin, int end)
+            {
+                for(int i=begin; i<end; ++i) parent[i].store(i, std::memory_order_relaxed);
+            });
+        }
+
+        int find(int x)
+        {
+            for(int p = parent[x].load(); p != x; p = parent[x].load())
+            {
+                int grandParent = parent[p].load();
+                parent[x].compare_exchange_weak(p, grandParent); // path halving, may fail harmlessly
+                x = grandParent;
+            }
+            return x;
+        }
+
+        void join(int a, int b)
+        {
+            for(;;)
+            {
+                a = find(a);
+                b = find(b);
+                if (a == b) return;
+                if (a < b) std::swap(a, b);
+                int expected = a;
+                if (parent[a].compare_exchange_strong(expected, b)) return;
+            }
+        }
+
+    private:
+
+        std::vector<std::atomic<int>> parent;
+};
+
+// open addressing table: cell key -> range of the sorted vertices
+class CellTable
+{
+    public:
+
+        void build(const std::vector<keyedVertex> & sorted)
+        {
+            starts.clear();
+            for(int i=0; i<(int)sorted.size(); ++i)
+            {
+                if (i == 0 || sorted[i].key != sorted[i-1].key) starts.push_back(i);
+            }
+            int runs = (int)starts.size();
+            starts.push_back((int)sorted.size());
+            size_t capacity = 16;
+            while (capacity < (size_t)runs * 2) capacity *= 2;
+            mask = capacity - 1;
+            slots.assign(capacity, Slot());
+            for(int r=0; r<runs; ++r)
+            {
+                int i = starts[r], j = starts[r+1];
+                size_t s = mix(sorted[i].key) & mask;
+                while (slots[s].end > 0) s = (s + 1) & mask;
+                slots[s].key   = sorted[i].key;
+                slots[s].begin = i;
+                slots[s].end   = j;
+            }
+        }
+
+        // false if no vertex is in a cell with that key
+        inline bool find(uint64_t key, int & begin, int & end) const
+        {
+            for(size_t s = mix(key) & mask; slots[s].end > 0; s = (s + 1) & mask)
+            {
+                if (slots[s].key == key)
+                {
+                    begin = slots[s].begin;
+                    end   = slots[s].end;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // the vertices with the same key (one cell, or more on a hash collision)
+        int numRuns()           const { return (int)starts.size() - 1; }
+        int runBegin(int run)   const { return starts[run];   }
+        int runEnd(int run)     const { return starts[run+1]; }
+
+    private:
+
+        struct Slot
+        {
+            uint64_t key   = 0;
+            int      begin = 0;
+            int      end   = 0; // 0: empty slot
+        };
+
+        std::vector<Slot> slots;
+        std::vector<int>  starts;
+        size_t            mask = 0;
+};
+
+}
+
+// the default tolerance of a mesh: relative times the diagonal of its bounding box
+template<typename real>
+double weldTolerance(const std::vector<real> & xyz, double relative = 1e-6)
+{
+    double min[3] = { DBL_MAX, DBL_MAX, DBL_MAX }, max[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+    for(size_t i=0; i<xyz.size(); ++i)
+    {
+        min[i%3] = std::min(min[i%3], (double)xyz[i]);
+        max[i%3] = std::max(max[i%3], (double)xyz[i]);
+    }
+    if (xyz.empty()) return 0;
+    double dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+    return relative * std::sqrt(dx*dx + dy*dy + dz*dz);
+}
+
+// xyz and tri are replaced by the welded mesh. Vertices not used by any triangle are kept
+// (merged like the others). tolerance is an absolute distance
+template<typename real>
+weldReport weldVertices(std::vector<real> & xyz, std::vector<int> & tri, double tolerance)
+{
+    using namespace Weld;
+    weldReport report;
+    int nv = (int)xyz.size() / 3;
+
+    double min[3] = { DBL_MAX, DBL_MAX, DBL_MAX }, max[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+    for(int i=0; i<nv*3; ++i)
+    {
+        min[i%3] = std::min(min[i%3], (double)xyz[i]);
+        max[i%3] = std::max(max[i%3], (double)xyz[i]);
+    }
+    // cells must have an index that fits 64 bits: tolerances far below the precision of the
+    // coordinates are as good as 0
+    double extent = 0;
+    for(int k=0; k<3 && nv>0; ++k) extent = std::max(extent, max[k] - min[k]);
+    double invSize = (tolerance > 0 && extent / tolerance < 1e15) ? 1 / (4 * tolerance) : 0;
+    bool neighbors = invSize > 0; // else cells are single points: no other cell is close
+    bool morton    = neighbors && extent * invSize < (1 << 21) - 3;
+    double tolerance2 = invSize > 0 ? tolerance * tolerance : 0;
+
+    std::vector<keyedVertex> sorted(nv);
+    Parallel::forChunks(nv, [&](int begin, int end)
+    {
+        for(int vid=begin; vid<end; ++vid)
+        {
+            const real * p = &xyz[vid*3];
+            sorted[vid].key = cellKey(cellOf(p[0], min[0], invSize), cellOf(p[1], min[1], invSize), cellOf(p[2], min[2], invSize), morton);
+            sorted[vid].vid = vid;
+        }
+    });
+    Parallel::sort(sorted.begin(), sorted.end());
+    CellTable cells;
+    cells.build(sorted);
+
+    // every pair within the tolerance joins its two sets: the root of a set is its lowest
+    // numbered vertex, whatever the order the pairs are found in. Cells are 4 times the
+    // tolerance: the box of a cell's vertices grown by the tolerance reaches only a few of
+    // the 26 cells around it (looked up once per cell, once per vertex on a hash collision)
+    DisjointSets sets(nv);
+    auto cellOfVertex = [&](int vid, int64_t c[3])
+    {
+        for(int k=0; k<3; ++k) c[k] = cellOf(xyz[vid*3+k], min[k], invSize);
+    };
+    auto joinClose = [&](int vid, int first, int last)
+    {
+        const real * p = &xyz[vid*3];
+        for(int i=first; i<last; ++i)
+        {
+            int other = sorted[i].vid;
+            const real * q = &xyz[other*3];
+            double ex = (double)p[0] - q[0], ey = (double)p[1] - q[1], ez = (double)p[2] - q[2];
+            if (ex*ex + ey*ey + ez*ez <= tolerance2) sets.join(vid, other);
+        }
+    };
+    // the vertices sorted[first, last), all in cell c, against the cells around it they reach
+    auto joinNeighbors = [&](int first, int last, const int64_t c[3])
+    {
+        int64_t lo[3], hi[3];
+        for(int k=0; k<3; ++k)
+        {
+            double a = DBL_MAX, b = -DBL_MAX;
+            for(int i=first; i<last; ++i)
+            {
+                a = std::min(a, (double)xyz[sorted[i].vid*3+k]);
+                b = std::max(b, (double)xyz[sorted[i].vid*3+k]);
+            }
+            lo[k] = std::max(c[k] - 1, cellOf(a - tolerance, min[k], invSize));
+            hi[k] = std::min(c[k] + 1, cellOf(b + tolerance, min[k], invSize));
+        }
+        for(int64_t x=lo[0]; x<=hi[0]; ++x)
+        for(int64_t y=lo[1]; y<=hi[1]; ++y)
+        for(int64_t z=lo[2]; z<=hi[2]; ++z)
+        {
+            int nFirst, nLast;
+            if (x == c[0] && y == c[1] && z == c[2]) continue;
+            if (!cells.find(cellKey(x, y, z, morton), nFirst, nLast)) continue;
+            for(int i=first; i<last; ++i) joinClose(sorted[i].vid, nFirst, nLast);
+        }
+    };
+    Parallel::forChunks(cells.numRuns(), [&](int begin, int end)
+    {
+        for(int run=begin; run<end; ++run)
+        {
+            int first = cells.runBegin(run), last = cells.runEnd(run);
+            for(int i=first; i<last; ++i) joinClose(sorted[i].vid, i + 1, last);
+            if (!neighbors) continue;
+
+            int64_t c[3], other[3];
+            cellOfVertex(sorted[first].vid, c);
+            bool oneCell = true;
+            for(int i=first+1; i<last && oneCell; ++i)
+            {
+                cellOfVertex(sorted[i].vid, other);
+                oneCell = other[0] == c[0] && other[1] == c[1] && other[2] == c[2];
+            }
+            if (oneCell) joinNeighbors(first, last, c);
+            else for(int i=first; i<last; ++i)
+            {
+                cellOfVertex(sorted[i].vid, c);
+                joinNeighbors(i, i + 1, c);
+            }
+        }
+    }, 4096);
+    std::vector<keyedVertex>().swap(sorted);
+
+    std::vector<int> rep(nv), next(nv);
+    Parallel::forChunks(nv, [&](int begin, int end)
+    {
+        for(int vid=begin; vid<end; ++vid) rep[vid] = sets.find(vid);
+    });
+
+    // roots keep their position, in their order
+    std::vector<int> newId(nv);
+    int kept = 0;
+    for(int vid=0; vid<nv; ++vid) newId[vid] = (rep[vid] == vid) ? kept++ : -1;
+    std::vector<real> newXyz(kept * 3);
+    Parallel::forChunks(nv, [&](int begin, int end)
+    {
+        for(int vid=begin; vid<end; ++vid)
+        {
+            if (newId[vid] >= 0) std::copy(&xyz[vid*3], &xyz[vid*3] + 3, &newXyz[newId[vid]*3]);
+        }
+    });
+    Parallel::forChunks(nv, [&](int begin, int end)
+    {
+        for(int vid=begin; vid<end; ++vid) next[vid] = newId[rep[vid]];
+    });
+    xyz.swap(newXyz);
+    report.mergedVertices = nv - kept;
+
+    // faces on the merged vertices: degenerate ones out, then duplicates (sorted corners)
+    int nt = (int)tri.size() / 3;
+    std::vector<sortedTriangle> faces(nt);
+    Parallel::forChunks(nt, [&](int begin, int end)
+    {
+        for(int tid=begin; tid<end; ++tid)
+        {
+            for(int i=0; i<3; ++i) tri[tid*3+i] = next[tri[tid*3+i]];
+            int * v = faces[tid].v;
+            std::copy(&tri[tid*3], &tri[tid*3] + 3, v);
+            std::sort(v, v + 3);
+            faces[tid].tid = tid;
+        }
+    });
+    Parallel::sort(faces.begin(), faces.end());
+
+    std::vector<char> keep(nt, 1);
+    Parallel::forChunks(nt, [&](int begin, int end)
+    {
+        for(int i=begin; i<end; ++i)
+        {
+            const int * v = faces[i].v;
+            if (v[0] == v[1] || v[1] == v[2])            keep[faces[i].tid] = 0;
+            else if (i > 0 && faces[i].sameVertices(faces[i-1])) keep[faces[i].tid] = 2; // not the first of its vertices
+        }
+    });
+    int last = 0;
+    for(int tid=0; tid<nt; ++tid)
+    {
+        if (keep[tid] == 0) ++report.degenerateFaces;
+        if (keep[tid] == 2) ++report.duplicateFaces;
+        if (keep[tid] != 1) continue;
+        if (last != tid) std::copy(&tri[tid*3], &tri[tid*3] + 3, &tri[last*3]);
+        ++last;
+    }
+    tri.resize(last * 3);
+    return report;
+}
+
+#endif // WELD_H
@@ -0,0 +1,307 @@
+#include "visibilitycache.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#define CACHE_MAGIC     "VISC"
+#define CACHE_VERSION   2           // also the version of the visibility: bump it when the rays or the tie-breaks change
+#define DIR_STEPS       4096.0      // direction quantization: 1/4096 per component
+#define INDEX_FILE      "index.txt"
+
+namespace {
+
+inline unsigned long long mixWord(unsigned long long h, unsigned long long v){
+    v *= 0xff51afd7ed558ccdull;
+    v ^= v >> 33;
+    h ^= v;
+    h = (h << 27) | (h >> 37);
+    return h * 5 + 0x52dce729;
+}
+
+inline unsigned long long finalize(unsigned long long h){
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+inline unsigned long long doubleBits(double d){
+    unsigned long long bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    return bits;
+}
+
+void writeVarint(std::string& out, unsigned long long v){
+    while (v >= 0x80){
+        out.push_back((char)((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+bool readVarint(const char*& p, const char* end, unsigned long long& v){
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7){
+        unsigned char c = *p++;
+        v |= (unsigned long long)(c & 0x7f) << shift;
+        if (!(c & 0x80)) return true;
+    }
+    return false;
+}
+
+template<typename T>
+void writePod(std::string& out, const T& v){
+    out.append((const char*)&v, sizeof(T));
+}
+
+template<typename T>
+bool readPod(const char*& p, const char* end, T& v){
+    if (end - p < (long)sizeof(T)) return false;
+    std::memcpy(&v, p, sizeof(T));
+    p += sizeof(T);
+    return true;
+}
+
+//one varint per ray: the face hit + 1, 0 if none
+std::string encodeHits(const std::vector<int>& hits){
+    std::string out;
+    for (int h : hits) writeVarint(out, (unsigned long long)(h + 1));
+    return out;
+}
+
+bool decodeHits(const char* p, const char* end, unsigned int n, std::vector<int>& hits){
+    hits.resize(n);
+    unsigned long long v;
+    for (unsigned int i = 0; i < n; i++){
+        if (!readVarint(p, end, v) || v > n) return false;
+        hits[i] = (int)v - 1;
+    }
+    return p == end;
+}
+
+void quantizeDirection(const Vec3& direction, int q[3]){
+    Vec3 d = direction;
+    d.normalize();
+    q[0] = (int)std::floor(d.x() * DIR_STEPS + 0.5);
+    q[1] = (int)std::floor(d.y() * DIR_STEPS + 0.5);
+    q[2] = (int)std::floor(d.z() * DIR_STEPS + 0.5);
+}
+
+}
+
+VisibilityCache::VisibilityCache() : maxBytes(DEFAULT_MAX_BYTES), totalBytes(0){
+}
+
+VisibilityCache::VisibilityCache(const std::string& directory, unsigned long long maxBytes) :
+    maxBytes(maxBytes), totalBytes(0){
+    setDirectory(directory);
+}
+
+VisibilityCache::~VisibilityCache(){
+    if (isEnabled()) saveIndex();
+}
+
+void VisibilityCache::setDirectory(const std::string& directory){
+    if (isEnabled()) saveIndex();
+    this->directory = directory;
+    lru.clear();
+    entries.clear();
+    totalBytes = 0;
+    if (isEnabled()) loadIndex();
+}
+
+void VisibilityCache::setMaxBytes(unsigned long long maxBytes){
+    this->maxBytes = maxBytes;
+    evict();
+}
+
+bool VisibilityCache::isEnabled() const{
+    return !directory.empty();
+}
+
+bool VisibilityCache::lookup(unsigned long long meshKey, const Vec3& direction, unsigned int nFaces,
+                             std::vector<int>& front, std::vector<int>& back){
+    if (!isEnabled()) return false;
+    std::string name = entryName(meshKey, direction);
+    std::map<std::string, EntryList::iterator>::iterator it = entries.find(name);
+    if (it == entries.end()) return false;
+
+    std::ifstream file(entryPath(name).c_str(), std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const char* p = data.data();
+    const char* end = p + data.size();
+
+    unsigned int version = 0, faces = 0, frontBytes = 0, backBytes = 0;
+    unsigned long long key = 0;
+    int q[3], qd[3];
+    quantizeDirection(direction, qd);
+    bool valid = data.size() > 4 && std::memcmp(p, CACHE_MAGIC, 4) == 0;
+    p += 4;
+    valid = valid && readPod(p, end, version) && version == CACHE_VERSION &&
+            readPod(p, end, key) && key == meshKey &&
+            readPod(p, end, q) && q[0] == qd[0] && q[1] == qd[1] && q[2] == qd[2] &&
+            readPod(p, end, faces) && faces == nFaces &&
+            readPod(p, end, frontBytes) && readPod(p, end, backBytes) &&
+            end - p == (long)frontBytes + (long)backBytes &&
+            decodeHits(p, p + frontBytes, nFaces, front) &&
+            decodeHits(p + frontBytes, end, nFaces, back);
+
+    if (!valid){
+        //missing, truncated or stale file
+        remove(it->second);
+        return false;
+    }
+    touch(it->second);
+    return true;
+}
+
+void VisibilityCache::store(unsigned long long meshKey, const Vec3& direction,
+                            const std::vector<int>& front, const std::vector<int>& back){
+    if (!isEnabled()) return;
+    std::string name = entryName(meshKey, direction);
+    std::string frontData = encodeHits(front);
+    std::string backData = encodeHits(back);
+    int q[3];
+    quantizeDirection(direction, q);
+
+    std::string data(CACHE_MAGIC);
+    writePod(data, (unsigned int)CACHE_VERSION);
+    writePod(data, meshKey);
+    writePod(data, q);
+    writePod(data, (unsigned int)front.size());
+    writePod(data, (unsigned int)frontData.size());
+    writePod(data, (unsigned int)backData.size());
+    data += frontData;
+    data += backData;
+
+    std::ofstream file(entryPath(name).c_str(), std::ios::binary | std::ios::trunc);
+    file.write(data.data(), data.size());
+    if (!file) return;
+
+    std::map<std::string, EntryList::iterator>::iterator it = entries.find(name);
+    if (it != entries.end()){
+        totalBytes -= it->second->bytes;
+        lru.erase(it->second);
+    }
+    Entry e = {name, meshKey, data.size()};
+    lru.push_front(e);
+    entries[name] = lru.begin();
+    totalBytes += e.bytes;
+    std::ostringstream line;
+    line << e.name << " " << e.meshKey << " " << e.bytes;
+    appendIndex(line.str());
+    evict();
+}
+
+void VisibilityCache::invalidate(unsigned long long meshKey){
+    for (EntryList::iterator it = lru.begin(); it != lru.end(); ){
+        EntryList::iterator next = it;
+        ++next;
+        if (it->meshKey == meshKey) remove(it);
+        it = next;
+    }
+}
+
+void VisibilityCache::clear(){
+    while (!lru.empty()) remove(lru.begin());
+    saveIndex();
+}
+
+unsigned long long VisibilityCache::meshHash(const DrawableEigenMesh& mesh){
+    unsigned long long h = mixWord(0, mesh.getNumberVertices());
+    h = mixWord(h, mesh.getNumberFaces());
+    for (unsigned int i = 0; i < mesh.getNumberVertices(); i++){
+        Pointd v = mesh.getVertex(i);
+        h = mixWord(h, doubleBits(v.x()));
+        h = mixWord(h, doubleBits(v.y()));
+        h = mixWord(h, doubleBits(v.z()));
+    }
+    for (unsigned int i = 0; i < mesh.getNumberFaces(); i++){
+        Pointi f = mesh.getFace(i);
+        h = mixWord(h, ((unsigned long long)(unsigned int)f.x() << 32) | (unsigned int)f.y());
+        h = mixWord(h, (unsigned int)f.z());
+    }
+    return finalize(h);
+}
+
+std::string VisibilityCache::entryName(unsigned long long meshKey, const Vec3& direction) const{
+    int q[3];
+    quantizeDirection(direction, q);
+    char name[64];
+    std::snprintf(name, sizeof(name), "%016llx_%d_%d_%d.vis", meshKey, q[0], q[1], q[2]);
+    return name;
+}
+
+std::string VisibilityCache::entryPath(const std::string& name) const{
+    return directory + "/" + name;
+}
+
+void VisibilityCache::touch(EntryList::iterator it){
+    lru.splice(lru.begin(), lru, it);
+}
+
+void VisibilityCache::remove(EntryList::iterator it){
+    std::remove(entryPath(it->name).c_str());
+    appendIndex("- " + it->name);
+    totalBytes -= it->bytes;
+    entries.erase(it->name);
+    lru.erase(it);
+}
+
+void VisibilityCache::evict(){
+    while (totalBytes > maxBytes && !lru.empty()){
+        EntryList::iterator last = lru.end();
+        --last;
+        remove(last);
+    }
+}
+
+//the index is a log, oldest line first: "name meshKey bytes" when an entry is stored
+//(it becomes the most recently used), "- name" when it is removed
+void VisibilityCache::loadIndex(){
+    std::ifstream file(entryPath(INDEX_FILE).c_str());
+    std::string line;
+    while (std::getline(file, line)){
+        std::istringstream iss(line);
+        Entry e;
+        if (line.compare(0, 2, "- ") == 0){
+            std::map<std::string, EntryList::iterator>::iterator it = entries.find(line.substr(2));
+            if (it != entries.end()){
+                totalBytes -= it->second->bytes;
+                lru.erase(it->second);
+                entries.erase(it);
+            }
+            continue;
+        }
+        if (!(iss >> e.name >> e.meshKey >> e.bytes)) continue;
+        std::map<std::string, EntryList::iterator>::iterator it = entries.find(e.name);
+        if (it != entries.end()){
+            totalBytes -= it->second->bytes;
+            lru.erase(it->second);
+        }
+        lru.push_front(e);
+        entries[e.name] = lru.begin();
+        totalBytes += e.bytes;
+    }
+    //compacted once, then only appended to
+    saveIndex();
+    evict();
+}
+
+void VisibilityCache::saveIndex() const{
+    if (!isEnabled()) return;
+    std::ofstream file(entryPath(INDEX_FILE).c_str(), std::ios::trunc);
+    for (EntryList::const_reverse_iterator it = lru.rbegin(); it != lru.rend(); ++it){
+        file << it->name << " " << it->meshKey << " " << it->bytes << "\n";
+    }
+}
+
+void VisibilityCache::appendIndex(const std::string& line) const{
+    std::ofstream file(entryPath(INDEX_FILE).c_str(), std::ios::app);
+    file << line << "\n";
+}
@@ -0,0 +1,88 @@
+#ifndef VISIBILITYCACHE_H
+#define VISIBILITYCACHE_H
+
+#include <eigenmesh/eigenmesh/gui/drawableeigenmesh.h>
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+typedef std::vector<bool>                                         FaceBitset;
+
+/**
+ * @brief Persistent on-disk cache of the per-direction visibility computed by PolylinesCheck::check.
+ *
+ * An entry is keyed by a content hash of the mesh (see meshHash) and by the quantized
+ * direction of the rays, and stores for the ray shot through every face the face hit
+ * first (front) and last (back), -1 if the ray hits nothing. Keeping the outcome of each
+ * ray (not only the faces marked) lets PolylinesCheck replay exactly the rays an uncached
+ * check would shoot, in the same order.
+ * Since the key depends on the geometry, editing the mesh automatically invalidates every
+ * entry; stale entries are dropped by the LRU policy once the size cap is exceeded.
+ * The index of the entries is an append-only log, compacted when the cache is opened and
+ * closed: storing an entry costs a single line.
+ */
+class VisibilityCache
+{
+    public:
+        VisibilityCache();
+
+        VisibilityCache(const std::string& directory, unsigned long long maxBytes = DEFAULT_MAX_BYTES);
+
+        ~VisibilityCache();
+
+        void    setDirectory            (const std::string& directory);
+
+        void    setMaxBytes             (unsigned long long maxBytes);
+
+        bool    isEnabled               () const;
+
+        bool    lookup                  (unsigned long long meshKey, const Vec3& direction, unsigned int nFaces,
+                                         std::vector<int>& front, std::vector<int>& back);
+
+        void    store                   (unsigned long long meshKey, const Vec3& direction,
+                                         const std::vector<int>& front, const std::vector<int>& back);
+
+        void    invalidate              (unsigned long long meshKey);
+
+        void    clear                   ();
+
+        static unsigned long long meshHash(const DrawableEigenMesh& mesh);
+
+        static const unsigned long long DEFAULT_MAX_BYTES = 256ull << 20;
+
+    private:
+
+        struct Entry {
+            std::string         name;
+            unsigned long long  meshKey;
+            unsigned long long  bytes;
+        };
+
+        typedef std::list<Entry>                                  EntryList;
+
+        std::string                                 directory;
+        unsigned long long                          maxBytes;
+        unsigned long long                          totalBytes;
+        EntryList                                   lru;        //most recently used first
+        std::map<std::string, EntryList::iterator>  entries;
+
+        std::string entryName           (unsigned long long meshKey, const Vec3& direction) const;
+
+        std::string entryPath           (const std::string& name) const;
+
+        void        touch               (EntryList::iterator it);
+
+        void        remove              (EntryList::iterator it);
+
+        void        evict               ();
+
+        void        loadIndex           ();
+
+        void        saveIndex           () const;
+
+        void        appendIndex         (const std::string& line) const;
+};
+
+#endif // VISIBILITYCACHE_H
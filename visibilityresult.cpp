@@ -0,0 +1,235 @@
+#include "visibilityresult.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include <QColor>
+
+#include <trimesh/parallel.h>
+
+#define RESULT_MAGIC    "VRES"
+#define RESULT_VERSION  1
+
+namespace {
+
+template<typename T>
+void writePod(std::string& out, const T& v){
+    out.append((const char*)&v, sizeof(T));
+}
+
+template<typename T>
+bool readPod(const char*& p, const char* end, T& v){
+    if (end - p < (long)sizeof(T)) return false;
+    std::memcpy(&v, p, sizeof(T));
+    p += sizeof(T);
+    return true;
+}
+
+void writeWords(std::string& out, const std::vector<unsigned long long>& words){
+    out.append((const char*)words.data(), words.size() * sizeof(unsigned long long));
+}
+
+bool readWords(const char*& p, const char* end, unsigned int n, std::vector<unsigned long long>& words){
+    if ((unsigned long long)(end - p) < (unsigned long long)n * sizeof(unsigned long long)) return false;
+    words.resize(n);
+    std::memcpy(words.data(), p, n * sizeof(unsigned long long));
+    p += n * sizeof(unsigned long long);
+    return true;
+}
+
+inline bool testBit(const std::vector<unsigned long long>& words, unsigned int i){
+    return (words[i >> 6] >> (i & 63)) & 1;
+}
+
+inline void setBit(std::vector<unsigned long long>& words, unsigned int i){
+    words[i >> 6] |= 1ull << (i & 63);
+}
+
+}
+
+VisibilityResult::VisibilityResult() : meshKey(0), nFaces(0){
+}
+
+void VisibilityResult::clear(){
+    meshKey = 0;
+    nFaces = 0;
+    meshFile.clear();
+    orientations.clear();
+    orientationSelected.clear();
+    unique.clear();
+}
+
+void VisibilityResult::setMesh(unsigned long long meshKey, unsigned int nFaces, const std::string& meshFile){
+    clear();
+    this->meshKey = meshKey;
+    this->nFaces = nFaces;
+    this->meshFile = meshFile;
+}
+
+void VisibilityResult::addOrientation(const Vec3& direction, int color,
+                                      const std::vector<int>& covered, const FaceBitset& front){
+    Orientation o;
+    o.direction = direction;
+    o.color = color;
+    o.covered.assign(words(), 0);
+    o.front.assign(words(), 0);
+    for (unsigned int i = 0; i < nFaces && i < covered.size(); i++){
+        if (covered[i] == 1) setBit(o.covered, i);
+    }
+    for (unsigned int i = 0; i < nFaces && i < front.size(); i++){
+        if (front[i]) setBit(o.front, i);
+    }
+    orientations.push_back(o);
+}
+
+void VisibilityResult::setSelection(const std::vector<int>& orientationSelected,
+                                    const std::vector<std::vector<int>>& uniqueTriangle){
+    this->orientationSelected = orientationSelected;
+    unique.assign(orientationSelected.size(), PackedBitset(words(), 0));
+    for (unsigned int i = 0; i < uniqueTriangle.size() && i < unique.size(); i++){
+        for (int f : uniqueTriangle[i]){
+            if (f >= 0 && (unsigned int)f < nFaces) setBit(unique[i], f);
+        }
+    }
+}
+
+bool VisibilityResult::save(const std::string& filename) const{
+    std::string data(RESULT_MAGIC);
+    writePod(data, (unsigned int)RESULT_VERSION);
+    writePod(data, meshKey);
+    writePod(data, nFaces);
+    writePod(data, (unsigned int)meshFile.size());
+    data += meshFile;
+    writePod(data, (unsigned int)orientations.size());
+    for (const Orientation& o : orientations){
+        double d[3] = {o.direction.x(), o.direction.y(), o.direction.z()};
+        writePod(data, d);
+        writePod(data, o.color);
+    }
+    for (const Orientation& o : orientations) writeWords(data, o.covered);
+    for (const Orientation& o : orientations) writeWords(data, o.front);
+    writePod(data, (unsigned int)orientationSelected.size());
+    for (int s : orientationSelected) writePod(data, s);
+    for (const PackedBitset& u : unique) writeWords(data, u);
+
+    std::ofstream file(filename.c_str(), std::ios::binary | std::ios::trunc);
+    file.write(data.data(), data.size());
+    if (!file){
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : save() : couldn't write output file " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool VisibilityResult::load(const std::string& filename){
+    clear();
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    if (!file){
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : load() : couldn't open input file " << filename << std::endl;
+        return false;
+    }
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const char* p = data.data();
+    const char* end = p + data.size();
+
+    unsigned int version = 0, nameBytes = 0, nOrientations = 0, nSelected = 0;
+    bool valid = data.size() > 4 && std::memcmp(p, RESULT_MAGIC, 4) == 0;
+    p += 4;
+    valid = valid && readPod(p, end, version) && version == RESULT_VERSION &&
+            readPod(p, end, meshKey) && readPod(p, end, nFaces) &&
+            readPod(p, end, nameBytes) && (unsigned long long)(end - p) >= nameBytes;
+    if (valid){
+        meshFile.assign(p, nameBytes);
+        p += nameBytes;
+        valid = readPod(p, end, nOrientations) &&
+                (unsigned long long)(end - p) >= (unsigned long long)nOrientations * (3*sizeof(double) + sizeof(int));
+    }
+    if (valid){
+        orientations.resize(nOrientations);
+        for (Orientation& o : orientations){
+            double d[3];
+            readPod(p, end, d);
+            readPod(p, end, o.color);
+            o.direction = Vec3(d[0], d[1], d[2]);
+        }
+        for (unsigned int i = 0; valid && i < nOrientations; i++) valid = readWords(p, end, words(), orientations[i].covered);
+        for (unsigned int i = 0; valid && i < nOrientations; i++) valid = readWords(p, end, words(), orientations[i].front);
+        valid = valid && readPod(p, end, nSelected) &&
+                (unsigned long long)(end - p) >= (unsigned long long)nSelected * sizeof(int);
+    }
+    if (valid){
+        orientationSelected.resize(nSelected);
+        for (int& s : orientationSelected){
+            readPod(p, end, s);
+            valid = valid && s >= 0 && (unsigned int)s < nOrientations;
+        }
+        unique.resize(nSelected);
+        for (unsigned int i = 0; valid && i < nSelected; i++) valid = readWords(p, end, words(), unique[i]);
+        valid = valid && p == end;
+    }
+
+    if (!valid){
+        std::cerr << "ERROR : " << __FILE__ << ", line " << __LINE__ << " : load() : " << filename << " is not a valid visibility result" << std::endl;
+        clear();
+        return false;
+    }
+    return true;
+}
+
+unsigned long long VisibilityResult::getMeshKey() const{
+    return meshKey;
+}
+
+unsigned int VisibilityResult::getNumberFaces() const{
+    return nFaces;
+}
+
+const std::string& VisibilityResult::getMeshFile() const{
+    return meshFile;
+}
+
+unsigned int VisibilityResult::getNumberOrientations() const{
+    return orientations.size();
+}
+
+Vec3 VisibilityResult::getDirection(unsigned int orientation) const{
+    return orientations[orientation].direction;
+}
+
+const std::vector<int>& VisibilityResult::getOrientationSelected() const{
+    return orientationSelected;
+}
+
+void VisibilityResult::colorOrientation(DrawableEigenMesh* mesh, unsigned int orientation) const{
+    //stessi colori degli OBJ per orientamento: fronte, retro e grigio per le facce non viste
+    const Orientation& o = orientations[orientation];
+    QColor grey, front, back;
+    grey.setHsv(100, 0, 127);
+    front.setHsv(o.color, 255, 255);
+    back.setHsv(120 + o.color, 255, 255);
+    Parallel::forEach(nFaces, [&](int f){
+        const QColor& c = !testBit(o.covered, f) ? grey : testBit(o.front, f) ? front : back;
+        mesh->setFaceColor(c.redF(), c.greenF(), c.blueF(), f);
+    });
+}
+
+void VisibilityResult::colorUniqueFaces(DrawableEigenMesh* mesh, unsigned int orientation) const{
+    //stessi colori degli OBJ "singole": in rosso le facce viste solo da questo orientamento
+    const PackedBitset* mask = nullptr;
+    for (unsigned int i = 0; i < orientationSelected.size(); i++){
+        if ((unsigned int)orientationSelected[i] == orientation) mask = &unique[i];
+    }
+    QColor grey, red;
+    grey.setHsv(0, 0, 127);
+    red.setHsv(0, 255, 255);
+    Parallel::forEach(nFaces, [&](int f){
+        const QColor& c = mask != nullptr && testBit(*mask, f) ? red : grey;
+        mesh->setFaceColor(c.redF(), c.greenF(), c.blueF(), f);
+    });
+}
+
+unsigned int VisibilityResult::words() const{
+    return (nFaces + 63) / 64;
+}
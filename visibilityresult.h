@@ -0,0 +1,79 @@
+#ifndef VISIBILITYRESULT_H
+#define VISIBILITYRESULT_H
+
+#include <eigenmesh/eigenmesh/gui/drawableeigenmesh.h>
+
+#include <string>
+#include <vector>
+
+#include <visibilitycache.h>
+
+/**
+ * @brief Result of a step by step sweep (DrawManager::on_stepByStep_clicked), saved in a
+ * single file instead of one colored OBJ per orientation.
+ *
+ * The mesh is not stored: the file keeps its path and its content hash
+ * (VisibilityCache::meshHash), so it can be checked against the mesh it is applied to.
+ * For every row of the checker it stores the ray direction, the hue used for the
+ * orientation, the faces covered and, among them, those hit from the front; then the
+ * orientations selected by the minimization and, for each of them, the faces seen by no
+ * other selected orientation. All the face sets are packed 64 faces per word.
+ * Any orientation can be colored back on the mesh exactly as the legacy OBJ exports.
+ */
+class VisibilityResult
+{
+    public:
+        VisibilityResult();
+
+        void    clear                   ();
+
+        void    setMesh                 (unsigned long long meshKey, unsigned int nFaces, const std::string& meshFile);
+
+        void    addOrientation          (const Vec3& direction, int color,
+                                         const std::vector<int>& covered, const FaceBitset& front);
+
+        void    setSelection            (const std::vector<int>& orientationSelected,
+                                         const std::vector<std::vector<int>>& uniqueTriangle);
+
+        bool    save                    (const std::string& filename) const;
+
+        bool    load                    (const std::string& filename);
+
+        unsigned long long getMeshKey   () const;
+
+        unsigned int getNumberFaces     () const;
+
+        const std::string& getMeshFile  () const;
+
+        unsigned int getNumberOrientations() const;
+
+        Vec3    getDirection            (unsigned int orientation) const;
+
+        const std::vector<int>& getOrientationSelected() const;
+
+        void    colorOrientation        (DrawableEigenMesh* mesh, unsigned int orientation) const;
+
+        void    colorUniqueFaces        (DrawableEigenMesh* mesh, unsigned int orientation) const;
+
+    private:
+
+        typedef std::vector<unsigned long long>                   PackedBitset;
+
+        struct Orientation {
+            Vec3                direction;  //zero for the row of the excluded faces
+            int                 color;
+            PackedBitset        covered;
+            PackedBitset        front;
+        };
+
+        unsigned long long          meshKey;
+        unsigned int                nFaces;
+        std::string                 meshFile;
+        std::vector<Orientation>    orientations;
+        std::vector<int>            orientationSelected;
+        std::vector<PackedBitset>   unique;     //one for each selected orientation
+
+        unsigned int words              () const;
+};
+
+#endif // VISIBILITYRESULT_H